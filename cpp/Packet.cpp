@@ -6,19 +6,33 @@
 
 namespace wcpp {
 
+void invalidEntryName() {}
+
+static inline uint16_t nameBits(const uint8_t* buf) {
+  return (buf[0] | buf[1] << 8) & EntryName::mask;
+}
+
 Entry::Name &Entry::Name::operator=(const char name[2]) {
-  buf_[0] = (buf_[0] & 0b11100000) | (name[0] & 0b00011111);
-  buf_[1] = (buf_[1] & 0b11100000) | (name[1] & 0b00011111);
+  return *this = EntryName::masked(name);
+}
+
+Entry::Name &Entry::Name::operator=(EntryName name) {
+  buf_[0] = (buf_[0] & 0b11100000) | (name.bits() & 0xFF);
+  buf_[1] = (buf_[1] & 0b11100000) | (name.bits() >> 8);
   return *this;
 }
 
 bool Entry::Name::operator==(const char name[2]) {
-  return (buf_[0] & 0b00011111) == (name[0] & 0b00011111) &&
-         (buf_[1] & 0b00011111) == (name[1] & 0b00011111);
+  return nameBits(buf_) == EntryName::masked(name).bits();
+}
+
+bool Entry::Name::operator==(EntryName name) {
+  return nameBits(buf_) == name.bits();
 }
 
 bool Entry::Name::operator==(Name name) {
-  return *this == name.buf_;
+  return (buf_[0] & 0b00011111) == (name.buf_[0] & 0b00011111) &&
+         (buf_[1] & 0b00011111) == (name.buf_[1] & 0b00011111);
 }
 
 char Entry::Name::operator[](int i) const {
@@ -32,8 +46,9 @@ Entry::Name Entry::name() const {
   return Name(entries_.buf_ + ptr_); 
 }
 
-uint8_t Entry::size() const {
-  uint8_t type = getType();
+// Payload size of an entry of type, whose payload starts at payload. Bytes
+// with a length of 255 come to 256, which no valid packet holds.
+static inline unsigned payloadSize(uint8_t type, const uint8_t* payload) {
   if (type == 0b000000 || type == 0b000100 || type & 0b100000)
     return 0; // null, 0.0f, short int
   if ((type & 0b110000) == 0b010000)
@@ -41,15 +56,19 @@ uint8_t Entry::size() const {
   if (type >= 0b000101 && type <= 0b000111)
     return 1 << (type & 0b000011); // float
   if (type == 0b000011)
-    return 1 + entries_.buf_[ptr_ + entry_type_size]; // bytes
+    return 1 + payload[0]; // bytes
   if (type == 0b000001 || type == 0b000010)
-    return entries_.buf_[ptr_ + entry_type_size]; // struct, packet
+    return payload[0]; // struct, packet
   if ((type & 0b111000) == 0b001000)
     return type & 0b000111; // short bytes
 
   return 0;
 }
 
+uint8_t Entry::size() const {
+  return payloadSize(getType(), entries_.buf_ + ptr_ + entry_type_size);
+}
+
 Entry::operator bool() const {
   return ptr_ + entry_type_size < entries_.buf_size_;
 }
@@ -61,6 +80,27 @@ void Entry::setType(uint8_t type) {
     (entries_.buf_[ptr_ + 1] & 0b00011111) | ((type & 0b111000) << 2);
 }
 
+Entry::Kind Entry::kind() const {
+  static const Kind kinds[64] = {
+    Kind::null,     Kind::structure, Kind::packet,  Kind::bytes,
+    Kind::float32,  Kind::float16,   Kind::float32, Kind::float64,
+    Kind::bytes,    Kind::bytes,     Kind::bytes,   Kind::bytes,
+    Kind::bytes,    Kind::bytes,     Kind::bytes,   Kind::bytes,
+    Kind::unsigned_int, Kind::unsigned_int, Kind::unsigned_int, Kind::unsigned_int,
+    Kind::unsigned_int, Kind::unsigned_int, Kind::unsigned_int, Kind::unsigned_int,
+    Kind::signed_int,   Kind::signed_int,   Kind::signed_int,   Kind::signed_int,
+    Kind::signed_int,   Kind::signed_int,   Kind::signed_int,   Kind::signed_int,
+    Kind::unsigned_int, Kind::unsigned_int, Kind::unsigned_int, Kind::unsigned_int,
+    Kind::unsigned_int, Kind::unsigned_int, Kind::unsigned_int, Kind::unsigned_int,
+    Kind::unsigned_int, Kind::unsigned_int, Kind::unsigned_int, Kind::unsigned_int,
+    Kind::unsigned_int, Kind::unsigned_int, Kind::unsigned_int, Kind::unsigned_int,
+    Kind::unsigned_int, Kind::unsigned_int, Kind::unsigned_int, Kind::unsigned_int,
+    Kind::unsigned_int, Kind::unsigned_int, Kind::unsigned_int, Kind::unsigned_int,
+    Kind::unsigned_int, Kind::unsigned_int, Kind::unsigned_int, Kind::unsigned_int,
+    Kind::unsigned_int, Kind::unsigned_int, Kind::unsigned_int, Kind::unsigned_int,
+  };
+  return kinds[getType()];
+}
 uint8_t Entry::getType() const {
   return (entries_.buf_[ptr_ + 0] >> 5) |
          ((entries_.buf_[ptr_ + 1] & 0b11100000) >> 2);
@@ -137,25 +177,56 @@ double Entry::getFloat64() const {
   return 0.0;
 }
 
-uint8_t Entry::getBytes(uint8_t *bytes) const {
+const uint8_t* Entry::getBytesBuf(uint8_t& len) const {
   if (matchType(0b000011)) {
-    uint8_t len = getPayload<uint8_t>(1);
-    std::memcpy(bytes, getPayloadBuf() + 1, len);
-    return len;
+    len = getPayload<uint8_t>(1);
+    return getPayloadBuf() + 1;
   }
   if (matchType (0b001000, 0b111000)) {
-    uint8_t len = getType() & 0b000111;
-    std::memcpy(bytes, getPayloadBuf(), len);
-    return len;
+    len = getType() & 0b000111;
+    return getPayloadBuf();
   }
-  return 0;
+  len = 0;
+  return getPayloadBuf();
+}
+uint8_t Entry::getBytes(uint8_t *bytes) const {
+  uint8_t len;
+  const uint8_t* buf = getBytesBuf(len);
+  std::memcpy(bytes, buf, len);
+  return len;
 }
-
 uint8_t Entry::getString(char *str) const {
   uint8_t len = getBytes(reinterpret_cast<uint8_t*>(str));
   str[len] = '\0';
   return len;
 }
+#ifndef ARDUINO
+std::span<const uint8_t> Entry::getBytesView() const {
+  uint8_t len;
+  const uint8_t* buf = getBytesBuf(len);
+  return std::span<const uint8_t>(buf, len);
+}
+std::string_view Entry::getStringView() const {
+  uint8_t len;
+  const uint8_t* buf = getBytesBuf(len);
+  return std::string_view(reinterpret_cast<const char*>(buf), len);
+}
+uint8_t Entry::getBytes(std::span<uint8_t> bytes) const {
+  uint8_t len;
+  const uint8_t* buf = getBytesBuf(len);
+  std::memcpy(bytes.data(), buf, len < bytes.size() ? len : bytes.size());
+  return len;
+}
+uint8_t Entry::getString(std::span<char> str) const {
+  if (str.empty()) return getBytesView().size();
+  uint8_t len;
+  const uint8_t* buf = getBytesBuf(len);
+  size_t n = len < str.size() - 1 ? len : str.size() - 1;
+  std::memcpy(str.data(), buf, n);
+  str[n] = '\0';
+  return len;
+}
+#endif
 
 const Packet Entry::getPacket() const {
   if (isPacket()) return Packet::decode(getPayloadBuf());
@@ -180,12 +251,12 @@ bool Entry::setNull() {
   return true;
 }
 
-bool Entry::setInt(const uint8_t *bytes, uint8_t size, bool is_negative) {
+bool Entry::setInt(const uint8_t *bytes, uint8_t size, bool is_negative, bool fixed) {
   if (size == 0) {
     if (!setSize(0)) return false;
     setType(0b100000);
   }
-  else if (size == 1 && !is_negative && bytes[0] < 32) {
+  else if (size == 1 && !is_negative && bytes[0] < 32 && !fixed) {
     if (!setSize(0)) return false;
     setType(0b100000 | bytes[0]);
   }
@@ -198,8 +269,8 @@ bool Entry::setInt(const uint8_t *bytes, uint8_t size, bool is_negative) {
   return true;
 }
 
-bool Entry::setFloat16(float value) {
-  if (value == 0.0f) {
+bool Entry::setFloat16(float value, bool fixed) {
+  if (value == 0.0f && !fixed) {
     if (!setSize(0))
       return false;
     setType(0b000100);
@@ -215,8 +286,8 @@ bool Entry::setFloat16(float value) {
   return true;
 }
 
-bool Entry::setFloat32(float value) {
-  if (value == 0.0f) {
+bool Entry::setFloat32(float value, bool fixed) {
+  if (value == 0.0f && !fixed) {
     if (!setSize(0))
       return false;
     setType(0b000100);
@@ -230,11 +301,11 @@ bool Entry::setFloat32(float value) {
   return true;
 }
 
-bool Entry::setFloat64(double value) {
+bool Entry::setFloat64(double value, bool fixed) {
   if (sizeof(double) != 8)
-    return setFloat32(value);
+    return setFloat32(value, fixed);
 
-  if (value == 0.0f) {
+  if (value == 0.0f && !fixed) {
     if (!setSize(0))
       return false;
     setType(0b000100);
@@ -276,6 +347,10 @@ SubEntries Entry::setStruct() {
   return SubEntries(entries_, ptr_ + entry_type_size, entries_.buf_, entries_.buf_size_);
 }
 
+SubEntries Entry::editStruct() {
+  return SubEntries(entries_, ptr_ + entry_type_size, entries_.buf_, entries_.buf_size_);
+}
+
 bool Entry::setPacket(const Packet& packet) {
   if (!setSize(packet.size())) return false;
   setType(0b000010);
@@ -283,10 +358,24 @@ bool Entry::setPacket(const Packet& packet) {
   return true; 
 }
 
+bool Entry::copy(const Entry& from) {
+  uint8_t size = from.size();
+  if (!setSize(size)) return false;
+  setType(from.getType());
+  setPayload(from.getPayloadBuf(), size);
+  return true;
+}
+
 bool Entry::setSize(uint8_t size_new) {
+  if (ptr_ + entry_type_size > entries_.buf_size_) return false;
+  if (size_new == size()) return true;
   return entries_.resize(ptr_ + entry_type_size, size_new, size());
 }
 
+const uint8_t* Entry::encode() const {
+  return entries_.buf_ + ptr_;
+}
+
 const uint8_t* Entry::getPayloadBuf() const {
   return entries_.buf_ + ptr_ + entry_type_size;
 }
@@ -311,12 +400,26 @@ EntriesConstIterator &EntriesConstIterator::operator++() {
 
 
 EntriesIterator& EntriesIterator::find(const char name[2]) {
-  while (*this != entries_.end() && (**this).name() == name) ++(*this);
+  return find(EntryName::masked(name));
+}
+
+EntriesIterator& EntriesIterator::find(EntryName name) {
+  while (*this != entries_.end() && nameBits(entries_.buf_ + ptr_) != name.bits()) {
+    WCPP_COUNT(iterator_steps, 1);
+    ++(*this);
+  }
   return *this;
 }
 
 EntriesConstIterator& EntriesConstIterator::find(const char name[2]) {
-  while (*this != entries_.end() && (**this).name() == name) ++(*this);
+  return find(EntryName::masked(name));
+}
+
+EntriesConstIterator& EntriesConstIterator::find(EntryName name) {
+  while (*this != entries_.end() && nameBits(entries_.buf_ + ptr_) != name.bits()) {
+    WCPP_COUNT(iterator_steps, 1);
+    ++(*this);
+  }
   return *this;
 }
 
@@ -325,7 +428,16 @@ Entries::iterator Entries::find(const char name[2]) {
   return itr.find(name);
 }
 
+Entries::iterator Entries::find(EntryName name) {
+  iterator itr = begin();
+  return itr.find(name);
+}
+
 Entry EntriesIterator::insert(const char name[2]) {
+  return insert(EntryName::masked(name));
+}
+
+Entry EntriesIterator::insert(EntryName name) {
   Entry e(entries_, ptr_);
   if (entries_.resize(ptr_, entry_type_size, 0)) {
     e.name() = name;
@@ -339,16 +451,23 @@ Entries::const_iterator Entries::find(const char name[2]) const {
   return itr.find(name);
 }
 
+Entries::const_iterator Entries::find(EntryName name) const {
+  const_iterator itr = begin();
+  return itr.find(name);
+}
+
 
 Entries::iterator Entries::at(unsigned n) {
   iterator itr = begin();
   for (int i = 0; i < n; i++) ++itr;
+  WCPP_COUNT(iterator_steps, n);
   return itr;
 }
 
 Entries::const_iterator Entries::at(unsigned n) const {
   const_iterator itr = begin();
   for (int i = 0; i < n; i++) ++itr;
+  WCPP_COUNT(iterator_steps, n);
   return itr;
 }
 
@@ -356,10 +475,15 @@ Entry Entries::append(const char name[2]) {
   return end().insert(name);
 }
 
+Entry Entries::append(EntryName name) {
+  return end().insert(name);
+}
+
 
 void Entries::clear() {
-  printf("CLEAR %d %d %d\n", offset(), header_size(), size());
-  resize(offset() + header_size(), 0, size() - header_size());
+  WCPP_TRACE("CLEAR %d %d %d\n", offset(), header_size(), size());
+  if (size() > header_size())
+    resize(offset() + header_size(), 0, size() - header_size());
 }
 
 Packet &Packet::command(uint8_t packet_id, uint8_t component_id) {
@@ -407,6 +531,35 @@ Packet &Packet::telemetry(uint8_t packet_id, uint8_t component_id,
   return *this;
 };
 
+// The entries between begin and end must fill it exactly
+static bool validEntries(const uint8_t* buf, unsigned begin, unsigned end) {
+  unsigned ptr = begin;
+  while (ptr < end) {
+    if (ptr + entry_type_size > end) return false;
+    uint8_t type = (buf[ptr] >> 5) | ((buf[ptr + 1] & 0b11100000) >> 2);
+    unsigned payload = ptr + entry_type_size;
+    // bytes, struct and packet start with a length byte
+    bool counted = type == 0b000001 || type == 0b000010 || type == 0b000011;
+    if (counted && payload >= end) return false;
+
+    unsigned size = payloadSize(type, buf + payload);
+    if (payload + size > end) return false;
+    if (type == 0b000001 && (size == 0 || !validEntries(buf, payload + 1, payload + size)))
+      return false;
+    if (type == 0b000010 && !Packet::validate(buf + payload, size))
+      return false;
+    ptr = payload + size;
+  }
+  return true;
+}
+
+bool Packet::validate(const uint8_t* buf, size_t length) {
+  if (length < 4 || buf[0] > length) return false;
+  unsigned header = buf[3] == unit_id_local ? 4 : 7;
+  if (buf[0] < header) return false;
+  return validEntries(buf, header, buf[0]);
+}
+
 Packet& Packet::operator=(const Packet& packet) {
   if (!isNull() && ref_change_ != nullptr) ref_change_(*this, -1);
   buf_ = packet.buf_;
@@ -426,11 +579,19 @@ Packet& Packet::operator=(Packet&& packet) {
   return *this;
 }
 
+bool Packet::copyHeader(const Packet& from) {
+  if (buf_size_ < from.header_size()) return false;
+
+  std::memcpy(buf_ + 1, from.buf_ + 1, from.header_size() - 1);
+  buf_[0] = from.header_size();
+  return true;
+}
+
 bool Packet::copyPayload(const Packet& from) {
   if (buf_size_ - header_size() < from.size() - from.header_size()) return false;
 
   buf_[0] = header_size() + from.size() - from.header_size();
-  std::memcpy(buf_ + header_size(), from.buf_ + header_size(),
+  std::memcpy(buf_ + header_size(), from.buf_ + from.header_size(),
               from.size() - from.header_size());
   return true;
 }
@@ -442,27 +603,78 @@ bool Packet::copy(const Packet& from) {
   return true;
 }
 
-void Packet::clear() {
+void Packet::release() {
   if (!isNull() && ref_change_ != nullptr) ref_change_(*this, -1);
   buf_ = nullptr;
 }
 
 
 bool Packet::resize(uint8_t ptr, uint8_t size_from_ptr, uint8_t size_from_ptr_old) {
-  // printf("RESIZE P %d %d %d %d\n", ptr, size_from_ptr, size_from_ptr_old, buf_size_);
-  if (size() + size_from_ptr - size_from_ptr_old > buf_size_) return false;
-  std::memmove(buf_ + ptr + size_from_ptr, buf_ + ptr + size_from_ptr_old, size() - ptr - size_from_ptr_old);
+  WCPP_TRACE("RESIZE P %d %d %d %d\n", ptr, size_from_ptr, size_from_ptr_old, buf_size_);
+  WCPP_COUNT(packet_resize, 1);
+  if (size() + size_from_ptr - size_from_ptr_old > buf_size_) {
+    WCPP_COUNT(resize_failed, 1);
+    return false;
+  }
+  uint8_t tail = size() - ptr - size_from_ptr_old;
+  WCPP_COUNT(memmove_bytes, tail);
+  if (tail > 0) std::memmove(buf_ + ptr + size_from_ptr, buf_ + ptr + size_from_ptr_old, tail);
   buf_[0] += size_from_ptr - size_from_ptr_old;
   return true;
 }
 
 bool SubEntries::resize(uint8_t ptr, uint8_t size_from_ptr, uint8_t size_from_ptr_old) {
-  // printf("RESIZE S %d %d %d %d %d %d\n", offset(), size(), ptr, size_from_ptr, size_from_ptr_old, buf_size_);
-  if (size() + size_from_ptr - size_from_ptr_old + offset() > buf_size_) return false;
+  WCPP_TRACE("RESIZE S %d %d %d %d %d %d\n", offset(), size(), ptr, size_from_ptr, size_from_ptr_old, buf_size_);
+  WCPP_COUNT(sub_entries_resize, 1);
+  if (size() + size_from_ptr - size_from_ptr_old + offset() > buf_size_) {
+    WCPP_COUNT(resize_failed, 1);
+    return false;
+  }
   if (!parent_.resize(ptr, size_from_ptr, size_from_ptr_old)) return false;
   buf_[offset()] += size_from_ptr - size_from_ptr_old;
   return true;
 }
 
+void SubEntries::adjustSize(int diff) {
+  buf_[offset()] += diff;
+  parent_.adjustSize(diff);
+}
+
+
+StructEdit::StructEdit(SubEntries& target)
+  : Entries(target.buf_, target.buf_size_), parent_(target.parent_),
+    ptr_(target.ptr_), size_old_(target.size()), open_(true) {
+  uint8_t end = ptr_ + size_old_;
+  tail_ = target.data_end() - end;
+  buf_size_ -= tail_;
+  WCPP_COUNT(memmove_bytes, tail_);
+  if (tail_ > 0) std::memmove(buf_ + buf_size_, buf_ + end, tail_);
+}
+
+void StructEdit::commit() {
+  if (!open_) return;
+  open_ = false;
+
+  uint8_t end = ptr_ + size();
+  WCPP_COUNT(memmove_bytes, tail_);
+  if (tail_ > 0) std::memmove(buf_ + end, buf_ + buf_size_, tail_);
+  buf_size_ += tail_;
+  parent_.adjustSize(size() - size_old_);
+}
+
+bool StructEdit::resize(uint8_t ptr, uint8_t size_from_ptr, uint8_t size_from_ptr_old) {
+  WCPP_TRACE("RESIZE E %d %d %d %d %d %d\n", offset(), size(), ptr, size_from_ptr, size_from_ptr_old, buf_size_);
+  WCPP_COUNT(sub_entries_resize, 1);
+  if (!open_ || ptr_ + size() + size_from_ptr - size_from_ptr_old > buf_size_) {
+    WCPP_COUNT(resize_failed, 1);
+    return false;
+  }
+  uint8_t tail = ptr_ + size() - ptr - size_from_ptr_old;
+  WCPP_COUNT(memmove_bytes, tail);
+  if (tail > 0) std::memmove(buf_ + ptr + size_from_ptr, buf_ + ptr + size_from_ptr_old, tail);
+  buf_[ptr_] += size_from_ptr - size_from_ptr_old;
+  return true;
+}
+
 
 } // namespace wccp
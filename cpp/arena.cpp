@@ -0,0 +1,106 @@
+#include "arena.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace wcpp {
+
+// Blocks are aligned to their size, so a buffer finds its block by masking
+// its address. The arena holds one reference to each of its blocks.
+
+static constexpr uint32_t data_offset = (sizeof(ArenaBlock) + 7) & ~7;
+
+PacketArena::~PacketArena() {
+  reset();
+  if (current_ != nullptr) drop(current_);
+  while (spare_ != nullptr) {
+    ArenaBlock* b = spare_;
+    spare_ = b->next;
+    drop(b);
+  }
+}
+
+Packet PacketArena::allocate(uint8_t size, bool pin) {
+  if (size == 0) return Packet::null();
+  if (current_ == nullptr || current_->used + size > block_size) {
+    if (!next()) return Packet::null();
+  }
+  uint8_t* buf = reinterpret_cast<uint8_t*>(current_) + current_->used;
+  current_->used += size;
+  if (!pin) return Packet::empty(buf, size);
+
+  current_->refs.fetch_add(1, std::memory_order_relaxed);
+  return Packet::empty(buf, size, &PacketArena::refChange);
+}
+
+Packet PacketArena::copy(const Packet& packet, bool pin) {
+  if (packet.isNull()) return Packet::null();
+  Packet p = allocate(packet.size(), pin);
+  if (!p.isNull()) std::memcpy(p.getBuf(), packet.encode(), packet.size());
+  return p;
+}
+
+void PacketArena::reset() {
+  if (current_ != nullptr) {
+    current_->next = full_;
+    full_ = current_;
+    current_ = nullptr;
+  }
+  while (full_ != nullptr) {
+    ArenaBlock* b = full_;
+    full_ = b->next;
+    if (b->refs.load(std::memory_order_acquire) == 1) {
+      b->used = data_offset;
+      b->next = spare_;
+      spare_ = b;
+    }
+    else {
+      // Pinned by packets still in use, the last of them frees it
+      blocks_--;
+      drop(b);
+    }
+  }
+}
+
+bool PacketArena::next() {
+  ArenaBlock* b = spare_;
+  if (b != nullptr) {
+    spare_ = b->next;
+  }
+  else {
+    void* mem = std::aligned_alloc(block_size, block_size);
+    if (mem == nullptr) return false;
+    b = new (mem) ArenaBlock;
+    b->refs.store(1, std::memory_order_relaxed);
+    b->used = data_offset;
+    blocks_++;
+  }
+  if (current_ != nullptr) {
+    current_->next = full_;
+    full_ = current_;
+  }
+  current_ = b;
+  return true;
+}
+
+void PacketArena::drop(ArenaBlock* b) {
+  if (b->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    b->~ArenaBlock();
+    std::free(b);
+  }
+}
+
+PacketArena& PacketArena::local() {
+  static thread_local PacketArena arena;
+  return arena;
+}
+
+void PacketArena::refChange(const Packet& packet, int change) {
+  if (packet.isNull()) return;
+  ArenaBlock* b = block(packet.encode());
+  if (change > 0) b->refs.fetch_add(1, std::memory_order_relaxed);
+  else            drop(b);
+}
+
+} // namespace wcpp
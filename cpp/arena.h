@@ -0,0 +1,63 @@
+#pragma once
+
+#include "packet.h"
+
+#include <atomic>
+#include <cstddef>
+
+namespace wcpp {
+
+// Bump allocator for packet buffers, for decoding and re-encoding bursts of
+// packets without a malloc per packet.
+//
+// Buffers are carved out of large blocks and all returned at once by
+// reset(). A pinned packet carries PacketArena::refChange as its
+// ref_change_t and keeps its block alive across reset() until the last copy
+// is gone; unpinned packets are plain views valid until the next reset().
+//
+// An arena is not thread safe. Use one per thread, e.g. PacketArena::local().
+// Pinned packets may be released from any thread.
+
+struct ArenaBlock {
+  std::atomic<int> refs;
+  ArenaBlock* next;
+  uint32_t used;
+};
+
+class PacketArena {
+public:
+  static constexpr uint32_t block_size = 1 << 16;
+
+  PacketArena() : current_(nullptr), full_(nullptr), spare_(nullptr), blocks_(0) {}
+  ~PacketArena();
+
+  PacketArena(const PacketArena&) = delete;
+  PacketArena& operator=(const PacketArena&) = delete;
+
+  Packet allocate(uint8_t size = size_max, bool pin = false);
+  // The copy's buffer is exactly the size of the packet
+  Packet copy(const Packet& packet, bool pin = false);
+
+  void reset();
+
+  // Blocks owned by the arena, in use or spare
+  inline uint32_t blocks() const { return blocks_; }
+
+  static PacketArena& local();
+
+  static void refChange(const Packet& packet, int change);
+
+private:
+  ArenaBlock* current_;
+  ArenaBlock* full_;
+  ArenaBlock* spare_;
+  uint32_t blocks_;
+
+  static inline ArenaBlock* block(const uint8_t* buf) {
+    return reinterpret_cast<ArenaBlock*>(reinterpret_cast<uintptr_t>(buf) & ~(uintptr_t)(block_size - 1));
+  }
+  bool next();
+  static void drop(ArenaBlock* block);
+};
+
+} // namespace wcpp
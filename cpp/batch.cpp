@@ -0,0 +1,97 @@
+#include "batch.h"
+
+#include <cstring>
+
+namespace wcpp {
+
+bool Batch::push(const Packet& packet, uint32_t now, uint8_t priority) {
+  uint8_t size = packet.size();
+  if (packet.isNull() || size == 0) return false;
+  if (size + batch_trailer_size > mtu_) return false;
+  if (count_ >= slots_size_ || used_ + size > buf_size_) return false;
+
+  std::memcpy(buf_ + used_, packet.encode(), size);
+  slots_[count_].offset = used_;
+  slots_[count_].size = size;
+  slots_[count_].priority = priority;
+  slots_[count_].deadline = now + max_delay_;
+  used_ += size;
+  count_++;
+  return true;
+}
+
+bool Batch::ready(uint32_t now) const {
+  if (count_ == 0) return false;
+  if (used_ + batch_trailer_size >= mtu_ || count_ >= slots_size_) return true;
+  for (int i = 0; i < count_; i++) {
+    if ((int32_t)(now - slots_[i].deadline) >= 0) return true;
+  }
+  return false;
+}
+
+uint8_t Batch::flush(uint8_t* frame) {
+  if (count_ == 0) return 0;
+
+  // Highest priority first, oldest first within a priority
+  uint8_t length = 0;
+  while (true) {
+    int best = -1;
+    for (int i = 0; i < count_; i++) {
+      if (length + slots_[i].size + batch_trailer_size > mtu_) continue;
+      if (best < 0 || slots_[i].priority > slots_[best].priority) best = i;
+    }
+    if (best < 0) break;
+    std::memcpy(frame + length, buf_ + slots_[best].offset, slots_[best].size);
+    length += slots_[best].size;
+    remove(best);
+  }
+
+  frame[length] = Packet::checksum(frame, length);
+  return length + batch_trailer_size;
+}
+
+void Batch::remove(uint8_t i) {
+  uint8_t offset = slots_[i].offset;
+  uint8_t size = slots_[i].size;
+  std::memmove(buf_ + offset, buf_ + offset + size, used_ - offset - size);
+  used_ -= size;
+  for (int j = i; j < count_ - 1; j++) slots_[j] = slots_[j + 1];
+  count_--;
+  for (int j = 0; j < count_; j++) {
+    if (slots_[j].offset > offset) slots_[j].offset -= size;
+  }
+}
+
+
+bool Unbatcher::isValidAt(const uint8_t* frame, uint8_t ptr, uint8_t end) {
+  if (ptr + 4 > end) return false;
+  uint8_t size = frame[ptr];
+  uint8_t header_size = frame[ptr + 3] == unit_id_local ? 4 : 7;
+  return size >= header_size && ptr + size <= end;
+}
+
+Unbatcher::iterator &Unbatcher::iterator::operator++() {
+  ptr_ += frame_[ptr_];
+  if (!isValidAt(frame_, ptr_, end_)) ptr_ = end_;
+  return *this;
+}
+
+Unbatcher::iterator Unbatcher::begin() const {
+  uint8_t end = payloadSize();
+  return iterator(frame_, isValidAt(frame_, 0, end) ? 0 : end, end);
+}
+
+bool Unbatcher::isValid() const {
+  if (length_ <= batch_trailer_size) return false;
+  uint8_t end = payloadSize();
+  if (Packet::checksum(frame_, end) != frame_[end]) return false;
+
+  uint8_t ptr = 0;
+  while (ptr < end) {
+    if (!isValidAt(frame_, ptr, end)) return false;
+    ptr += frame_[ptr];
+  }
+  return true;
+}
+
+} // namespace wcpp
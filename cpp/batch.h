@@ -0,0 +1,97 @@
+#pragma once
+
+#include "packet.h"
+
+namespace wcpp {
+
+// Several packets in one link frame:
+//   packet * N (each starting with its size byte) | CRC8 of the whole frame
+// The per-packet checksums are replaced by the single trailer.
+
+constexpr uint8_t batch_trailer_size = 1;
+
+struct BatchSlot {
+  uint8_t offset;
+  uint8_t size;
+  uint8_t priority;
+  uint32_t deadline;
+};
+
+class Batch {
+public:
+  Batch(uint8_t* buf, uint8_t buf_size, BatchSlot* slots, uint8_t slots_size,
+        uint8_t mtu, uint32_t max_delay)
+    : buf_(buf), buf_size_(buf_size), slots_(slots), slots_size_(slots_size),
+      mtu_(mtu), max_delay_(max_delay), used_(0), count_(0) {}
+
+  bool push(const Packet& packet, uint32_t now, uint8_t priority = 0);
+
+  bool ready(uint32_t now) const;
+  uint8_t flush(uint8_t* frame);
+
+  inline uint8_t count() const { return count_; }
+  inline bool empty() const { return count_ == 0; }
+  inline uint8_t mtu() const { return mtu_; }
+
+private:
+  uint8_t* buf_;
+  uint8_t buf_size_;
+  BatchSlot* slots_;
+  uint8_t slots_size_;
+  uint8_t mtu_;
+  uint32_t max_delay_;
+  uint8_t used_;
+  uint8_t count_;
+
+  void remove(uint8_t i);
+};
+
+template <uint8_t MTU, uint8_t N = 16> class StaticBatch : public Batch {
+public:
+  StaticBatch(uint32_t max_delay)
+    : Batch(buf_, sizeof(buf_), slots_, N, MTU, max_delay) {}
+
+private:
+  uint8_t buf_[MTU * 2 > size_max ? size_max : MTU * 2];
+  BatchSlot slots_[N];
+};
+
+
+class Unbatcher {
+public:
+  class iterator {
+  public:
+    inline const Packet operator*() const { return Packet::decode(frame_ + ptr_); }
+    iterator &operator++();
+    inline bool operator==(const iterator &i) const { return ptr_ == i.ptr_; }
+    inline bool operator!=(const iterator &i) const { return ptr_ != i.ptr_; }
+
+  private:
+    const uint8_t* frame_;
+    uint8_t ptr_;
+    uint8_t end_;
+
+    iterator(const uint8_t* frame, uint8_t ptr, uint8_t end)
+      : frame_(frame), ptr_(ptr), end_(end) {}
+
+    friend Unbatcher;
+  };
+
+  Unbatcher(const uint8_t* frame, uint8_t length) : frame_(frame), length_(length) {}
+
+  bool isValid() const;
+
+  iterator begin() const;
+  inline iterator end() const { return iterator(frame_, payloadSize(), payloadSize()); }
+
+private:
+  const uint8_t* frame_;
+  uint8_t length_;
+
+  inline uint8_t payloadSize() const {
+    return length_ < batch_trailer_size ? 0 : length_ - batch_trailer_size;
+  }
+  static bool isValidAt(const uint8_t* frame, uint8_t ptr, uint8_t end);
+};
+
+} // namespace wcpp
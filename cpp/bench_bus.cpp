@@ -0,0 +1,88 @@
+#include "bus.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// One publisher decoding telemetry into pooled buffers and eight subscribers
+// (logger, TUI, web bridge, alarms, ...) each draining their own queue.
+
+int main() {
+  const unsigned packets = 2000000;
+  const unsigned subscribers = 8;
+
+  static wcpp::StaticPacketPool<4096> pool;
+  wcpp::Bus bus(pool);
+
+  wcpp::Subscriber* s[subscribers];
+  for (unsigned i = 0; i < subscribers; i++) {
+    wcpp::BusFilter filter;
+    if (i == 5) filter.component_id = 0x10;
+    if (i == 6) filter.name("Ax");
+    if (i == 7) filter.type_and_id = 0x80 | 0x02;
+    // The logger must see everything, the others may drop under load
+    s[i] = bus.subscribe(filter, 1024, i == 0 ? wcpp::BusPolicy::block : wcpp::BusPolicy::drop);
+  }
+
+  std::atomic<bool> done(false);
+  std::vector<std::thread> threads;
+  uint64_t checksums[subscribers] = {};
+  for (unsigned i = 0; i < subscribers; i++) {
+    threads.emplace_back([&, i]() {
+      uint8_t buf[wcpp::size_max];
+      wcpp::Packet out = wcpp::Packet::empty(buf, wcpp::size_max);
+      uint64_t sum = 0;
+      while (true) {
+        if (s[i]->receive(out)) {
+          sum += out.size();
+          continue;
+        }
+        if (done.load(std::memory_order_acquire)) {
+          while (s[i]->receive(out)) sum += out.size();
+          break;
+        }
+        std::this_thread::yield();
+      }
+      checksums[i] = sum;
+    });
+  }
+
+  uint8_t frame[wcpp::size_max];
+  wcpp::Packet templ = wcpp::Packet::empty(frame, wcpp::size_max);
+
+  auto t0 = std::chrono::steady_clock::now();
+  unsigned starved = 0;
+  for (unsigned n = 0; n < packets; n++) {
+    templ.telemetry(n % 4, n % 2 ? 0x10 : 0x20, 0x01, 0xFE, n);
+    templ.append("Ax").setFloat32(n * 0.5f);
+    templ.append("Ay").setInt(n);
+
+    wcpp::Packet p = pool.allocate();
+    while (p.isNull()) {
+      starved++;
+      std::this_thread::yield();
+      p = pool.allocate();
+    }
+    p.copyHeader(templ);
+    p.copyPayload(templ);
+    bus.publish(p);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  done.store(true, std::memory_order_release);
+  for (auto& t : threads) t.join();
+  auto t2 = std::chrono::steady_clock::now();
+
+  double publish_s = std::chrono::duration<double>(t1 - t0).count();
+  double total_s = std::chrono::duration<double>(t2 - t0).count();
+  printf("%u packets, %u subscribers\n", packets, subscribers);
+  printf("publish: %.2f Mpacket/s, drained: %.2f Mpacket/s, pool starved %u times\n",
+         packets / publish_s / 1e6, packets / total_s / 1e6, starved);
+  for (unsigned i = 0; i < subscribers; i++) {
+    printf("subscriber %u: delivered %llu, dropped %llu\n", i,
+           (unsigned long long)s[i]->delivered(), (unsigned long long)s[i]->dropped());
+  }
+  printf("pool: %u / %u available\n", pool.available(), pool.count());
+  return 0;
+}
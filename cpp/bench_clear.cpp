@@ -0,0 +1,95 @@
+#include "packet.h"
+
+#include <chrono>
+#include <cstdio>
+
+// The telemetry reuse loop: clear the packet and rebuild it, 1000 times a
+// second on the MCU. Compares Packet::clear() with the generic
+// Entries::clear(), which goes through resize().
+
+static void build(wcpp::Packet& p, unsigned i) {
+  p.append("Ct").setInt(i);
+  p.append("Ax").setFloat32(i * 0.01f);
+  p.append("Ay").setFloat32(i * 0.02f);
+  p.append("Az").setFloat32(i * 0.03f);
+  auto st = p.append("Gp").setStruct();
+  st.append("La").setFloat64(35.0 + i * 1e-7);
+  st.append("Lo").setFloat64(139.0 + i * 1e-7);
+  st.append("Al").setInt(i % 4000);
+  p.append("St").setInt(i % 8);
+}
+
+template <typename F> static double measure(unsigned iterations, F clear) {
+  uint8_t buf[wcpp::size_max];
+  wcpp::Packet p = wcpp::Packet::empty(buf, wcpp::size_max);
+  p.telemetry(0x10, 0x20);
+
+  unsigned checksum = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < iterations; i++) {
+    clear(p);
+    build(p, i);
+    checksum += p.size();
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  if (checksum == 0) printf("unexpected\n");
+  return std::chrono::duration<double, std::nano>(t1 - t0).count() / iterations;
+}
+
+static double measureTemplate(unsigned iterations) {
+  uint8_t buf[wcpp::size_max];
+  wcpp::Packet p = wcpp::Packet::empty(buf, wcpp::size_max);
+  p.telemetry(0x10, 0x20);
+  wcpp::Entry ct = p.append("Ct");
+  ct.setInt(0, 4);
+  wcpp::Entry ax = p.append("Ax");
+  ax.setFloat32(0.0f, true);
+  wcpp::Entry ay = p.append("Ay");
+  ay.setFloat32(0.0f, true);
+  wcpp::Entry az = p.append("Az");
+  az.setFloat32(0.0f, true);
+  auto st = p.append("Gp").setStruct();
+  wcpp::Entry la = st.append("La");
+  la.setFloat64(0.0, true);
+  wcpp::Entry lo = st.append("Lo");
+  lo.setFloat64(0.0, true);
+  wcpp::Entry al = st.append("Al");
+  al.setInt(0, 2);
+  wcpp::Entry s = p.append("St");
+  s.setInt(0, 1);
+
+  unsigned checksum = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < iterations; i++) {
+    ct.setInt(i, 4);
+    ax.setFloat32(i * 0.01f, true);
+    ay.setFloat32(i * 0.02f, true);
+    az.setFloat32(i * 0.03f, true);
+    la.setFloat64(35.0 + i * 1e-7, true);
+    lo.setFloat64(139.0 + i * 1e-7, true);
+    al.setInt(i % 4000, 2);
+    s.setInt(i % 8, 1);
+    checksum += p.size();
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  if (checksum == 0) printf("unexpected\n");
+  return std::chrono::duration<double, std::nano>(t1 - t0).count() / iterations;
+}
+
+int main() {
+  const unsigned iterations = 1000000;
+
+  double fast = measure(iterations, [](wcpp::Packet& p) { p.clear(); });
+  double generic = measure(iterations, [](wcpp::Packet& p) {
+    static_cast<wcpp::Entries&>(p).clear();
+  });
+  double header = measure(iterations, [](wcpp::Packet& p) { p.telemetry(0x10, 0x20); });
+  double templ = measureTemplate(iterations);
+
+  printf("%u iterations of clear + rebuild\n", iterations);
+  printf("Packet::clear()    %.1f ns\n", fast);
+  printf("Entries::clear()   %.1f ns\n", generic);
+  printf("Packet::telemetry  %.1f ns\n", header);
+  printf("fixed-width update %.1f ns\n", templ);
+  return 0;
+}
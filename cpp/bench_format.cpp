@@ -0,0 +1,47 @@
+#include "format.h"
+#include "deframer.h"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+// Converts a framed log of typical telemetry to NDJSON in memory and reports
+// output MB/s.
+
+int main() {
+  const unsigned packets = 1000000;
+
+  std::vector<uint8_t> log;
+  for (unsigned i = 0; i < packets; i++) {
+    uint8_t buf[wcpp::size_max], f[wcpp::size_max + wcpp::frame_overhead];
+    wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+    p.telemetry(i % 8, 0x10, 1, 2, i);
+    p.append("Ax").setFloat32(0.001f * i);
+    p.append("Ay").setFloat32(-0.5f * (i % 100));
+    p.append("Az").setFloat16(9.8f);
+    p.append("Ct").setInt(i);
+    wcpp::SubEntries gps = p.append("Gp").setStruct();
+    gps.append("La").setFloat64(35.0 + 1e-7 * i);
+    gps.append("Lo").setFloat64(139.0 - 1e-7 * i);
+    p.append("St").setString("ok");
+    uint16_t n = wcpp::frame(p, f);
+    log.insert(log.end(), f, f + n);
+  }
+
+  FILE* in = fmemopen(log.data(), log.size(), "rb");
+  std::vector<char> text(packets * 256);
+  FILE* out = fmemopen(text.data(), text.size(), "w");
+
+  auto start = std::chrono::steady_clock::now();
+  uint64_t count = wcpp::convertLog(in, out, wcpp::LogFormat::framed);
+  long written = ftell(out);
+  auto end = std::chrono::steady_clock::now();
+  fclose(in);
+  fclose(out);
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  printf("%llu packets, %.1f MB in, %.1f MB out\n", (unsigned long long)count,
+         log.size() / 1e6, written / 1e6);
+  printf("%.0f packets/s, %.0f MB/s out\n", count / seconds, written / 1e6 / seconds);
+  return count == packets ? 0 : 1;
+}
@@ -0,0 +1,99 @@
+#include "pipeline.h"
+#include "workload.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// Two links of framed telemetry from memory through the whole pipeline,
+// with a subscriber draining the bus, the log going to memory and the
+// cache updated. Reports packets/s and the latency of each stage; with
+// "trace", also traces every packet and dumps the tracer.
+
+static std::vector<uint8_t> stream(unsigned packets, uint8_t unit) {
+  std::mt19937_64 rand(unit);
+  std::vector<uint8_t> bytes;
+  for (unsigned i = 0; i < packets; i++) {
+    uint8_t entries[wcpp::size_max], buf[wcpp::size_max], f[wcpp::size_max + wcpp::frame_overhead];
+    wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+    p.telemetry(i % 16, 0x10, unit, 0xFE, i / 16);
+    p.copyPayload(wcpp::generatePacket(wcpp::workload_telemetry, entries, rand));
+    uint16_t n = wcpp::frame(p, f);
+    bytes.insert(bytes.end(), f, f + n);
+  }
+  return bytes;
+}
+
+int main(int argc, char** argv) {
+  bool trace = argc > 1 && std::strcmp(argv[1], "trace") == 0;
+  const unsigned packets = 1000000;
+  const unsigned links = 2;
+
+  std::vector<uint8_t> streams[links];
+  for (unsigned i = 0; i < links; i++) streams[i] = stream(packets, i + 1);
+
+  static wcpp::StaticPacketPool<8192> pool;
+  wcpp::Bus bus(pool);
+  wcpp::Subscriber* s = bus.subscribe(wcpp::BusFilter(), 1024, wcpp::BusPolicy::block);
+  static wcpp::StaticTelemetryCache<256> cache;
+  std::vector<char> log_buf(links * streams[0].size() * 2);
+  FILE* log = fmemopen(log_buf.data(), log_buf.size(), "w");
+
+  wcpp::Pipeline pipeline(pool, 1024);
+  for (unsigned i = 0; i < links; i++) {
+    const std::vector<uint8_t>& bytes = streams[i];
+    size_t pos = 0;
+    pipeline.addLink([&bytes, pos](uint8_t* buf, size_t size) mutable -> long {
+      if (pos == bytes.size()) return -1;
+      size_t n = std::min(size, bytes.size() - pos);
+      std::memcpy(buf, bytes.data() + pos, n);
+      pos += n;
+      return n;
+    });
+  }
+  pipeline.routeTo(bus);
+  pipeline.logTo(log);
+  pipeline.cacheTo(cache);
+  wcpp::Tracer tracer;
+  if (trace) {
+    pipeline.traceTo(tracer);
+    bus.traceTo(tracer);
+  }
+
+  std::atomic<bool> done(false);
+  uint64_t received = 0;
+  std::thread consumer([&]() {
+    uint8_t buf[wcpp::size_max];
+    wcpp::Packet out = wcpp::Packet::empty(buf, sizeof(buf));
+    while (true) {
+      bool last = done.load(std::memory_order_acquire);
+      if (s->receive(out)) received++;
+      else if (last) break;
+      else std::this_thread::yield();
+    }
+  });
+
+  auto start = std::chrono::steady_clock::now();
+  pipeline.start();
+  pipeline.join();
+  auto end = std::chrono::steady_clock::now();
+  done.store(true, std::memory_order_release);
+  consumer.join();
+  fclose(log);
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  printf("%u links, %u frames, %u errors, %llu received: %.2f Mpacket/s\n", links,
+         pipeline.frames(), pipeline.errors(), (unsigned long long)received,
+         pipeline.frames() / seconds / 1e6);
+  const char* names[] = {"validate", "route", "log", "cache"};
+  printf("latency from the end of the frame, us:\n");
+  for (unsigned i = 0; i < wcpp::pipeline_stages; i++) {
+    const wcpp::LatencyHistogram& h = pipeline.latency((wcpp::PipelineStage)i);
+    printf("  %-9s p50 %8.1f  p99 %8.1f  p99.9 %8.1f  max %8.1f\n", names[i],
+           h.percentile(0.5) / 1e3, h.percentile(0.99) / 1e3, h.percentile(0.999) / 1e3,
+           h.max() / 1e3);
+  }
+  if (trace) tracer.dump(stdout);
+  return received == links * packets ? 0 : 1;
+}
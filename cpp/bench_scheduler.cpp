@@ -0,0 +1,113 @@
+#include "scheduler.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+// Simulates a flight computer producing more telemetry than the radio can
+// carry. Streams produce at their own rate, commands arrive at random and the
+// link drains one packet whenever its byte budget allows.
+
+struct SimStream {
+  uint8_t packet_id;
+  uint8_t component_id;
+  uint32_t produce_period;
+  uint8_t weight;
+  uint32_t min_period;
+  uint8_t entries;
+  unsigned produced;
+  unsigned sent;
+};
+
+int main() {
+  SimStream streams[] = {
+    {0x01, 0x10, 10,   4, 50,   8, 0, 0}, // attitude, 100 Hz
+    {0x02, 0x10, 20,   2, 100,  6, 0, 0}, // IMU raw, 50 Hz
+    {0x03, 0x20, 100,  2, 200,  4, 0, 0}, // GNSS, 10 Hz
+    {0x04, 0x30, 100,  1, 500,  3, 0, 0}, // power
+    {0x05, 0x30, 200,  1, 1000, 10, 0, 0}, // thermal
+    {0x06, 0x40, 1000, 8, 0,    2, 0, 0}, // status
+    {0x07, 0x40, 50,   1, 0,    12, 0, 0}, // debug
+    {0x08, 0x50, 25,   1, 0,    5, 0, 0}, // barometer
+  };
+  const unsigned stream_count = sizeof(streams) / sizeof(streams[0]);
+
+  const uint32_t duration = 600000;   // [ms]
+  const unsigned link_rate = 1200;    // [byte/s], roughly LoRa SF9 125 kHz
+
+  wcpp::StaticScheduler<16, 1024> scheduler;
+  for (auto& s : streams) scheduler.configure(s.packet_id, s.component_id, s.weight, s.min_period);
+
+  std::mt19937 engine(1);
+  uint8_t buf[wcpp::size_max];
+  uint8_t out_buf[wcpp::size_max];
+
+  unsigned commands_sent = 0;
+  uint64_t command_latency = 0;
+  uint32_t command_latency_max = 0;
+  uint32_t command_time[256];
+  uint8_t command_seq = 0;
+
+  double link_budget = 0;
+  uint64_t push_ns = 0, pop_ns = 0;
+  unsigned pushes = 0, pops = 0;
+
+  for (uint32_t now = 0; now < duration; now++) {
+    for (auto& s : streams) {
+      if (now % s.produce_period != 0) continue;
+      wcpp::Packet p = wcpp::Packet::empty(buf, wcpp::size_max);
+      p.telemetry(s.packet_id, s.component_id);
+      for (int i = 0; i < s.entries; i++) p.append("Va").setFloat32(engine() * 1e-3f);
+      auto t0 = std::chrono::steady_clock::now();
+      scheduler.push(p, now);
+      push_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - t0).count();
+      pushes++;
+      s.produced++;
+    }
+    if (engine() % 2000 == 0) {
+      wcpp::Packet c = wcpp::Packet::empty(buf, wcpp::size_max);
+      c.command(0x10, 0x10);
+      c.append("Sq").setInt(command_seq);
+      command_time[command_seq++] = now;
+      scheduler.push(c, now);
+    }
+
+    link_budget += link_rate / 1000.0;
+    while (link_budget > 0) {
+      wcpp::Packet out = wcpp::Packet::empty(out_buf, wcpp::size_max);
+      auto t0 = std::chrono::steady_clock::now();
+      bool popped = scheduler.pop(out, now);
+      pop_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - t0).count();
+      if (!popped) break;
+      pops++;
+      link_budget -= out.size() + 2; // checksum and delimiter
+
+      if (out.isCommand()) {
+        uint32_t latency = now - command_time[(uint8_t)(*out.begin()).getUInt()];
+        command_latency += latency;
+        if (latency > command_latency_max) command_latency_max = latency;
+        commands_sent++;
+        continue;
+      }
+      for (auto& s : streams) {
+        if (s.packet_id == out.packet_id() && s.component_id == out.component_id()) s.sent++;
+      }
+    }
+    if (link_budget > 255) link_budget = 255;
+  }
+
+  printf("link %u byte/s, %u s simulated\n", link_rate, duration / 1000);
+  printf("%-6s %-6s %-8s %-8s %-10s %-10s\n", "id", "comp", "weight", "min[ms]", "prod[Hz]", "sent[Hz]");
+  for (unsigned i = 0; i < stream_count; i++) {
+    const SimStream& s = streams[i];
+    printf("0x%02X   0x%02X   %-8u %-8u %-10.2f %-10.2f\n", s.packet_id, s.component_id,
+           s.weight, s.min_period, s.produced * 1000.0 / duration, s.sent * 1000.0 / duration);
+  }
+  printf("commands: %u, latency avg %.2f ms, max %u ms\n", commands_sent,
+         commands_sent ? (double)command_latency / commands_sent : 0.0, command_latency_max);
+  printf("push: %.1f ns, pop: %.1f ns\n",
+         pushes ? (double)push_ns / pushes : 0.0, pops ? (double)pop_ns / pops : 0.0);
+  return 0;
+}
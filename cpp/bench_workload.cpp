@@ -0,0 +1,132 @@
+#include "workload.h"
+
+#include <chrono>
+#include <cstdio>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// Builds, decodes, iterates and checksums the packets of each workload
+// profile (workload.h) and reports packets/s and MB/s for each stage. With a
+// path, the results are also written there as JSON to compare runs over
+// time.
+//
+//   bench_workload [results.json]
+//
+// Building replays the numbers recorded when the corpus was generated, so
+// it times the setters rather than the random number engine.
+
+static uint64_t walk(const wcpp::Entries& entries) {
+  uint64_t sum = 0;
+  entries.visit([&](const wcpp::Entry&, const auto& value) {
+    using T = std::decay_t<decltype(value)>;
+    if constexpr (std::is_same_v<T, wcpp::SubEntries> || std::is_same_v<T, wcpp::Packet>)
+      sum += walk(value);
+    else if constexpr (std::is_same_v<T, std::span<const uint8_t>>) sum += value.size();
+    else if constexpr (std::is_same_v<T, std::nullptr_t>) sum++;
+    else if constexpr (std::is_integral_v<T>) sum += value;
+    else sum += (float)value != 0;
+  });
+  return sum;
+}
+
+struct Stage {
+  const char* name;
+  double seconds;  // per pass over the corpus
+};
+
+// Repeats a pass over the corpus for at least a quarter of a second
+template <typename Pass>
+static Stage measure(const char* name, uint64_t& sink, Pass pass) {
+  auto start = std::chrono::steady_clock::now();
+  unsigned passes = 0;
+  double elapsed;
+  do {
+    sink += pass();
+    passes++;
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  } while (elapsed < 0.25);
+  return {name, elapsed / passes};
+}
+
+int main(int argc, char** argv) {
+  const unsigned packets = 20000;
+
+  FILE* json = nullptr;
+  if (argc > 1 && (json = fopen(argv[1], "w")) == nullptr) {
+    perror(argv[1]);
+    return 1;
+  }
+  if (json) fprintf(json, "{\"packets\":%u,\"profiles\":[", packets);
+
+  uint64_t sink = 0;
+  bool first = true;
+  for (const wcpp::WorkloadProfile& profile : wcpp::workload_profiles) {
+    RandomSequence sequence(1);
+    std::vector<uint8_t> corpus;
+    std::vector<uint32_t> offsets;
+    {
+      auto rand = sequence.begin();
+      for (unsigned i = 0; i < packets; i++) {
+        uint8_t buf[wcpp::size_max];
+        wcpp::Packet p = wcpp::generatePacket(profile, buf, rand);
+        offsets.push_back(corpus.size());
+        corpus.insert(corpus.end(), buf, buf + p.size());
+      }
+    }
+
+    Stage stages[] = {
+      measure("build", sink, [&] {
+        uint64_t n = 0;
+        auto rand = sequence.begin();
+        for (unsigned i = 0; i < packets; i++) {
+          uint8_t buf[wcpp::size_max];
+          n += wcpp::generatePacket(profile, buf, rand).size();
+        }
+        return n;
+      }),
+      measure("decode", sink, [&] {
+        uint64_t n = 0;
+        for (uint32_t offset : offsets) {
+          const uint8_t* buf = corpus.data() + offset;
+          if (wcpp::Packet::validate(buf, corpus.size() - offset)) n += wcpp::Packet::decode(buf).size();
+        }
+        return n;
+      }),
+      measure("iterate", sink, [&] {
+        uint64_t n = 0;
+        for (uint32_t offset : offsets) n += walk(wcpp::Packet::decode(corpus.data() + offset));
+        return n;
+      }),
+      measure("checksum", sink, [&] {
+        uint64_t n = 0;
+        for (uint32_t offset : offsets) {
+          const uint8_t* buf = corpus.data() + offset;
+          n += wcpp::Packet::checksum(buf, buf[0]);
+        }
+        return n;
+      }),
+    };
+
+    double mean_size = (double)corpus.size() / packets;
+    printf("%-10s %6.1f B/packet\n", profile.name, mean_size);
+    if (json) {
+      fprintf(json, "%s{\"name\":\"%s\",\"mean_size\":%.1f", first ? "" : ",", profile.name, mean_size);
+    }
+    first = false;
+    for (const Stage& stage : stages) {
+      double rate = packets / stage.seconds;
+      double mb = corpus.size() / 1e6 / stage.seconds;
+      printf("  %-9s %12.0f packets/s %9.1f MB/s\n", stage.name, rate, mb);
+      if (json) fprintf(json, ",\"%s\":{\"packets_per_s\":%.0f,\"mb_per_s\":%.1f}", stage.name, rate, mb);
+    }
+    if (json) fprintf(json, "}");
+  }
+
+  if (json) {
+    fprintf(json, "]}\n");
+    fclose(json);
+  }
+  // Keeps the passes from being optimized away
+  return sink == 0;
+}
@@ -0,0 +1,153 @@
+#include "bus.h"
+#include "trace.h"
+
+#include <thread>
+
+namespace wcpp {
+
+BusFilter& BusFilter::name(const char name[2]) {
+  if (names_count < bus_filter_names_max) {
+    names[names_count][0] = name[0];
+    names[names_count][1] = name[1];
+    names_count++;
+  }
+  return *this;
+}
+
+bool BusFilter::match(const Packet& packet) const {
+  if (origin_unit_id != bus_any && origin_unit_id != packet.origin_unit_id()) return false;
+  if (component_id   != bus_any && component_id   != packet.component_id())   return false;
+  if (type_and_id    != bus_any && type_and_id    != packet.type_and_id())    return false;
+  if (names_count == 0) return true;
+
+  for (auto e = packet.begin(); e != packet.end(); ++e) {
+    for (int i = 0; i < names_count; i++) {
+      if ((*e).name() == names[i]) return true;
+    }
+  }
+  return false;
+}
+
+
+PacketQueue::PacketQueue(uint32_t capacity) : tail_(0), head_(0) {
+  uint64_t size = 2;
+  while (size < capacity) size <<= 1;
+  cells_.reset(new Cell[size]);
+  mask_ = size - 1;
+  for (uint64_t i = 0; i < size; i++) cells_[i].seq.store(i, std::memory_order_relaxed);
+}
+
+PacketQueue::~PacketQueue() {
+  const uint8_t* buf;
+  while (pop(buf)) PacketPool::release(buf);
+}
+
+bool PacketQueue::push(const uint8_t* buf) {
+  uint64_t pos = tail_.load(std::memory_order_relaxed);
+  while (true) {
+    Cell& cell = cells_[pos & mask_];
+    uint64_t seq = cell.seq.load(std::memory_order_acquire);
+    int64_t diff = (int64_t)seq - (int64_t)pos;
+    if (diff == 0) {
+      if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        cell.buf = buf;
+        cell.seq.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    }
+    else if (diff < 0) return false;
+    else pos = tail_.load(std::memory_order_relaxed);
+  }
+}
+
+bool PacketQueue::pop(const uint8_t*& buf) {
+  uint64_t pos = head_.load(std::memory_order_relaxed);
+  while (true) {
+    Cell& cell = cells_[pos & mask_];
+    uint64_t seq = cell.seq.load(std::memory_order_acquire);
+    int64_t diff = (int64_t)seq - (int64_t)(pos + 1);
+    if (diff == 0) {
+      if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        buf = cell.buf;
+        cell.seq.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+      }
+    }
+    else if (diff < 0) return false;
+    else pos = head_.load(std::memory_order_relaxed);
+  }
+}
+
+bool PacketQueue::receive(Packet& out) {
+  const uint8_t* buf;
+  if (!pop(buf)) return false;
+  // The queue's reference moves to out
+  out = PacketPool::adopt(buf);
+  return true;
+}
+
+
+Subscriber::Subscriber(const BusFilter& filter, uint32_t capacity, BusPolicy policy)
+  : filter_(filter), policy_(policy), queue_(capacity), tracer_(nullptr), delivered_(0), dropped_(0) {}
+
+bool Subscriber::receive(Packet& out) {
+  if (!queue_.receive(out)) return false;
+  if (tracer_ != nullptr) tracer_->record(out, TraceStage::deliver);
+  return true;
+}
+
+void Subscriber::clear() {
+  const uint8_t* buf;
+  while (queue_.pop(buf)) PacketPool::release(buf);
+}
+
+
+// Not thread safe against other subscribe() calls; subscribe from one thread
+Subscriber* Bus::subscribe(const BusFilter& filter, uint32_t capacity, BusPolicy policy) {
+  unsigned i = count_.load(std::memory_order_relaxed);
+  if (i >= subscribers_max) return nullptr;
+  subscribers_[i].reset(new Subscriber(filter, capacity, policy));
+  subscribers_[i]->tracer_ = tracer_;
+  count_.store(i + 1, std::memory_order_release);
+  return subscribers_[i].get();
+}
+
+void Bus::traceTo(Tracer& tracer) {
+  tracer_ = &tracer;
+  unsigned count = count_.load(std::memory_order_acquire);
+  for (unsigned i = 0; i < count; i++) subscribers_[i]->tracer_ = &tracer;
+}
+
+unsigned Bus::publish(const Packet& packet) {
+  if (packet.isNull()) return 0;
+  if (!pool_.owns(packet.encode())) {
+    Packet p = pool_.copy(packet);
+    if (p.isNull()) return 0;
+    return publish(p);
+  }
+
+  const uint8_t* buf = packet.encode();
+  unsigned delivered = 0;
+  unsigned count = count_.load(std::memory_order_acquire);
+  for (unsigned i = 0; i < count; i++) {
+    Subscriber& s = *subscribers_[i];
+    if (!s.filter_.match(packet)) continue;
+
+    PacketPool::retain(buf);
+    bool pushed = s.queue_.push(buf);
+    while (!pushed && s.policy_ == BusPolicy::block) {
+      std::this_thread::yield();
+      pushed = s.queue_.push(buf);
+    }
+    if (!pushed) {
+      PacketPool::release(buf);
+      s.dropped_.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    s.delivered_.fetch_add(1, std::memory_order_relaxed);
+    delivered++;
+  }
+  return delivered;
+}
+
+} // namespace wcpp
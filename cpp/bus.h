@@ -0,0 +1,124 @@
+#pragma once
+
+#include "packet.h"
+#include "pool.h"
+
+#include <atomic>
+#include <memory>
+
+namespace wcpp {
+
+class Tracer;
+
+// In-process publish/subscribe bus for decoded packets.
+//
+// Published packets live in a PacketPool. Each matching subscriber gets a
+// reference to the same buffer through its own bounded queue, so delivery
+// never copies the packet. Subscribers must treat the packets as read only.
+
+constexpr uint16_t bus_any = 0xFFFF;
+// Above every ID, so a field set to it matches no packet
+constexpr uint16_t bus_none = 0x100;
+constexpr uint8_t bus_filter_names_max = 4;
+
+struct BusFilter {
+  uint16_t origin_unit_id = bus_any;
+  uint16_t component_id   = bus_any;
+  uint16_t type_and_id    = bus_any;
+  uint8_t names_count = 0;
+  char names[bus_filter_names_max][2];
+
+  BusFilter& name(const char name[2]);
+  bool match(const Packet& packet) const;
+};
+
+// Bounded MPMC queue of pooled buffers (D. Vyukov). Each queued buffer
+// holds a reference, which push() takes over from the caller and pop()
+// hands to it. Buffers still queued are released with the queue.
+class PacketQueue {
+public:
+  PacketQueue(uint32_t capacity);
+  ~PacketQueue();
+
+  PacketQueue(const PacketQueue&) = delete;
+  PacketQueue& operator=(const PacketQueue&) = delete;
+
+  bool push(const uint8_t* buf);
+  bool pop(const uint8_t*& buf);
+  bool receive(Packet& out);
+
+  inline bool empty() const {
+    return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+  }
+  inline uint32_t capacity() const { return mask_ + 1; }
+
+private:
+  struct Cell {
+    std::atomic<uint64_t> seq;
+    const uint8_t* buf;
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  uint64_t mask_;
+  alignas(64) std::atomic<uint64_t> tail_;
+  alignas(64) std::atomic<uint64_t> head_;
+};
+
+enum class BusPolicy {
+  drop,  // drop the packet for this subscriber when its queue is full
+  block, // make the publisher wait until there is room
+};
+
+class Subscriber {
+public:
+  Subscriber(const BusFilter& filter, uint32_t capacity, BusPolicy policy);
+
+  bool receive(Packet& out);
+  // Releases whatever is queued, without delivering it
+  void clear();
+
+  // Subscribers stay on the bus, but one can be reused with another filter.
+  // Only safe from the thread that publishes.
+  inline void setFilter(const BusFilter& filter) { filter_ = filter; }
+
+  inline const BusFilter& filter() const { return filter_; }
+  inline BusPolicy policy() const { return policy_; }
+  inline uint64_t delivered() const { return delivered_.load(std::memory_order_relaxed); }
+  inline uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+  BusFilter filter_;
+  BusPolicy policy_;
+  PacketQueue queue_;
+  Tracer* tracer_;
+  std::atomic<uint64_t> delivered_;
+  std::atomic<uint64_t> dropped_;
+
+  friend class Bus;
+};
+
+class Bus {
+public:
+  Bus(PacketPool& pool) : pool_(pool), count_(0), tracer_(nullptr) {}
+
+  Subscriber* subscribe(const BusFilter& filter, uint32_t capacity = 1024,
+                        BusPolicy policy = BusPolicy::drop);
+
+  unsigned publish(const Packet& packet);
+
+  // Subscribers record TraceStage::deliver as they receive. Set before
+  // anything is published.
+  void traceTo(Tracer& tracer);
+
+  inline PacketPool& pool() { return pool_; }
+
+  static constexpr unsigned subscribers_max = 32;
+
+private:
+  PacketPool& pool_;
+  std::unique_ptr<Subscriber> subscribers_[subscribers_max];
+  std::atomic<unsigned> count_;
+  Tracer* tracer_;
+};
+
+} // namespace wcpp
@@ -0,0 +1,71 @@
+#include "random_packet.h"
+#include "format.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The C++ side of tools/codec_diff.py, which compares this codec with the
+// Python one. Packets are exchanged as hex, values as JSON (format.h).
+//
+//   wcpp_codec_diff gen SEED COUNT   random packets: "<hex> <json>" per line
+//   wcpp_codec_diff dump             decodes "<hex>" lines from stdin and
+//                                    writes "<json>" or "invalid" per line
+
+static void writeHex(const uint8_t* buf, size_t n) {
+  static const char digits[] = "0123456789abcdef";
+  char hex[2 * wcpp::size_max];
+  for (size_t i = 0; i < n; i++) {
+    hex[2 * i] = digits[buf[i] >> 4];
+    hex[2 * i + 1] = digits[buf[i] & 0xF];
+  }
+  fwrite(hex, 1, 2 * n, stdout);
+}
+
+static size_t readHex(const char* hex, uint8_t* buf, size_t size) {
+  size_t n = 0;
+  while (n < size && hex[2 * n] != '\0' && hex[2 * n + 1] != '\0') {
+    char byte[3] = {hex[2 * n], hex[2 * n + 1], '\0'};
+    char* end;
+    buf[n] = strtoul(byte, &end, 16);
+    if (end != byte + 2) break;
+    n++;
+  }
+  return n;
+}
+
+int main(int argc, char** argv) {
+  char json[4096];
+
+  if (argc == 4 && strcmp(argv[1], "gen") == 0) {
+    uint64_t seed = strtoull(argv[2], nullptr, 10);
+    long count = atol(argv[3]);
+    for (long i = 0; i < count; i++) {
+      RandomSequence sequence(seed + i);
+      auto rand = sequence.begin();
+      uint8_t buf[256];
+      wcpp::Packet p = generateRandomPacket(buf, rand);
+      if (wcpp::format(p, json, sizeof(json)) == 0) return 1;
+      writeHex(buf, p.size());
+      printf(" %s\n", json);
+    }
+    return 0;
+  }
+
+  if (argc == 2 && strcmp(argv[1], "dump") == 0) {
+    char line[2 * wcpp::size_max + 4];
+    while (fgets(line, sizeof(line), stdin) != nullptr) {
+      uint8_t buf[wcpp::size_max];
+      size_t n = readHex(line, buf, sizeof(buf));
+      if (!wcpp::Packet::validate(buf, n) || wcpp::format(wcpp::Packet::decode(buf), json, sizeof(json)) == 0) {
+        puts("invalid");
+        continue;
+      }
+      puts(json);
+    }
+    return 0;
+  }
+
+  fprintf(stderr, "usage: %s gen SEED COUNT | %s dump\n", argv[0], argv[0]);
+  return 1;
+}
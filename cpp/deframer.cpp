@@ -0,0 +1,68 @@
+#include "deframer.h"
+
+namespace wcpp {
+
+uint16_t frame(const Packet& packet, uint8_t* out) {
+  uint8_t size = packet.size();
+  if (size == 0) return 0;
+  std::memcpy(out, packet.encode(), size);
+  out[size] = packet.checksum();
+  out[size + 1] = 0;
+  return size + frame_overhead;
+}
+
+bool Deframer::put(uint8_t byte) {
+  if (frame_ > 0) drop(frame_);
+  // Zeros between frames are terminators or line idle
+  if (length_ == 0 && byte == 0) return false;
+
+  buf_[length_++] = byte;
+  if (length_ < buf_[0] + frame_overhead && buf_[0] >= 4) return false;
+  return parse();
+}
+
+bool Deframer::next() {
+  if (frame_ > 0) drop(frame_);
+  return length_ > 0 && parse();
+}
+
+void Deframer::drop(uint16_t n) {
+  length_ -= n;
+  std::memmove(buf_, buf_ + n, length_);
+  frame_ = 0;
+}
+
+bool Deframer::parse() {
+  while (true) {
+    uint16_t zeros = 0;
+    while (zeros < length_ && buf_[zeros] == 0) zeros++;
+    if (zeros > 0) drop(zeros);
+    if (length_ == 0) return false;
+
+    uint8_t size = buf_[0];
+    if (size >= 4) {
+      if (length_ < size + frame_overhead) return false;
+      if (buf_[size + 1] == 0 && Packet::checksum(buf_, size) == buf_[size]) {
+        // A whole frame that does not hold a well formed packet is dropped
+        if (!Packet::validate(buf_, size)) {
+          errors_++;
+          drop(size + frame_overhead);
+          continue;
+        }
+        // Keep the bytes for packet(), the next put() drops them
+        frame_ = size + frame_overhead;
+        frames_++;
+        return true;
+      }
+    }
+
+    // Restart after the next zero, which may end the frame we missed the
+    // start of, and parse the bytes already received after it
+    errors_++;
+    uint16_t zero = 1;
+    while (zero < length_ && buf_[zero] != 0) zero++;
+    drop(zero);
+  }
+}
+
+} // namespace wcpp
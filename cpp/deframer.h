@@ -0,0 +1,45 @@
+#pragma once
+
+#include "packet.h"
+
+namespace wcpp {
+
+// Link framing of a single packet, as the Python tools read and write it:
+//   packet (starting with its size byte) | CRC8 | 0x00
+// The trailing zero lets a receiver that lost sync find the next frame.
+
+constexpr uint8_t frame_overhead = 2;
+
+uint16_t frame(const Packet& packet, uint8_t* out);
+
+// Reassembles frames from a byte stream that may split or merge them.
+class Deframer {
+public:
+  Deframer() : length_(0), frame_(0), frames_(0), errors_(0) {}
+
+  // Returns true when byte completes a valid frame, which packet() then
+  // returns until the next put() or next()
+  bool put(uint8_t byte);
+  // Returns true when bytes left over from resynchronizing complete another
+  // frame, without adding any
+  bool next();
+
+  inline const Packet packet() const { return Packet::decode(buf_); }
+
+  inline void reset() { length_ = 0; frame_ = 0; }
+
+  inline uint32_t frames() const { return frames_; }
+  inline uint32_t errors() const { return errors_; }
+
+private:
+  uint8_t buf_[size_max + frame_overhead + 1];
+  uint16_t length_;
+  uint16_t frame_;
+  uint32_t frames_;
+  uint32_t errors_;
+
+  void drop(uint16_t n);
+  bool parse();
+};
+
+} // namespace wcpp
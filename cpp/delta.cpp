@@ -0,0 +1,227 @@
+#include "delta.h"
+
+#include <cstring>
+
+namespace wcpp {
+
+// Ints whose value round-trips through int64_t, so a delta can be applied
+static bool isDeltaInt(const Entry& e) {
+  if (!e.isInt()) return false;
+  return e.size() < 8 || !(e.encode()[entry_type_size + 7] & 0x80);
+}
+
+static bool isSameEntry(const Entry& a, const Entry& b) {
+  uint8_t size = a.size();
+  return size == b.size() &&
+         std::memcmp(a.encode(), b.encode(), entry_type_size + size) == 0;
+}
+
+static bool appendEntry(Packet& out, const Entry& e) {
+  if (out.size_remain() < entry_type_size + e.size()) return false;
+  const char name[2] = {e.name()[0], e.name()[1]};
+  return out.append(name).copy(e);
+}
+
+static bool appendInt(Packet& out, const char name[2], int64_t value) {
+  if (out.size_remain() < entry_type_size + 8) return false;
+  return out.append(name).setInt(value);
+}
+
+static bool appendUInt(Packet& out, const char name[2], uint64_t value) {
+  if (out.size_remain() < entry_type_size + 8) return false;
+  return out.append(name).setInt(value);
+}
+
+
+void DeltaEncoder::reset() {
+  for (int i = 0; i < refs_size_; i++) refs_[i].valid = false;
+}
+
+DeltaReference& DeltaEncoder::reference(uint32_t key) {
+  for (int i = 0; i < refs_size_; i++) {
+    if (refs_[i].valid && refs_[i].key == key) return refs_[i];
+  }
+  for (int i = 0; i < refs_size_; i++) {
+    if (!refs_[i].valid) {
+      refs_[i].key = key;
+      refs_[i].keyframe_id = 0;
+      return refs_[i];
+    }
+  }
+  DeltaReference& ref = refs_[evict_];
+  evict_ = (evict_ + 1) % refs_size_;
+  ref.valid = false;
+  ref.key = key;
+  ref.keyframe_id = 0;
+  return ref;
+}
+
+bool DeltaEncoder::encode(const Packet& packet, Packet& out) {
+  if (packet.packet_id() == packet_id_) return false;
+  if (refs_size_ == 0) return out.copyHeader(packet) && out.copyPayload(packet);
+
+  DeltaReference& ref = reference(packet.key());
+  // The keyframe is frame 0 of each interval
+  if (ref.valid && ref.count + 1 < keyframe_interval_ && encodeDelta(ref, packet, out)) {
+    ref.count++;
+    return true;
+  }
+  return encodeKeyframe(ref, packet, out);
+}
+
+bool DeltaEncoder::encodeKeyframe(const Packet& packet, Packet& out) {
+  if (packet.packet_id() == packet_id_) return false;
+  if (refs_size_ == 0) return out.copyHeader(packet) && out.copyPayload(packet);
+  return encodeKeyframe(reference(packet.key()), packet, out);
+}
+
+bool DeltaEncoder::encodeKeyframe(DeltaReference& ref, const Packet& packet, Packet& out) {
+  uint8_t id = ref.valid ? (ref.keyframe_id + 1) % delta_keyframe_id_max : 0;
+
+  bool fits = frameHeader(packet, out, delta_keyframe_name, id);
+  for (auto e = packet.begin(); fits && e != packet.end(); ++e) {
+    fits = appendEntry(out, *e);
+  }
+  if (!fits) {
+    // No room for the marker, send as a plain packet
+    ref.valid = false;
+    return out.copyHeader(packet) && out.copyPayload(packet);
+  }
+
+  std::memcpy(ref.buf, packet.encode(), packet.size());
+  ref.keyframe_id = id;
+  ref.count = 0;
+  ref.valid = true;
+  return true;
+}
+
+bool DeltaEncoder::encodeDelta(const DeltaReference& ref, const Packet& packet, Packet& out) {
+  const Packet key = Packet::decode(ref.buf);
+  if (key.header_size() != packet.header_size()) return false;
+
+  if (!frameHeader(packet, out, delta_frame_name, ref.keyframe_id)) return false;
+
+  auto k = key.begin();
+  auto e = packet.begin();
+  uint8_t skip = 0;
+  for (; e != packet.end(); ++e, ++k) {
+    if (k == key.end() || !((*k).name() == (*e).name())) return false;
+
+    if (isSameEntry(*k, *e)) {
+      skip++;
+      continue;
+    }
+    // It would read as a skip
+    if ((*e).name() == delta_skip_name) return false;
+    if (skip > 0) {
+      if (!appendInt(out, delta_skip_name, skip)) return false;
+      skip = 0;
+    }
+
+    if (isDeltaInt(*k) && (*e).isInt()) {
+      if (!isDeltaInt(*e)) return false;
+      const char name[2] = {(*e).name()[0], (*e).name()[1]};
+      // Wraps rather than overflows; decode() adds it back the same way
+      int64_t delta = (int64_t)((uint64_t)(*e).getInt() - (uint64_t)(*k).getInt());
+      if (!appendUInt(out, name, zigzag(delta))) return false;
+    }
+    else if (!appendEntry(out, *e)) return false;
+  }
+  if (k != key.end()) return false;
+
+  // A keyframe costs the packet plus its marker
+  return out.size() < packet.size() + entry_type_size;
+}
+
+bool DeltaEncoder::frameHeader(const Packet& packet, Packet& out, const char marker[2], uint8_t keyframe_id) {
+  if (!out.copyHeader(packet)) return false;
+  out.getBuf()[1] = (packet.type_and_id() & packet_type_mask) | packet_id_;
+  return appendInt(out, marker, (uint16_t)packet.packet_id() << 8 | keyframe_id);
+}
+
+
+void DeltaDecoder::reset() {
+  for (int i = 0; i < refs_size_; i++) refs_[i].valid = false;
+}
+
+DeltaReference* DeltaDecoder::find(uint32_t key) {
+  for (int i = 0; i < refs_size_; i++) {
+    if (refs_[i].valid && refs_[i].key == key) return refs_ + i;
+  }
+  return nullptr;
+}
+
+DeltaReference& DeltaDecoder::reference(uint32_t key) {
+  DeltaReference* found = find(key);
+  if (found != nullptr) return *found;
+  for (int i = 0; i < refs_size_; i++) {
+    if (!refs_[i].valid) {
+      refs_[i].key = key;
+      return refs_[i];
+    }
+  }
+  DeltaReference& ref = refs_[evict_];
+  evict_ = (evict_ + 1) % refs_size_;
+  ref.key = key;
+  return ref;
+}
+
+bool DeltaDecoder::decode(const Packet& packet, Packet& out) {
+  if (!out.copyHeader(packet)) return false;
+  if (packet.packet_id() != packet_id_) return out.copyPayload(packet);
+
+  auto m = packet.begin();
+  if (m == packet.end() || !(*m).isInt()) return false;
+  bool is_keyframe = (*m).name() == delta_keyframe_name;
+  if (!is_keyframe && !((*m).name() == delta_frame_name)) return false;
+
+  // Back to the header of the original packet
+  uint64_t marker = (*m).getUInt();
+  uint8_t packet_id = marker >> 8;
+  uint8_t id = marker & 0xFF;
+  if (marker >> 8 > packet_id_mask || packet_id == packet_id_) return false;
+  out.getBuf()[1] = (packet.type_and_id() & packet_type_mask) | packet_id;
+  ++m;
+
+  if (is_keyframe) {
+    for (; m != packet.end(); ++m) {
+      if (!appendEntry(out, *m)) return false;
+    }
+    if (refs_size_ == 0) return true;
+
+    DeltaReference& ref = reference(out.key());
+    std::memcpy(ref.buf, out.encode(), out.size());
+    ref.keyframe_id = id;
+    ref.valid = true;
+    return true;
+  }
+
+  DeltaReference* ref = find(out.key());
+  if (ref == nullptr || ref->keyframe_id != id) return false;
+
+  const Packet key = Packet::decode(ref->buf);
+  auto k = key.begin();
+  for (; m != packet.end(); ++m) {
+    if ((*m).name() == delta_skip_name) {
+      for (uint64_t n = (*m).getUInt(); n > 0; n--, ++k) {
+        if (k == key.end() || !appendEntry(out, *k)) return false;
+      }
+      continue;
+    }
+    if (k == key.end()) return false;
+
+    if (isDeltaInt(*k) && (*m).isInt()) {
+      const char name[2] = {(*k).name()[0], (*k).name()[1]};
+      int64_t value = (int64_t)((uint64_t)(*k).getInt() + (uint64_t)unzigzag((*m).getUInt()));
+      if (!appendInt(out, name, value)) return false;
+    }
+    else if (!appendEntry(out, *m)) return false;
+    ++k;
+  }
+  for (; k != key.end(); ++k) {
+    if (!appendEntry(out, *k)) return false;
+  }
+  return true;
+}
+
+} // namespace wcpp
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "packet.h"
+
+namespace wcpp {
+
+// Delta compression for periodic packets.
+//
+// Frames are sent with the reserved packet ID delta_packet_id, so a plain
+// packet is never taken for one. Their first entry holds the packet ID of
+// the original packet in its upper byte. A keyframe is the original packet
+// after a leading "@K" entry whose lower byte is the keyframe ID. A delta
+// frame starts with a "@D" entry with the ID of the keyframe it refers to,
+// followed by the changed entries only:
+//   "@S" = n     skip n entries unchanged from the keyframe
+//   int entry    zigzag delta to the keyframe value (if that was an int)
+//   other entry  replaces the keyframe entry as is
+// Entries after the last one sent are unchanged. Deltas always refer to the
+// last keyframe, so a lost delta frame does not break the following ones.
+// A packet too large for a keyframe goes as it is; one that uses the
+// reserved packet ID itself cannot be encoded.
+
+constexpr char delta_keyframe_name[2] = {'@', 'K'};
+constexpr char delta_frame_name[2]    = {'@', 'D'};
+constexpr char delta_skip_name[2]     = {'@', 'S'};
+
+constexpr uint8_t delta_packet_id = 0x7D;
+constexpr uint8_t delta_keyframe_id_max = 32;
+
+inline uint64_t zigzag(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+inline int64_t unzigzag(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+struct DeltaReference {
+  uint32_t key;
+  uint8_t keyframe_id;
+  uint8_t count;
+  bool valid;
+  uint8_t buf[size_max];
+};
+
+class DeltaEncoder {
+public:
+  DeltaEncoder(DeltaReference* refs, uint8_t refs_size, uint8_t keyframe_interval = 10,
+               uint8_t packet_id = delta_packet_id)
+    : refs_(refs), refs_size_(refs_size), keyframe_interval_(keyframe_interval),
+      packet_id_(packet_id), evict_(0) {
+    reset();
+  }
+
+  bool encode(const Packet& packet, Packet& out);
+  bool encodeKeyframe(const Packet& packet, Packet& out);
+
+  void reset();
+
+private:
+  DeltaReference* refs_;
+  uint8_t refs_size_;
+  uint8_t keyframe_interval_;
+  uint8_t packet_id_;
+  uint8_t evict_;
+
+  DeltaReference& reference(uint32_t key);
+  bool encodeKeyframe(DeltaReference& ref, const Packet& packet, Packet& out);
+  bool encodeDelta(const DeltaReference& ref, const Packet& packet, Packet& out);
+  bool frameHeader(const Packet& packet, Packet& out, const char marker[2], uint8_t keyframe_id);
+};
+
+class DeltaDecoder {
+public:
+  DeltaDecoder(DeltaReference* refs, uint8_t refs_size, uint8_t packet_id = delta_packet_id)
+    : refs_(refs), refs_size_(refs_size), packet_id_(packet_id), evict_(0) {
+    reset();
+  }
+
+  bool decode(const Packet& packet, Packet& out);
+
+  void reset();
+
+private:
+  DeltaReference* refs_;
+  uint8_t refs_size_;
+  uint8_t packet_id_;
+  uint8_t evict_;
+
+  DeltaReference* find(uint32_t key);
+  DeltaReference& reference(uint32_t key);
+};
+
+template <uint8_t N = 4> class StaticDeltaEncoder : public DeltaEncoder {
+public:
+  StaticDeltaEncoder(uint8_t keyframe_interval = 10, uint8_t packet_id = delta_packet_id)
+    : DeltaEncoder(refs_, N, keyframe_interval, packet_id) {}
+
+private:
+  DeltaReference refs_[N];
+};
+
+template <uint8_t N = 4> class StaticDeltaDecoder : public DeltaDecoder {
+public:
+  StaticDeltaDecoder(uint8_t packet_id = delta_packet_id) : DeltaDecoder(refs_, N, packet_id) {}
+
+private:
+  DeltaReference refs_[N];
+};
+
+} // namespace wcpp
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "packet.h"
+
+#include <span>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+// Declarative mapping between entry names and struct members.
+//
+//   struct Imu { float ax; float ay; uint32_t count; };
+//   constexpr auto imu_fields = wcpp::fields(
+//     wcpp::field("Ax", &Imu::ax),
+//     wcpp::field("Ay", &Imu::ay),
+//     wcpp::field("Ct", &Imu::count));
+//
+//   Imu imu;
+//   uint32_t found = imu_fields.decode(packet, imu);  // one scan
+//   imu_fields.encode(packet, imu);                    // appends entries
+//
+// A field can map a struct entry to a member with its own field map:
+//   wcpp::field("Gp", &Imu::gps, gps_fields)
+
+namespace wcpp {
+
+constexpr uint16_t field_key(const char name[2]) {
+  return EntryName::masked(name).key();
+}
+
+inline uint16_t field_key(const Entry& entry) {
+  const uint8_t* buf = entry.encode();
+  return (buf[0] & 0b00011111) | ((buf[1] & 0b00011111) << 5);
+}
+
+template <typename T, typename M> struct Field {
+  using object_type = T;
+
+  char name[2];
+  uint16_t key;
+  M T::*member;
+
+  template <typename V> bool set(T& obj, const V& value) const {
+    M& m = obj.*member;
+    if constexpr (std::is_same_v<V, float16>) {
+      if constexpr (std::is_arithmetic_v<M>) {
+        m = static_cast<M>((float)value);
+        return true;
+      }
+    }
+    else if constexpr (std::is_arithmetic_v<V>) {
+      if constexpr (std::is_same_v<M, bool>) {
+        m = value != 0;
+        return true;
+      }
+      else if constexpr (std::is_arithmetic_v<M>) {
+        m = static_cast<M>(value);
+        return true;
+      }
+      else if constexpr (std::is_enum_v<M> && std::is_integral_v<V>) {
+        m = static_cast<M>(value);
+        return true;
+      }
+    }
+    else if constexpr (std::is_same_v<V, std::span<const uint8_t>>) {
+      if constexpr (std::is_same_v<M, std::string_view>) {
+        m = std::string_view(reinterpret_cast<const char*>(value.data()), value.size());
+        return true;
+      }
+      else if constexpr (std::is_same_v<M, std::span<const uint8_t>>) {
+        m = value;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool append(Entries& entries, const T& obj) const {
+    const M& m = obj.*member;
+    Entry e = entries.append(name);
+    if constexpr (std::is_same_v<M, bool>)                         return e.setBool(m);
+    else if constexpr (std::is_same_v<M, float>)                   return e.setFloat32(m);
+    else if constexpr (std::is_same_v<M, double>)                  return e.setFloat64(m);
+    else if constexpr (std::is_integral_v<M>)                      return e.setInt(m);
+    else if constexpr (std::is_enum_v<M>)                          return e.setEnum(m);
+    else if constexpr (std::is_same_v<M, std::string_view>)
+      return m.size() <= 0xFF &&
+             e.setBytes(reinterpret_cast<const uint8_t*>(m.data()), m.size());
+    else if constexpr (std::is_same_v<M, std::span<const uint8_t>>)
+      return m.size() <= 0xFF && e.setBytes(m.data(), m.size());
+    else {
+      static_assert(std::is_void_v<M>, "unsupported member type");
+      return false;
+    }
+  }
+};
+
+template <typename T, typename M, typename Map> struct StructField {
+  using object_type = T;
+
+  char name[2];
+  uint16_t key;
+  M T::*member;
+  Map map;
+
+  template <typename V> bool set(T& obj, const V& value) const {
+    if constexpr (std::is_same_v<V, SubEntries>) {
+      map.decode(value, obj.*member);
+      return true;
+    }
+    return false;
+  }
+
+  bool append(Entries& entries, const T& obj) const {
+    uint8_t size = entries.size();
+    SubEntries sub = entries.append(name).setStruct();
+    if (entries.size() != size + entry_type_size + 1) return false;
+    return map.encode(sub, obj.*member);
+  }
+};
+
+template <typename T, typename M>
+constexpr Field<T, M> field(const char (&name)[3], M T::*member) {
+  return Field<T, M>{{name[0], name[1]}, field_key(name), member};
+}
+
+template <typename T, typename M, typename Map>
+constexpr StructField<T, M, Map> field(const char (&name)[3], M T::*member, Map map) {
+  return StructField<T, M, Map>{{name[0], name[1]}, field_key(name), member, map};
+}
+
+// With a checked name: field("Ax"_wn, &Imu::ax)
+template <typename T, typename M>
+constexpr Field<T, M> field(EntryName name, M T::*member) {
+  return Field<T, M>{{name[0], name[1]}, name.key(), member};
+}
+
+template <typename T, typename M, typename Map>
+constexpr StructField<T, M, Map> field(EntryName name, M T::*member, Map map) {
+  return StructField<T, M, Map>{{name[0], name[1]}, name.key(), member, map};
+}
+
+template <typename T, typename... Fs> class FieldMap {
+  static_assert(sizeof...(Fs) <= 32, "too many fields");
+
+public:
+  constexpr FieldMap(Fs... fields) : fields_(fields...) {}
+
+  // Returns a bitmask of the fields found, bit i for the i-th field
+  uint32_t decode(const Entries& entries, T& obj) const {
+    uint32_t found = 0;
+    entries.visit([&](const Entry& e, const auto& value) {
+      uint16_t key = field_key(e);
+      std::apply([&](const auto&... f) {
+        uint32_t bit = 1;
+        ((f.key == key && !(found & bit) && f.set(obj, value) ? found |= bit : 0,
+          bit <<= 1), ...);
+      }, fields_);
+    });
+    return found;
+  }
+
+  bool encode(Entries& entries, const T& obj) const {
+    return std::apply([&](const auto&... f) {
+      return (f.append(entries, obj) && ...);
+    }, fields_);
+  }
+
+  static constexpr unsigned count() { return sizeof...(Fs); }
+  static constexpr uint32_t all() {
+    return sizeof...(Fs) == 32 ? 0xFFFFFFFF : ((uint32_t)1 << sizeof...(Fs)) - 1;
+  }
+
+private:
+  std::tuple<Fs...> fields_;
+};
+
+template <typename F, typename... Fs>
+constexpr FieldMap<typename F::object_type, F, Fs...> fields(F f, Fs... fs) {
+  return FieldMap<typename F::object_type, F, Fs...>(f, fs...);
+}
+
+} // namespace wcpp
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace wcpp {
+
+// Helpers for the fixed-memory containers (PacketPool, TelemetryCache,
+// SequenceTable, DedupTable, ...).
+//
+// Each container works on arrays handed to its constructor, so the memory
+// can be static, on the heap or inline. A Static<Name><N> wrapper holds the
+// arrays inline by deriving from FixedArray before the container: bases are
+// constructed in the order they are listed, so the arrays exist by the time
+// the container's constructor sets them up. Tag tells two arrays of the same
+// type apart.
+
+template <typename T, size_t N, int Tag = 0> struct FixedArray {
+  T items_[N];
+};
+
+// Open-addressing tables hash a key by Fibonacci hashing, scaled to the
+// table size so it need not be a power of two, then probe linearly from
+// there. probe() calls visit(i) on up to limit slots in that order, and
+// returns the first slot it accepts, or size if it accepts none.
+
+inline uint32_t probeStart(uint32_t key, uint32_t size) {
+  return (uint32_t)((uint64_t)(uint32_t)(key * 0x9E3779B1u) * size >> 32);
+}
+
+template <typename Visit>
+uint32_t probe(uint32_t key, uint32_t size, uint32_t limit, Visit visit) {
+  if (size == 0) return 0;
+  uint32_t i = probeStart(key, size);
+  for (uint32_t n = 0; n < limit; n++) {
+    if (visit(i)) return i;
+    i = i + 1 == size ? 0 : i + 1;
+  }
+  return size;
+}
+
+} // namespace wcpp
@@ -0,0 +1,317 @@
+#include "format.h"
+
+#ifndef ARDUINO
+
+#include "deframer.h"
+
+#include <charconv>
+#include <cmath>
+#include <type_traits>
+
+namespace wcpp {
+
+static const char hex_digits[] = "0123456789abcdef";
+
+bool Formatter::write(const Packet& packet) {
+  if (packet.isNull() || packet.size() < packet.header_size()) {
+    put("null");
+    return !truncated_;
+  }
+  put(style_ == TextStyle::json ? '{' : '[');
+  header(packet);
+  entries(packet);
+  put(style_ == TextStyle::json ? '}' : ']');
+  return !truncated_;
+}
+
+bool Formatter::writeLine(const Packet& packet) {
+  if (packet.isNull() || packet.size() < packet.header_size()) return false;
+  if (style_ == TextStyle::json) put('{');
+  header(packet);
+  entries(packet);
+  if (style_ == TextStyle::json) put('}');
+  put('\n');
+  return !truncated_;
+}
+
+bool Formatter::writeLine(const Packet& packet, uint32_t time) {
+  if (packet.isNull() || packet.size() < packet.header_size()) return false;
+  if (style_ == TextStyle::json) {
+    put("{\"t\":");
+    number((uint64_t)time);
+    put(',');
+  }
+  else {
+    put("t=");
+    number((uint64_t)time);
+    put(' ');
+  }
+  header(packet);
+  entries(packet);
+  if (style_ == TextStyle::json) put('}');
+  put('\n');
+  return !truncated_;
+}
+
+bool Formatter::flush() {
+  if (stream_ == nullptr) return false;
+  bool ok = fwrite(buf_, 1, length_, stream_) == length_;
+  length_ = 0;
+  return ok;
+}
+
+bool Formatter::reserve(size_t n) {
+  if (length_ + n <= size_) return true;
+  if (stream_ != nullptr && n <= size_ && flush()) return true;
+  truncated_ = true;
+  return false;
+}
+
+void Formatter::put(char c) {
+  if (reserve(1)) buf_[length_++] = c;
+}
+
+void Formatter::put(const char* s, size_t n) {
+  if (!reserve(n)) return;
+  std::memcpy(buf_ + length_, s, n);
+  length_ += n;
+}
+
+void Formatter::header(const Packet& packet) {
+  if (style_ == TextStyle::json) {
+    put(packet.isCommand() ? "\"type\":\"cmd\",\"id\":" : "\"type\":\"tlm\",\"id\":");
+    number((uint64_t)packet.packet_id());
+    put(",\"comp\":");
+    number((uint64_t)packet.component_id());
+    if (packet.isRemote()) {
+      put(",\"from\":");
+      number((uint64_t)packet.origin_unit_id());
+      put(",\"to\":");
+      number((uint64_t)packet.dest_unit_id());
+      put(",\"seq\":");
+      number((uint64_t)packet.sequence());
+    }
+  }
+  else {
+    put(packet.isCommand() ? "cmd id=" : "tlm id=");
+    number((uint64_t)packet.packet_id());
+    put(" comp=");
+    number((uint64_t)packet.component_id());
+    if (packet.isRemote()) {
+      put(" from=");
+      number((uint64_t)packet.origin_unit_id());
+      put(" to=");
+      number((uint64_t)packet.dest_unit_id());
+      put(" seq=");
+      number((uint64_t)packet.sequence());
+    }
+  }
+}
+
+void Formatter::entries(const Entries& entries) {
+  // Packets have their header before the entries, structs start bare
+  bool first = entries.header_size() <= 1;
+  entries.visit([&](const Entry& e, auto value) {
+    Entry::Name n = e.name();
+    char name[2] = {n[0], n[1]};
+    key(name, 2, first);
+    first = false;
+
+    using V = std::decay_t<decltype(value)>;
+    if constexpr (std::is_same_v<V, std::nullptr_t>) {
+      put("null");
+    }
+    else if constexpr (std::is_same_v<V, float16>) {
+      number((float)value);
+    }
+    else if constexpr (std::is_same_v<V, std::span<const uint8_t>>) {
+      string(value.data(), value.size());
+    }
+    else if constexpr (std::is_same_v<V, SubEntries>) {
+      put('{');
+      this->entries(value);
+      put('}');
+    }
+    else if constexpr (std::is_same_v<V, Packet>) {
+      write(value);
+    }
+    else {
+      number(value);
+    }
+  });
+}
+
+void Formatter::key(const char* name, size_t n, bool first) {
+  if (style_ == TextStyle::json) {
+    if (!reserve(2 * n + 4)) return;
+    if (!first) buf_[length_++] = ',';
+    buf_[length_++] = '"';
+    // Names are 0x40 to 0x7F, of which only the backslash needs escaping
+    for (size_t i = 0; i < n; i++) {
+      if (name[i] == '\\') buf_[length_++] = '\\';
+      buf_[length_++] = name[i];
+    }
+    buf_[length_++] = '"';
+    buf_[length_++] = ':';
+  }
+  else {
+    if (!reserve(n + 2)) return;
+    if (!first) buf_[length_++] = ' ';
+    std::memcpy(buf_ + length_, name, n);
+    length_ += n;
+    buf_[length_++] = '=';
+  }
+}
+
+void Formatter::number(uint64_t value) {
+  if (!reserve(20)) return;
+  length_ = std::to_chars(buf_ + length_, buf_ + size_, value).ptr - buf_;
+}
+
+void Formatter::number(int64_t value) {
+  if (!reserve(20)) return;
+  length_ = std::to_chars(buf_ + length_, buf_ + size_, value).ptr - buf_;
+}
+
+// Floats always get a fraction or exponent, so they read back as floats
+void Formatter::number(float value) {
+  if (!std::isfinite(value)) return put("null");
+  if (!reserve(18)) return;
+  fraction(std::to_chars(buf_ + length_, buf_ + size_, value).ptr);
+}
+
+void Formatter::number(double value) {
+  if (!std::isfinite(value)) return put("null");
+  if (!reserve(26)) return;
+  fraction(std::to_chars(buf_ + length_, buf_ + size_, value).ptr);
+}
+
+void Formatter::fraction(char* end) {
+  char* p = buf_ + length_;
+  while (p < end && *p != '.' && *p != 'e') p++;
+  if (p == end) {
+    *end++ = '.';
+    *end++ = '0';
+  }
+  length_ = end - buf_;
+}
+
+void Formatter::string(const uint8_t* s, size_t n) {
+  put('"');
+  for (size_t i = 0; i < n; i++) {
+    if (!reserve(6)) return;
+    uint8_t c = s[i];
+    if (c >= 0x20 && c < 0x7F && c != '"' && c != '\\') {
+      buf_[length_++] = c;
+      continue;
+    }
+    buf_[length_++] = '\\';
+    if (c == '"' || c == '\\') {
+      buf_[length_++] = c;
+    }
+    else if (c == '\n') {
+      buf_[length_++] = 'n';
+    }
+    else if (style_ == TextStyle::json) {
+      std::memcpy(buf_ + length_, "u00", 3);
+      buf_[length_ + 3] = hex_digits[c >> 4];
+      buf_[length_ + 4] = hex_digits[c & 0xF];
+      length_ += 5;
+    }
+    else {
+      buf_[length_++] = 'x';
+      buf_[length_++] = hex_digits[c >> 4];
+      buf_[length_++] = hex_digits[c & 0xF];
+    }
+  }
+  put('"');
+}
+
+
+size_t format(const Packet& packet, char* out, size_t size, TextStyle style) {
+  if (size == 0) return 0;
+  Formatter f(out, size - 1, nullptr, style);
+  if (!f.write(packet)) {
+    out[0] = '\0';
+    return 0;
+  }
+  out[f.length()] = '\0';
+  return f.length();
+}
+
+
+// Frames are checked and formatted in place in the read buffer, rather than
+// copied through a Deframer byte by byte. Resynchronizes the same way.
+static uint64_t convertFramed(FILE* in, Formatter& out) {
+  uint8_t buf[1 << 16];
+  size_t length = 0;
+  uint64_t count = 0;
+  while (true) {
+    size_t n = fread(buf + length, 1, sizeof(buf) - length, in);
+    length += n;
+
+    size_t pos = 0;
+    while (pos < length) {
+      uint8_t size = buf[pos];
+      if (size == 0) {
+        pos++;
+        continue;
+      }
+      if (size >= 4) {
+        if (pos + size + frame_overhead > length) break;
+        const uint8_t* p = buf + pos;
+        if (p[size + 1] == 0 && Packet::checksum(p, size) == p[size]) {
+          if (Packet::validate(p, size) && out.writeLine(Packet::decode(p))) count++;
+          pos += size + frame_overhead;
+          continue;
+        }
+      }
+      const void* zero = std::memchr(buf + pos + 1, 0, length - pos - 1);
+      pos = zero != nullptr ? (const uint8_t*)zero - buf : length;
+    }
+    std::memmove(buf, buf + pos, length - pos);
+    length -= pos;
+    if (n == 0) break;
+  }
+  return count;
+}
+
+static uint64_t convertTimed(FILE* in, Formatter& out) {
+  constexpr size_t record_header = 5;
+  uint8_t buf[1 << 16];
+  size_t length = 0;
+  uint64_t count = 0;
+  while (true) {
+    size_t n = fread(buf + length, 1, sizeof(buf) - length, in);
+    length += n;
+
+    size_t pos = 0;
+    while (pos + record_header <= length) {
+      uint8_t size = buf[pos + 4];
+      if (pos + record_header + size > length) break;
+
+      uint32_t time;
+      std::memcpy(&time, buf + pos, 4);
+      const uint8_t* p = buf + pos + record_header;
+      // The size byte of the packet must agree with the record
+      if (p[0] == size && Packet::validate(p, size) && out.writeLine(Packet::decode(p), time)) count++;
+      pos += record_header + size;
+    }
+    std::memmove(buf, buf + pos, length - pos);
+    length -= pos;
+    if (n == 0) break;
+  }
+  return count;
+}
+
+uint64_t convertLog(FILE* in, FILE* out, LogFormat format, TextStyle style) {
+  char buf[1 << 16];
+  Formatter f(buf, sizeof(buf), out, style);
+  uint64_t count = format == LogFormat::framed ? convertFramed(in, f) : convertTimed(in, f);
+  f.flush();
+  return count;
+}
+
+} // namespace wcpp
+
+#endif
@@ -0,0 +1,87 @@
+#pragma once
+
+#ifndef ARDUINO
+
+#include "packet.h"
+
+#include <cstddef>
+#include <cstdio>
+
+namespace wcpp {
+
+// Packets as JSON or compact text, written without allocating.
+//
+// JSON: {"type":"tlm","id":5,"comp":2,"from":1,"to":5,"seq":3,
+//        "Ax":1.5,"Nm":"abc","Gp":{"La":35.5},"Pk":{"type":"cmd",...}}
+// Text: tlm id=5 comp=2 from=1 to=5 seq=3 Ax=1.5 Nm="abc" Gp={La=35.5} Pk=[cmd ...]
+//
+// "from", "to" and "seq" are there for remote packets only. Entry names
+// always start with an upper case letter, so they never clash with the
+// header keys. Bytes are written as strings, with bytes outside printable
+// ASCII escaped as \u00XX in JSON and \xXX in text. Floats use the shortest
+// form that reads back the same value, with ".0" added to whole numbers so
+// parse.h reads them back as floats; NaN and infinities are null.
+
+enum class TextStyle : uint8_t { json, text };
+
+class Formatter {
+public:
+  // Writes into buf. With a stream, a full buffer is written out to it, and
+  // buf must hold at least 32 characters; without one, what does not fit is
+  // dropped and truncated() is set.
+  Formatter(char* buf, size_t size, FILE* stream = nullptr, TextStyle style = TextStyle::json)
+    : buf_(buf), size_(size), length_(0), stream_(stream), style_(style), truncated_(false) {}
+
+  bool write(const Packet& packet);
+  // One line per packet (NDJSON), with the log time first if there is one
+  bool writeLine(const Packet& packet);
+  bool writeLine(const Packet& packet, uint32_t time);
+
+  bool flush();
+  inline void clear() { length_ = 0; truncated_ = false; }
+
+  inline const char* data() const { return buf_; }
+  inline size_t length() const { return length_; }
+  inline bool truncated() const { return truncated_; }
+  inline TextStyle style() const { return style_; }
+
+private:
+  char* buf_;
+  size_t size_;
+  size_t length_;
+  FILE* stream_;
+  TextStyle style_;
+  bool truncated_;
+
+  bool reserve(size_t n);
+  void put(char c);
+  void put(const char* s, size_t n);
+  template <size_t N> inline void put(const char (&s)[N]) { put(s, N - 1); }
+
+  void header(const Packet& packet);
+  void entries(const Entries& entries);
+  void key(const char* name, size_t n, bool first);
+  void number(uint64_t value);
+  void number(int64_t value);
+  void number(float value);
+  void number(double value);
+  void fraction(char* end);
+  void string(const uint8_t* s, size_t n);
+};
+
+// Writes packet into out as a NUL terminated string, returns its length,
+// or 0 if it does not fit
+size_t format(const Packet& packet, char* out, size_t size, TextStyle style = TextStyle::json);
+
+// Log files as one packet per line, with Formatter::writeLine
+enum class LogFormat : uint8_t {
+  framed, // packet | CRC8 | 0x00, as received on a link (see deframer.h)
+  timed,  // millis (uint32 LE) | size | packet, as the logger writes
+};
+
+// Returns the number of packets written, malformed ones are skipped
+uint64_t convertLog(FILE* in, FILE* out, LogFormat format, TextStyle style = TextStyle::json);
+
+} // namespace wcpp
+
+#endif
@@ -0,0 +1,77 @@
+#include "random_packet.h"
+#include "format.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// Runs a libFuzzer target where libFuzzer is not available (GCC builds):
+//
+//   fuzz_packet [-runs=N] [-seed=S] [file...]
+//
+// Files, like crashes saved by libFuzzer, are run as given. Without files
+// it runs N inputs made from random packets with a few bytes changed,
+// inserted or cut. Built with WCPP_FUZZ_TEXT, the packets are formatted as
+// JSON or text first.
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+static std::vector<uint8_t> input(RandomSequence::iterator& rand) {
+  uint8_t buf[256];
+  wcpp::Packet p = generateRandomPacket(buf, rand);
+  std::vector<uint8_t> in;
+#ifdef WCPP_FUZZ_TEXT
+  char text[4096];
+  size_t n = wcpp::format(p, text, sizeof(text), rand() % 2 ? wcpp::TextStyle::json : wcpp::TextStyle::text);
+  in.assign(text, text + n);
+#else
+  in.assign(buf, buf + p.size());
+#endif
+
+  int changes = rand() % 4;
+  for (int i = 0; i < changes && !in.empty(); i++) {
+    size_t at = rand() % in.size();
+    switch (rand() % 3) {
+    case 0: in[at] = rand(); break;
+    case 1: in.insert(in.begin() + at, (uint8_t)rand()); break;
+    case 2: in.resize(at); break;
+    }
+  }
+  return in;
+}
+
+int main(int argc, char** argv) {
+  long runs = 100000;
+  uint64_t seed = 1;
+  int files = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "-runs=", 6) == 0) runs = atol(argv[i] + 6);
+    else if (strncmp(argv[i], "-seed=", 6) == 0) seed = strtoull(argv[i] + 6, nullptr, 10);
+    else {
+      FILE* f = fopen(argv[i], "rb");
+      if (f == nullptr) {
+        perror(argv[i]);
+        return 1;
+      }
+      std::vector<uint8_t> data;
+      uint8_t chunk[4096];
+      size_t n;
+      while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) data.insert(data.end(), chunk, chunk + n);
+      fclose(f);
+      LLVMFuzzerTestOneInput(data.data(), data.size());
+      files++;
+    }
+  }
+  if (files > 0) return 0;
+
+  for (long i = 0; i < runs; i++) {
+    // A sequence per run keeps its history short and any run replayable
+    RandomSequence sequence(seed + i);
+    auto rand = sequence.begin();
+    std::vector<uint8_t> in = input(rand);
+    LLVMFuzzerTestOneInput(in.data(), in.size());
+  }
+  printf("%ld runs\n", runs);
+  return 0;
+}
@@ -0,0 +1,83 @@
+#include "packet.h"
+#include "format.h"
+
+#include <cstdlib>
+
+// libFuzzer target for decoding untrusted bytes: validate, then iterate,
+// find and read every entry, walking into structs and nested packets.
+// Anything validate() accepts must be safe to read in full.
+
+static void check(bool condition) {
+  if (!condition) abort();
+}
+
+static void walk(const wcpp::Entries& entries, int depth) {
+  for (auto i = entries.begin(); i != entries.end(); ++i) {
+    const wcpp::Entry e = *i;
+    wcpp::Entry::Name name = e.name();
+    char n[2] = {name[0], name[1]};
+
+    // find() stops at the first entry with the name, which is this one or
+    // an earlier one with the same name
+    auto found = entries.find(n);
+    check(found != entries.end());
+    check((*found).name() == name);
+
+    uint8_t bytes[wcpp::size_max];
+    char str[wcpp::size_max + 1];
+    switch (e.kind()) {
+    case wcpp::Entry::Kind::null:
+      check(e.isNull());
+      break;
+    case wcpp::Entry::Kind::unsigned_int:
+    case wcpp::Entry::Kind::signed_int:
+      check(e.isInt());
+      (void)e.getInt();
+      (void)e.getUInt();
+      break;
+    case wcpp::Entry::Kind::float16:
+    case wcpp::Entry::Kind::float32:
+    case wcpp::Entry::Kind::float64:
+      check(e.isFloat());
+      (void)e.getFloat16();
+      (void)e.getFloat32();
+      (void)e.getFloat64();
+      break;
+    case wcpp::Entry::Kind::bytes: {
+      check(e.isBytes());
+      auto view = e.getBytesView();
+      check(e.getBytes(bytes) == view.size());
+      check(e.getString(std::span<char>(str)) == view.size());
+      break;
+    }
+    case wcpp::Entry::Kind::structure:
+      check(e.isStruct());
+      walk(e.getStruct(), depth + 1);
+      break;
+    case wcpp::Entry::Kind::packet: {
+      check(e.isPacket());
+      const wcpp::Packet p = e.getPacket();
+      check(p.size() == e.size());
+      walk(p, depth + 1);
+      break;
+    }
+    }
+  }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  if (!wcpp::Packet::validate(data, size)) return 0;
+
+  // Copy to the exact size so reads past the packet are caught
+  uint8_t* buf = (uint8_t*)malloc(data[0]);
+  memcpy(buf, data, data[0]);
+  const wcpp::Packet p = wcpp::Packet::decode(buf);
+  (void)p.checksum();
+  walk(p, 0);
+
+  char text[4096];
+  check(wcpp::format(p, text, sizeof(text)) > 0);
+  check(wcpp::format(p, text, sizeof(text), wcpp::TextStyle::text) > 0);
+  free(buf);
+  return 0;
+}
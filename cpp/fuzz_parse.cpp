@@ -0,0 +1,31 @@
+#include "parse.h"
+#include "format.h"
+
+#include <cstdlib>
+
+// libFuzzer target for the text and JSON parser. Whatever parses must be a
+// valid packet, and formatting it and parsing that again must give the
+// same bytes.
+
+static void check(bool condition) {
+  if (!condition) abort();
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  uint8_t buf[wcpp::size_max];
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+  if (wcpp::parse((const char*)data, size, p) == 0) return 0;
+  check(wcpp::Packet::validate(buf, p.size()));
+
+  for (auto style : {wcpp::TextStyle::json, wcpp::TextStyle::text}) {
+    char text[4096];
+    size_t n = wcpp::format(p, text, sizeof(text), style);
+    check(n > 0);
+
+    uint8_t again_buf[wcpp::size_max];
+    wcpp::Packet again = wcpp::Packet::empty(again_buf, sizeof(again_buf));
+    check(wcpp::parse(text, n, again) == n);
+    check(again.size() == p.size() && memcmp(again_buf, buf, p.size()) == 0);
+  }
+  return 0;
+}
@@ -0,0 +1,408 @@
+#include "gateway.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace wcpp {
+
+static constexpr uint32_t udp_tag = 0xFFFFFFFF;
+
+static inline bool sameAddress(const sockaddr_in& a, const sockaddr_in& b) {
+  return a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port;
+}
+
+Gateway::Gateway(PacketPool& pool, int udp_fd, uint32_t queue_capacity)
+  : pool_(pool), bus_(pool), udp_fd_(udp_fd), epoll_fd_(epoll_create1(EPOLL_CLOEXEC)),
+    capacity_(queue_capacity), want_write_(false), paused_(false), clients_count_(0), next_client_(0),
+    left_count_(0), left_next_(0),
+    sources_count_(0), uplinked_(0) {
+  datagrams_.reset(new uint8_t[batch_max * datagram_max]);
+
+  if (epoll_fd_ < 0 || udp_fd_ < 0) return;
+  epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.u32 = udp_tag;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, udp_fd_, &ev) < 0) {
+    close(udp_fd_);
+    udp_fd_ = -1;
+  }
+}
+
+Gateway::~Gateway() {
+  while (clients_count_ > 0) removeAt(clients_count_ - 1);
+  for (unsigned i = 0; i < sources_count_; i++) {
+    if (sources_[i].fd >= 0) close(sources_[i].fd);
+  }
+  if (udp_fd_ >= 0) close(udp_fd_);
+  if (epoll_fd_ >= 0) close(epoll_fd_);
+}
+
+bool Gateway::addSource(int fd) {
+  if (fd < 0) return false;
+  if (sources_count_ >= sources_max) {
+    close(fd);
+    return false;
+  }
+  GatewaySource& s = sources_[sources_count_];
+  epoll_event ev = {};
+  ev.events = paused_ ? 0u : (uint32_t)EPOLLIN;
+  ev.data.u32 = sources_count_;
+  int flags = fcntl(fd, F_GETFL);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0 ||
+      epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    close(fd);
+    return false;
+  }
+  s.fd = fd;
+  s.deframer.reset();
+  s.rx_pos = 0;
+  s.rx_len = 0;
+  s.received = 0;
+  s.dropped = 0;
+  sources_count_++;
+  return true;
+}
+
+GatewayClient* Gateway::addClient(const sockaddr_in& addr, const BusFilter& filter) {
+  GatewayClient* c = client(addr);
+  if (c != nullptr) {
+    c->subscriber->setFilter(filter);
+    return c;
+  }
+  if (clients_count_ >= clients_max) return nullptr;
+
+  c = &clients_[clients_count_];
+  if (c->subscriber == nullptr) c->subscriber = bus_.subscribe(filter, capacity_, BusPolicy::drop);
+  else c->subscriber->setFilter(filter);
+  if (c->subscriber == nullptr) return nullptr;
+  clients_count_++;
+  c->addr = addr;
+  c->held_count = 0;
+  c->sent = 0;
+  c->failed = 0;
+  c->dropped_before = c->subscriber->dropped();
+  return c;
+}
+
+void Gateway::removeClient(const sockaddr_in& addr) {
+  for (unsigned i = 0; i < clients_count_; i++) {
+    if (sameAddress(clients_[i].addr, addr)) {
+      removeAt(i);
+      return;
+    }
+  }
+}
+
+void Gateway::removeAt(unsigned i) {
+  GatewayClient& c = clients_[i];
+  BusFilter none;
+  none.origin_unit_id = bus_none;
+  c.subscriber->setFilter(none);
+  c.subscriber->clear();
+  releaseHeld(c, c.held_count);
+  clients_count_--;
+  if (i != clients_count_) std::swap(clients_[i], clients_[clients_count_]);
+}
+
+bool Gateway::hold(GatewayClient& c) {
+  Packet p = Packet::null();
+  if (!c.subscriber->receive(p)) return false;
+  // The reference moves from p to held
+  PacketPool::retain(p.encode());
+  c.held[c.held_count++] = p.encode();
+  return true;
+}
+
+void Gateway::releaseHeld(GatewayClient& c, unsigned n) {
+  for (unsigned k = 0; k < n; k++) PacketPool::release(c.held[k]);
+  c.held_count -= n;
+  memmove(c.held, c.held + n, c.held_count * sizeof(c.held[0]));
+}
+
+bool Gateway::hasLeft(const sockaddr_in& addr) const {
+  for (unsigned i = 0; i < left_count_; i++) {
+    if (sameAddress(left_[i], addr)) return true;
+  }
+  return false;
+}
+
+void Gateway::setLeft(const sockaddr_in& addr, bool left) {
+  for (unsigned i = 0; i < left_count_; i++) {
+    if (!sameAddress(left_[i], addr)) continue;
+    if (!left) left_[i] = left_[--left_count_];
+    return;
+  }
+  if (!left) return;
+  if (left_count_ < clients_max) {
+    left_[left_count_++] = addr;
+  }
+  else {
+    left_[left_next_] = addr;
+    left_next_ = (left_next_ + 1) % clients_max;
+  }
+}
+
+GatewayClient* Gateway::client(const sockaddr_in& addr) {
+  for (unsigned i = 0; i < clients_count_; i++) {
+    if (sameAddress(clients_[i].addr, addr)) return &clients_[i];
+  }
+  return nullptr;
+}
+
+unsigned Gateway::publish(const Packet& packet) {
+  return bus_.publish(packet);
+}
+
+bool Gateway::runOnce(int timeout_ms) {
+  epoll_event events[sources_max + 1];
+  int n = epoll_wait(epoll_fd_, events, sources_max + 1, timeout_ms);
+  if (n < 0) return errno == EINTR;
+
+  for (int i = 0; i < n; i++) {
+    if (events[i].data.u32 == udp_tag) {
+      if (events[i].events & EPOLLIN) readClients();
+    }
+    else {
+      readSource(sources_[events[i].data.u32]);
+    }
+  }
+  flush();
+
+  if (paused_ && pool_.available() > 0) {
+    pauseSources(false);
+    for (unsigned i = 0; i < sources_count_; i++) readSource(sources_[i]);
+    flush();
+  }
+  return true;
+}
+
+void Gateway::readSource(GatewaySource& s) {
+  while (s.fd >= 0) {
+    while (true) {
+      // Leave the bytes where they are until the clients free some buffers
+      if (pool_.available() == 0) {
+        pauseSources(true);
+        return;
+      }
+      bool ready = s.deframer.next();
+      while (!ready && s.rx_pos < s.rx_len) ready = s.deframer.put(s.rx[s.rx_pos++]);
+      if (!ready) break;
+
+      Packet p = pool_.copy(s.deframer.packet());
+      if (p.isNull()) {
+        s.dropped++;
+        continue;
+      }
+      s.received++;
+      publish(p);
+    }
+
+    ssize_t n = read(s.fd, s.rx, sizeof(s.rx));
+    if (n > 0) {
+      s.rx_pos = 0;
+      s.rx_len = n;
+      continue;
+    }
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+
+    // Closed or failed
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, s.fd, nullptr);
+    close(s.fd);
+    s.fd = -1;
+  }
+}
+
+void Gateway::readClients() {
+  mmsghdr msgs[batch_max];
+  iovec iov[batch_max];
+  sockaddr_in from[batch_max];
+
+  while (true) {
+    for (unsigned i = 0; i < batch_max; i++) {
+      iov[i].iov_base = datagrams_.get() + i * datagram_max;
+      iov[i].iov_len = datagram_max;
+      msgs[i].msg_hdr = {};
+      msgs[i].msg_hdr.msg_name = &from[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int n = recvmmsg(udp_fd_, msgs, batch_max, MSG_DONTWAIT, nullptr);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return;
+
+    for (int i = 0; i < n; i++) {
+      if (msgs[i].msg_hdr.msg_namelen != sizeof(sockaddr_in)) continue;
+      Deframer d;
+      for (unsigned j = 0; j < msgs[i].msg_len; j++) {
+        if (d.put(datagrams_[i * datagram_max + j])) handle(from[i], d.packet());
+      }
+    }
+    if (n < (int)batch_max) return;
+  }
+}
+
+void Gateway::handle(const sockaddr_in& from, const Packet& packet) {
+  bool request = !packet.isRemote() && packet.isCommand();
+  if (request && packet.packet_id() == gateway_unsubscribe) {
+    removeClient(from);
+    setLeft(from, true);
+    return;
+  }
+  bool subscribe = request && packet.packet_id() == gateway_subscribe;
+  if (subscribe) setLeft(from, false);
+
+  // First contact subscribes to everything, but not after leaving
+  GatewayClient* c = client(from);
+  if (c == nullptr && (subscribe || !hasLeft(from))) c = addClient(from);
+
+  if (packet.isRemote()) {
+    uplink(packet);
+    return;
+  }
+  if (subscribe && c != nullptr) {
+    BusFilter filter;
+    auto unit = packet.find("Un");
+    if (unit != packet.end()) filter.origin_unit_id = (*unit).getUInt();
+    auto component = packet.find("Cp");
+    if (component != packet.end()) filter.component_id = (*component).getUInt();
+    auto id = packet.find("Id");
+    if (id != packet.end()) filter.type_and_id = (*id).getUInt();
+    c->subscriber->setFilter(filter);
+  }
+}
+
+void Gateway::uplink(const Packet& packet) {
+  uint8_t buf[size_max + frame_overhead];
+  uint16_t len = frame(packet, buf);
+  for (unsigned i = 0; i < sources_count_; i++) {
+    if (sources_[i].fd < 0) continue;
+    // A full serial buffer loses the command, the sender retries
+    if (write(sources_[i].fd, buf, len) == len) uplinked_++;
+  }
+}
+
+void Gateway::flush() {
+  mmsghdr msgs[batch_max];
+  iovec iov[batch_max][2];
+  uint8_t trailer[batch_max][frame_overhead];
+  uint8_t owner[batch_max];
+
+  while (clients_count_ > 0) {
+    // Take packets round robin so one busy client does not starve the rest.
+    // Each client holds them until they are sent, so nothing is reordered.
+    unsigned taken[clients_max] = {};
+    unsigned n = 0;
+    bool more = true;
+    while (n < batch_max && more) {
+      more = false;
+      for (unsigned k = 0; k < clients_count_ && n < batch_max; k++) {
+        unsigned i = (next_client_ + k) % clients_count_;
+        GatewayClient& c = clients_[i];
+        if (taken[i] == c.held_count && !hold(c)) continue;
+
+        const uint8_t* buf = c.held[taken[i]];
+        trailer[n][0] = Packet::checksum(buf, buf[0]);
+        trailer[n][1] = 0;
+        iov[n][0].iov_base = const_cast<uint8_t*>(buf);
+        iov[n][0].iov_len = buf[0];
+        iov[n][1].iov_base = trailer[n];
+        iov[n][1].iov_len = frame_overhead;
+        msgs[n].msg_hdr = {};
+        msgs[n].msg_hdr.msg_name = &c.addr;
+        msgs[n].msg_hdr.msg_namelen = sizeof(c.addr);
+        msgs[n].msg_hdr.msg_iov = iov[n];
+        msgs[n].msg_hdr.msg_iovlen = 2;
+        owner[n] = i;
+        taken[i]++;
+        n++;
+        more = true;
+      }
+    }
+    if (n == 0) break;
+    next_client_ = (next_client_ + 1) % clients_count_;
+
+    int sent = sendmmsg(udp_fd_, msgs, n, MSG_DONTWAIT);
+    if (sent < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+        watchWrite(true);
+        return;
+      }
+      // This datagram cannot be sent at all, skip it
+      GatewayClient& c = clients_[owner[0]];
+      releaseHeld(c, 1);
+      c.failed++;
+      continue;
+    }
+
+    // Each client's part of the batch is the start of what it holds
+    unsigned done[clients_max] = {};
+    for (int k = 0; k < sent; k++) done[owner[k]]++;
+    for (unsigned i = 0; i < clients_count_; i++) {
+      releaseHeld(clients_[i], done[i]);
+      clients_[i].sent += done[i];
+    }
+    if (sent < (int)n) {
+      watchWrite(true);
+      return;
+    }
+  }
+  watchWrite(false);
+}
+
+void Gateway::watchWrite(bool on) {
+  if (on == want_write_) return;
+  want_write_ = on;
+  epoll_event ev = {};
+  ev.events = EPOLLIN | (on ? (uint32_t)EPOLLOUT : 0u);
+  ev.data.u32 = udp_tag;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, udp_fd_, &ev);
+}
+
+void Gateway::pauseSources(bool on) {
+  if (on == paused_) return;
+  paused_ = on;
+  for (unsigned i = 0; i < sources_count_; i++) {
+    if (sources_[i].fd < 0) continue;
+    epoll_event ev = {};
+    ev.events = on ? 0u : (uint32_t)EPOLLIN;
+    ev.data.u32 = i;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, sources_[i].fd, &ev);
+  }
+}
+
+
+bool setMulticast(int fd, uint8_t ttl, bool loop) {
+  unsigned char t = ttl, l = loop;
+  return setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &t, sizeof(t)) == 0 &&
+         setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &l, sizeof(l)) == 0;
+}
+
+bool joinMulticast(int fd, const char* group) {
+  ip_mreq req = {};
+  if (inet_pton(AF_INET, group, &req.imr_multiaddr) != 1) return false;
+  req.imr_interface.s_addr = htonl(INADDR_ANY);
+  return setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &req, sizeof(req)) == 0;
+}
+
+bool parseAddress(const char* host, uint16_t port, sockaddr_in& addr) {
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  addrinfo* res;
+  if (getaddrinfo(host, nullptr, &hints, &res) != 0) return false;
+  addr = *reinterpret_cast<sockaddr_in*>(res->ai_addr);
+  freeaddrinfo(res);
+  addr.sin_port = htons(port);
+  return true;
+}
+
+} // namespace wcpp
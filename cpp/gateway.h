@@ -0,0 +1,139 @@
+#pragma once
+
+// Bridges packets between serial sources and UDP clients (Linux).
+//
+// Packets framed on the sources are decoded into a shared PacketPool and
+// published on a Bus, where every client has its own Subscriber; the
+// subscribers are drained with sendmmsg, one frame per datagram. Datagrams from clients
+// are read with recvmmsg. Remote packets from clients go out to all the
+// sources; local command packets are requests to the gateway itself:
+//
+//   'S' subscribe   Un: origin unit ID, Cp: component ID,
+//                   Id: packet type and ID (absent entries match anything)
+//   'U' unsubscribe
+//
+// A client also gets a catch-all subscription with its first datagram. After
+// 'U' it stays off until it sends 'S', whatever else it sends meanwhile.
+// Multicast groups are added as clients with addClient().
+//
+// Backpressure: a client whose queue is full loses the packet (counted in
+// dropped()), and while the pool is exhausted the sources are not read, so
+// the kernel and the serial line buffer the burst. Clients always use
+// BusPolicy::drop: the loop that would wait for room is the one draining.
+
+#include "bus.h"
+#include "deframer.h"
+
+#include <memory>
+#include <netinet/in.h>
+
+namespace wcpp {
+
+constexpr uint8_t gateway_subscribe   = 'S';
+constexpr uint8_t gateway_unsubscribe = 'U';
+
+constexpr unsigned gateway_batch_max = 64;
+
+struct GatewayClient {
+  sockaddr_in addr;
+  // Kept when the client is removed, and reused for the next one
+  Subscriber* subscriber = nullptr;
+  // Taken from the subscriber but not sent yet, oldest first
+  const uint8_t* held[gateway_batch_max];
+  unsigned held_count = 0;
+  uint64_t sent;
+  uint64_t failed;
+  uint64_t dropped_before;
+
+  inline uint64_t dropped() const { return subscriber->dropped() - dropped_before + failed; }
+};
+
+struct GatewaySource {
+  int fd;
+  Deframer deframer;
+  uint8_t rx[4096];
+  uint16_t rx_pos;
+  uint16_t rx_len;
+  uint64_t received;
+  uint64_t dropped;
+};
+
+class Gateway {
+public:
+  static constexpr unsigned clients_max = 32;
+  static constexpr unsigned sources_max = 8;
+  static constexpr unsigned batch_max   = gateway_batch_max;
+
+  // Takes ownership of udp_fd, a bound UDP socket (see openUdp)
+  Gateway(PacketPool& pool, int udp_fd, uint32_t queue_capacity = 256);
+  ~Gateway();
+
+  Gateway(const Gateway&) = delete;
+  Gateway& operator=(const Gateway&) = delete;
+
+  inline bool isValid() const { return epoll_fd_ >= 0 && udp_fd_ >= 0; }
+
+  // Takes ownership of fd, a serial, pty or stream socket
+  bool addSource(int fd);
+  GatewayClient* addClient(const sockaddr_in& addr, const BusFilter& filter = BusFilter());
+  void removeClient(const sockaddr_in& addr);
+  GatewayClient* client(const sockaddr_in& addr);
+
+  // Publishes a packet from a source other than the fds, e.g. a CAN driver
+  unsigned publish(const Packet& packet);
+  // Subscribers record TraceStage::deliver as packets are taken to be sent
+  inline void traceTo(Tracer& tracer) { bus_.traceTo(tracer); }
+
+  // Waits up to timeout_ms for I/O and handles whatever is ready
+  bool runOnce(int timeout_ms);
+
+  inline unsigned clients() const { return clients_count_; }
+  inline const GatewayClient& clientAt(unsigned i) const { return clients_[i]; }
+  inline const GatewaySource& sourceAt(unsigned i) const { return sources_[i]; }
+  inline uint64_t uplinked() const { return uplinked_; }
+
+private:
+  PacketPool& pool_;
+  Bus bus_;
+  int udp_fd_;
+  int epoll_fd_;
+  uint32_t capacity_;
+  bool want_write_;
+  bool paused_;
+  std::unique_ptr<uint8_t[]> datagrams_;
+
+  GatewayClient clients_[clients_max];
+  unsigned clients_count_;
+  unsigned next_client_;
+  // Recent unsubscribers; once full, each new one overwrites another
+  sockaddr_in left_[clients_max];
+  unsigned left_count_;
+  unsigned left_next_;
+  GatewaySource sources_[sources_max];
+  unsigned sources_count_;
+  uint64_t uplinked_;
+
+  static constexpr unsigned datagram_max = 2048;
+
+  void removeAt(unsigned i);
+  bool hold(GatewayClient& c);
+  void releaseHeld(GatewayClient& c, unsigned n);
+  bool hasLeft(const sockaddr_in& addr) const;
+  void setLeft(const sockaddr_in& addr, bool left);
+  void readSource(GatewaySource& s);
+  void readClients();
+  void handle(const sockaddr_in& from, const Packet& packet);
+  void uplink(const Packet& packet);
+  void flush();
+  void watchWrite(bool on);
+  void pauseSources(bool on);
+};
+
+// Multicast helpers: sets the outgoing TTL and loopback on a UDP socket, or
+// joins a group to receive it
+bool setMulticast(int fd, uint8_t ttl, bool loop = true);
+bool joinMulticast(int fd, const char* group);
+
+bool parseAddress(const char* host, uint16_t port, sockaddr_in& addr);
+
+} // namespace wcpp
@@ -0,0 +1,108 @@
+#include "gateway.h"
+#include "link.h"
+
+#include <arpa/inet.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// wcpp_gateway -p 5000 -s /dev/ttyUSB0:115200 -m 239.0.0.1:5001 -c 192.168.0.10:5002
+//
+//   -p port        UDP port clients send to (default 5000)
+//   -s path[:baud] serial source, repeatable
+//   -m group:port  multicast group that gets every packet, repeatable
+//   -c host:port   fixed client that gets every packet, repeatable
+//   -t ttl         multicast TTL (default 1)
+
+static volatile sig_atomic_t running = 1;
+
+static void stop(int) { running = 0; }
+
+static bool splitAddress(char* arg, const char** host, uint16_t* port) {
+  char* colon = strrchr(arg, ':');
+  if (colon == nullptr) return false;
+  *colon = '\0';
+  *host = arg;
+  *port = atoi(colon + 1);
+  return *port != 0;
+}
+
+static void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-p port] [-s path[:baud]]... [-m group:port]... "
+                  "[-c host:port]... [-t ttl]\n", name);
+}
+
+int main(int argc, char** argv) {
+  static wcpp::StaticPacketPool<8192> pool;
+
+  uint16_t port = 5000;
+  uint8_t ttl = 1;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "-p") == 0) port = atoi(argv[i + 1]);
+    if (strcmp(argv[i], "-t") == 0) ttl = atoi(argv[i + 1]);
+  }
+
+  int udp_fd = wcpp::openUdp(port);
+  if (udp_fd < 0 || !wcpp::setMulticast(udp_fd, ttl)) {
+    perror("udp");
+    return 1;
+  }
+  wcpp::Gateway gateway(pool, udp_fd);
+  if (!gateway.isValid()) {
+    perror("gateway");
+    return 1;
+  }
+
+  for (int i = 1; i < argc; i += 2) {
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      return 1;
+    }
+    char* arg = argv[i + 1];
+    if (strcmp(argv[i], "-s") == 0) {
+      unsigned baud = 115200;
+      char* colon = strrchr(arg, ':');
+      if (colon != nullptr) {
+        *colon = '\0';
+        baud = atoi(colon + 1);
+      }
+      if (!gateway.addSource(wcpp::openSerial(arg, baud))) {
+        fprintf(stderr, "cannot open %s at %u baud\n", arg, baud);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], "-m") == 0 || strcmp(argv[i], "-c") == 0) {
+      const char* host;
+      uint16_t client_port;
+      sockaddr_in addr;
+      if (!splitAddress(arg, &host, &client_port) ||
+          !wcpp::parseAddress(host, client_port, addr) || !gateway.addClient(addr)) {
+        fprintf(stderr, "bad address %s\n", arg);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], "-p") != 0 && strcmp(argv[i], "-t") != 0) {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+  fprintf(stderr, "listening on udp %u\n", port);
+
+  while (running) {
+    if (!gateway.runOnce(1000)) {
+      perror("epoll");
+      return 1;
+    }
+  }
+
+  for (unsigned i = 0; i < gateway.clients(); i++) {
+    const wcpp::GatewayClient& c = gateway.clientAt(i);
+    fprintf(stderr, "client %s:%u sent %llu dropped %llu\n", inet_ntoa(c.addr.sin_addr),
+            ntohs(c.addr.sin_port), (unsigned long long)c.sent, (unsigned long long)c.dropped());
+  }
+  return 0;
+}
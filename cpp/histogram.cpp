@@ -0,0 +1,46 @@
+#include "histogram.h"
+
+#ifndef ARDUINO
+
+#include <algorithm>
+#include <cmath>
+
+namespace wcpp {
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+  for (unsigned i = 0; i < buckets; i++) add(counts_[i], other.counts_[i].load(std::memory_order_relaxed));
+  add(count_, other.count());
+  add(sum_, other.sum_.load(std::memory_order_relaxed));
+  if (other.max() > max()) max_.store(other.max(), std::memory_order_relaxed);
+}
+
+void LatencyHistogram::reset() {
+  for (unsigned i = 0; i < buckets; i++) counts_[i].store(0, std::memory_order_relaxed);
+  count_.store(0, std::memory_order_relaxed);
+  sum_.store(0, std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::highest(unsigned bucket) {
+  if (bucket < 2 * sub_count) return bucket;
+  unsigned shift = bucket / sub_count - 1;
+  uint64_t lowest = (uint64_t)(sub_count + bucket % sub_count) << shift;
+  return lowest + (((uint64_t)1 << shift) - 1);
+}
+
+uint64_t LatencyHistogram::percentile(double q) const {
+  uint64_t total = count();
+  if (total == 0) return 0;
+  uint64_t rank = std::ceil(q * total);
+  if (rank < 1) rank = 1;
+  uint64_t seen = 0;
+  for (unsigned i = 0; i < buckets; i++) {
+    seen += counts_[i].load(std::memory_order_relaxed);
+    if (seen >= rank) return std::min(highest(i), max());
+  }
+  return max();
+}
+
+} // namespace wcpp
+
+#endif
@@ -0,0 +1,71 @@
+#pragma once
+
+#ifndef ARDUINO
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace wcpp {
+
+// Latency histogram with HDR-style log-linear buckets: values below 32
+// count exactly, larger ones in 16 buckets per power of two, so a
+// percentile is within 1/16 of the true value over the whole uint64_t
+// range. Meant for nanoseconds.
+//
+// One thread records; any thread may read percentiles at the same time,
+// which may then miss the latest few values.
+
+class LatencyHistogram {
+public:
+  static constexpr unsigned sub_bits = 4;
+  static constexpr unsigned sub_count = 1 << sub_bits;
+  static constexpr unsigned buckets = (64 - sub_bits + 1) * sub_count;
+
+  LatencyHistogram() { reset(); }
+
+  inline void record(uint64_t value) {
+    add(counts_[bucket(value)], 1);
+    add(count_, 1);
+    add(sum_, value);
+    if (value > max_.load(std::memory_order_relaxed)) max_.store(value, std::memory_order_relaxed);
+  }
+
+  // Adds the counts of another histogram, from the recording thread
+  void merge(const LatencyHistogram& other);
+  void reset();
+
+  inline uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+  inline uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+  inline uint64_t mean() const { return count() > 0 ? sum_.load(std::memory_order_relaxed) / count() : 0; }
+  // The value at or below which the fraction q of the values lie, as the
+  // highest value of its bucket
+  uint64_t percentile(double q) const;
+
+  static inline unsigned bucket(uint64_t value) {
+    if (value < 2 * sub_count) return value;
+    unsigned msb = 63 - __builtin_clzll(value);
+    return (msb - sub_bits + 1) * sub_count + (value >> (msb - sub_bits) & (sub_count - 1));
+  }
+  static uint64_t highest(unsigned bucket);
+
+private:
+  std::atomic<uint64_t> counts_[buckets];
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> sum_;
+  std::atomic<uint64_t> max_;
+
+  // Single writer, so no read-modify-write is needed
+  static inline void add(std::atomic<uint64_t>& a, uint64_t n) {
+    a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+};
+
+inline uint64_t monotonicNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace wcpp
+
+#endif
@@ -0,0 +1,38 @@
+#include "instrument.h"
+
+namespace wcpp {
+namespace instrument {
+
+LiveCounters counters;
+
+Counters snapshot() {
+  Counters c;
+  c.packet_resize      = counters.packet_resize;
+  c.sub_entries_resize = counters.sub_entries_resize;
+  c.resize_failed      = counters.resize_failed;
+  c.memmove_bytes      = counters.memmove_bytes;
+  c.iterator_steps     = counters.iterator_steps;
+  c.checksum_bytes     = counters.checksum_bytes;
+  return c;
+}
+
+void reset() {
+  counters.packet_resize      = 0;
+  counters.sub_entries_resize = 0;
+  counters.resize_failed      = 0;
+  counters.memmove_bytes      = 0;
+  counters.iterator_steps     = 0;
+  counters.checksum_bytes     = 0;
+}
+
+void dump(const Counters& c) {
+  printf("packet resize      %lu\n", (unsigned long)c.packet_resize);
+  printf("sub entries resize %lu\n", (unsigned long)c.sub_entries_resize);
+  printf("resize failed      %lu\n", (unsigned long)c.resize_failed);
+  printf("memmove bytes      %lu\n", (unsigned long)c.memmove_bytes);
+  printf("iterator steps     %lu\n", (unsigned long)c.iterator_steps);
+  printf("checksum bytes     %lu\n", (unsigned long)c.checksum_bytes);
+}
+
+} // namespace instrument
+} // namespace wcpp
@@ -0,0 +1,69 @@
+#pragma once
+
+// Hot-path counters, compiled in only with WCPP_INSTRUMENT defined.
+// Without it WCPP_COUNT() expands to nothing and the counters are never touched.
+// Likewise WCPP_TRACE() prints only with WCPP_DEBUG_TRACE defined.
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <stdint.h>
+#include <atomic>
+#endif
+
+#include <stdio.h>
+
+namespace wcpp {
+namespace instrument {
+
+#ifdef ARDUINO
+using counter_t = volatile uint32_t;
+#else
+using counter_t = std::atomic<uint32_t>;
+#endif
+
+struct Counters {
+  uint32_t packet_resize;
+  uint32_t sub_entries_resize;
+  uint32_t resize_failed;
+  uint32_t memmove_bytes;
+  uint32_t iterator_steps;
+  uint32_t checksum_bytes;
+};
+
+struct LiveCounters {
+  counter_t packet_resize;
+  counter_t sub_entries_resize;
+  counter_t resize_failed;
+  counter_t memmove_bytes;
+  counter_t iterator_steps;
+  counter_t checksum_bytes;
+};
+
+extern LiveCounters counters;
+
+#ifdef ARDUINO
+inline void add(counter_t& counter, uint32_t n) { counter = counter + n; }
+#else
+inline void add(counter_t& counter, uint32_t n) { counter.fetch_add(n, std::memory_order_relaxed); }
+#endif
+
+Counters snapshot();
+void reset();
+void dump(const Counters& c);
+inline void dump() { dump(snapshot()); }
+
+} // namespace instrument
+} // namespace wcpp
+
+#ifdef WCPP_INSTRUMENT
+#define WCPP_COUNT(counter, n) ::wcpp::instrument::add(::wcpp::instrument::counters.counter, (n))
+#else
+#define WCPP_COUNT(counter, n) ((void)0)
+#endif
+
+#ifdef WCPP_DEBUG_TRACE
+#define WCPP_TRACE(...) printf(__VA_ARGS__)
+#else
+#define WCPP_TRACE(...) ((void)0)
+#endif
@@ -0,0 +1,316 @@
+#include "link.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <exception>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace wcpp {
+
+void Task::promise_type::unhandled_exception() noexcept {
+  std::terminate();
+}
+
+
+EventLoop::EventLoop() : fd_(epoll_create1(EPOLL_CLOEXEC)), stopped_(false), waiting_(0) {}
+
+EventLoop::~EventLoop() {
+  if (fd_ >= 0) close(fd_);
+}
+
+bool EventLoop::runOnce(int timeout_ms) {
+  epoll_event events[64];
+  int n = epoll_wait(fd_, events, 64, timeout_ms);
+  if (n < 0) return errno == EINTR;
+  for (int i = 0; i < n; i++) {
+    static_cast<Link*>(events[i].data.ptr)->wake(events[i].events);
+  }
+  return true;
+}
+
+void EventLoop::run() {
+  stopped_ = false;
+  while (!stopped_ && waiting_ > 0) {
+    if (!runOnce()) break;
+  }
+}
+
+
+Link::Link(EventLoop& loop, int fd, bool datagram)
+  : loop_(loop), fd_(fd), datagram_(datagram), socket_(false), connected_(false),
+    closed_(false), failed_(false), ready_(false), peer_len_(0),
+    rx_pos_(0), rx_len_(0), tx_pos_(0), tx_len_(0) {
+  if (fd_ < 0) return;
+
+  int type;
+  socklen_t len = sizeof(type);
+  socket_ = getsockopt(fd_, SOL_SOCKET, SO_TYPE, &type, &len) == 0;
+  if (socket_) {
+    sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    connected_ = getpeername(fd_, reinterpret_cast<sockaddr*>(&addr), &addr_len) == 0;
+  }
+
+  epoll_event ev = {};
+  ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  ev.data.ptr = this;
+  int flags = fcntl(fd_, F_GETFL);
+  if (flags < 0 || fcntl(fd_, F_SETFL, flags | O_NONBLOCK) < 0 ||
+      epoll_ctl(loop_.fd_, EPOLL_CTL_ADD, fd_, &ev) < 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+Link::~Link() {
+  if (reader_) loop_.waiting_--;
+  if (writer_) loop_.waiting_--;
+  if (fd_ < 0) return;
+  epoll_ctl(loop_.fd_, EPOLL_CTL_DEL, fd_, nullptr);
+  close(fd_);
+}
+
+bool Link::next() {
+  if (fd_ < 0) failed_ = true;
+  if (ready_ || closed_ || failed_) return true;
+  if (deframer_.next()) {
+    ready_ = true;
+    return true;
+  }
+  while (true) {
+    while (rx_pos_ < rx_len_) {
+      if (deframer_.put(rx_[rx_pos_++])) {
+        ready_ = true;
+        return true;
+      }
+    }
+
+    ssize_t n;
+    if (datagram_) {
+      // A frame never spans datagrams
+      deframer_.reset();
+      sockaddr_storage from;
+      socklen_t from_len = sizeof(from);
+      n = recvfrom(fd_, rx_, sizeof(rx_), 0, reinterpret_cast<sockaddr*>(&from), &from_len);
+      if (n >= 0) {
+        peer_ = from;
+        peer_len_ = from_len;
+      }
+    }
+    else {
+      n = read(fd_, rx_, sizeof(rx_));
+    }
+
+    if (n > 0) {
+      rx_pos_ = 0;
+      rx_len_ = n;
+      continue;
+    }
+    if (n == 0) {
+      if (datagram_) continue;
+      closed_ = true;
+      return true;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) return false;
+    if (errno == EINTR) continue;
+    // A UDP peer that is not up yet
+    if (datagram_ && errno == ECONNREFUSED) continue;
+    failed_ = true;
+    return true;
+  }
+}
+
+bool Link::flush() {
+  while (tx_pos_ < tx_len_) {
+    if (fd_ < 0 || closed_ || failed_) {
+      tx_pos_ = tx_len_;
+      return true;
+    }
+
+    ssize_t n;
+    if (datagram_ && !connected_) {
+      if (peer_len_ == 0) {
+        // Nobody to reply to yet
+        tx_pos_ = tx_len_;
+        return true;
+      }
+      n = sendto(fd_, tx_, tx_len_, MSG_NOSIGNAL,
+                 reinterpret_cast<const sockaddr*>(&peer_), peer_len_);
+    }
+    else if (socket_) {
+      n = ::send(fd_, tx_ + tx_pos_, tx_len_ - tx_pos_, MSG_NOSIGNAL);
+    }
+    else {
+      n = write(fd_, tx_ + tx_pos_, tx_len_ - tx_pos_);
+    }
+
+    if (n >= 0) {
+      tx_pos_ += datagram_ ? tx_len_ : n;
+      continue;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) return false;
+    if (errno == EINTR) continue;
+    if (datagram_ && errno == ECONNREFUSED) {
+      tx_pos_ = tx_len_;
+      return true;
+    }
+    failed_ = true;
+  }
+  return true;
+}
+
+Link::SendAwaiter Link::send(const Packet& packet) {
+  // One sender at a time, a frame still going out is finished first
+  if (tx_pos_ < tx_len_ || packet.isNull() || packet.size() == 0) {
+    return SendAwaiter(*this, false);
+  }
+  tx_len_ = frame(packet, tx_);
+  tx_pos_ = 0;
+  return SendAwaiter(*this, true);
+}
+
+bool Link::ReceiveAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  if (link_.next()) return false;
+  link_.reader_ = handle;
+  link_.loop_.waiting_++;
+  return true;
+}
+
+Packet Link::ReceiveAwaiter::await_resume() {
+  if (!link_.ready_) return Packet::null();
+  link_.ready_ = false;
+  return link_.deframer_.packet();
+}
+
+bool Link::SendAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  if (link_.flush()) return false;
+  link_.writer_ = handle;
+  link_.loop_.waiting_++;
+  return true;
+}
+
+void Link::wake(uint32_t events) {
+  // The resumed coroutines may destroy the link, so touch nothing after
+  std::coroutine_handle<> reader, writer;
+  if (writer_ && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) && flush()) {
+    writer = writer_;
+    writer_ = nullptr;
+    loop_.waiting_--;
+  }
+  if (reader_ && (events & (EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLRDHUP)) && next()) {
+    reader = reader_;
+    reader_ = nullptr;
+    loop_.waiting_--;
+  }
+  if (writer) writer.resume();
+  if (reader) reader.resume();
+}
+
+
+static speed_t baudToSpeed(unsigned baud) {
+  switch (baud) {
+  case 9600:   return B9600;
+  case 19200:  return B19200;
+  case 38400:  return B38400;
+  case 57600:  return B57600;
+  case 115200: return B115200;
+  case 230400: return B230400;
+  case 460800: return B460800;
+  case 921600: return B921600;
+  default:     return B0;
+  }
+}
+
+int openSerial(const char* path, unsigned baud) {
+  speed_t speed = baudToSpeed(baud);
+  if (speed == B0) return -1;
+
+  int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) return -1;
+
+  termios tio;
+  if (tcgetattr(fd, &tio) < 0) {
+    close(fd);
+    return -1;
+  }
+  cfmakeraw(&tio);
+  tio.c_cflag |= CLOCAL | CREAD;
+  cfsetispeed(&tio, speed);
+  cfsetospeed(&tio, speed);
+  if (tcsetattr(fd, TCSANOW, &tio) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int openUdp(uint16_t local_port, const char* host, uint16_t port) {
+  int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(local_port);
+  if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  if (host != nullptr) {
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* res;
+    if (getaddrinfo(host, nullptr, &hints, &res) != 0) {
+      close(fd);
+      return -1;
+    }
+    sockaddr_in peer = *reinterpret_cast<sockaddr_in*>(res->ai_addr);
+    freeaddrinfo(res);
+    peer.sin_port = htons(port);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&peer), sizeof(peer)) < 0) {
+      close(fd);
+      return -1;
+    }
+  }
+  return fd;
+}
+
+uint16_t localPort(int fd) {
+  sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  if (getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) < 0) return 0;
+  return ntohs(addr.sin_port);
+}
+
+bool openPair(int fds[2]) {
+  return socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) == 0;
+}
+
+int openPty(char* slave_path, unsigned length) {
+  int fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if (fd < 0) return -1;
+  if (grantpt(fd) < 0 || unlockpt(fd) < 0 || ptsname_r(fd, slave_path, length) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  termios tio;
+  if (tcgetattr(fd, &tio) == 0) {
+    cfmakeraw(&tio);
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+  return fd;
+}
+
+} // namespace wcpp
@@ -0,0 +1,158 @@
+#pragma once
+
+// Coroutine link I/O on Linux (epoll). One thread runs an EventLoop and
+// serves any number of links:
+//
+//   wcpp::Task forward(wcpp::Link& from, wcpp::Link& to) {
+//     while (true) {
+//       wcpp::Packet p = co_await from.receive();
+//       if (p.isNull()) break;        // closed or failed
+//       co_await to.send(p);
+//     }
+//   }
+//
+// receive() returns a view into the link's frame buffer, valid until the
+// next receive() on it. Each link serves one receiver and one sender at a
+// time.
+
+#include "deframer.h"
+
+#include <coroutine>
+#include <sys/socket.h>
+
+namespace wcpp {
+
+// Coroutine that starts right away and frees itself when it finishes
+struct Task {
+  struct promise_type {
+    Task get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() noexcept;
+  };
+};
+
+class Link;
+
+class EventLoop {
+public:
+  EventLoop();
+  ~EventLoop();
+
+  EventLoop(const EventLoop&) = delete;
+  EventLoop& operator=(const EventLoop&) = delete;
+
+  inline bool isValid() const { return fd_ >= 0; }
+
+  // Waits up to timeout_ms (-1 for ever) and resumes the ready coroutines
+  bool runOnce(int timeout_ms = -1);
+  // Runs until stop() or until no coroutine is waiting on a link
+  void run();
+  inline void stop() { stopped_ = true; }
+
+  inline unsigned waiting() const { return waiting_; }
+
+private:
+  int fd_;
+  bool stopped_;
+  unsigned waiting_;
+
+  friend Link;
+};
+
+class Link {
+public:
+  // Takes ownership of fd and makes it non-blocking. A datagram link gets
+  // one frame per datagram.
+  Link(EventLoop& loop, int fd, bool datagram = false);
+  ~Link();
+
+  Link(const Link&) = delete;
+  Link& operator=(const Link&) = delete;
+
+  inline bool isValid() const { return fd_ >= 0; }
+  inline bool isClosed() const { return closed_; }
+  inline int fd() const { return fd_; }
+
+  class ReceiveAwaiter {
+  public:
+    inline bool await_ready() { return link_.next(); }
+    bool await_suspend(std::coroutine_handle<> handle);
+    Packet await_resume();
+
+  private:
+    Link& link_;
+    ReceiveAwaiter(Link& link) : link_(link) {}
+    friend Link;
+  };
+
+  class SendAwaiter {
+  public:
+    inline bool await_ready() { return link_.flush(); }
+    bool await_suspend(std::coroutine_handle<> handle);
+    inline bool await_resume() { return ok_ && !link_.failed_; }
+
+  private:
+    Link& link_;
+    bool ok_;
+    SendAwaiter(Link& link, bool ok) : link_(link), ok_(ok) {}
+    friend Link;
+  };
+
+  inline ReceiveAwaiter receive() { return ReceiveAwaiter(*this); }
+  SendAwaiter send(const Packet& packet);
+
+  inline const Deframer& deframer() const { return deframer_; }
+
+private:
+  EventLoop& loop_;
+  int fd_;
+  bool datagram_;
+  bool socket_;
+  bool connected_;
+  bool closed_;
+  bool failed_;
+  bool ready_;
+
+  // Sender of the last datagram, replies go there if not connected
+  sockaddr_storage peer_;
+  socklen_t peer_len_;
+
+  std::coroutine_handle<> reader_;
+  std::coroutine_handle<> writer_;
+
+  Deframer deframer_;
+  uint8_t rx_[4096];
+  uint16_t rx_pos_;
+  uint16_t rx_len_;
+
+  uint8_t tx_[size_max + frame_overhead];
+  uint16_t tx_pos_;
+  uint16_t tx_len_;
+
+  bool next();
+  bool flush();
+  void wake(uint32_t events);
+
+  friend EventLoop;
+};
+
+// File descriptors for the backends, -1 on failure
+
+// Serial tty (or pty slave) in raw mode
+int openSerial(const char* path, unsigned baud = 115200);
+
+// UDP socket bound to local_port (0 for any) on all interfaces, and sending
+// to host:port if host is given
+int openUdp(uint16_t local_port, const char* host = nullptr, uint16_t port = 0);
+uint16_t localPort(int fd);
+
+// Connected pair of stream sockets, a local stand-in for a serial line
+bool openPair(int fds[2]);
+
+// Pseudo terminal: returns the master and writes the slave path, for tools
+// that expect a serial port
+int openPty(char* slave_path, unsigned length);
+
+} // namespace wcpp
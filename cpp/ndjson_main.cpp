@@ -0,0 +1,38 @@
+#include "format.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// wcpp_ndjson [-t] [-x] [in [out]]
+//
+//   -t  input is a timed log (millis | size | packet) instead of framed packets
+//   -x  compact text instead of JSON
+//
+// Reads stdin and writes stdout when no files are given.
+
+int main(int argc, char** argv) {
+  wcpp::LogFormat format = wcpp::LogFormat::framed;
+  wcpp::TextStyle style = wcpp::TextStyle::json;
+  const char* paths[2] = {nullptr, nullptr};
+  int n = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-t") == 0) format = wcpp::LogFormat::timed;
+    else if (strcmp(argv[i], "-x") == 0) style = wcpp::TextStyle::text;
+    else if (argv[i][0] != '-' && n < 2) paths[n++] = argv[i];
+    else {
+      fprintf(stderr, "usage: %s [-t] [-x] [in [out]]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  FILE* in = paths[0] ? fopen(paths[0], "rb") : stdin;
+  FILE* out = paths[1] ? fopen(paths[1], "w") : stdout;
+  if (in == nullptr || out == nullptr) {
+    perror(in == nullptr ? paths[0] : paths[1]);
+    return 1;
+  }
+
+  unsigned long long count = wcpp::convertLog(in, out, format, style);
+  fprintf(stderr, "%llu packets\n", count);
+  return fclose(out) == 0 ? 0 : 1;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "fixed.h"
+#include "packet.h"
+
+namespace wcpp {
+
+// Packet with its buffer inline, so it can be copied, moved and kept in
+// containers by value. Copies and moves only copy the packet's bytes, not
+// the whole buffer. The Entries and header APIs of Packet work on it, and
+// view() gives a Packet over the inline buffer, valid as long as the
+// OwnedPacket is. Packet is a private base, so nothing can rebind or release
+// the inline buffer through a Packet&.
+//
+// A packet that does not fit in N bytes is not copied and leaves it empty.
+
+template <unsigned N = size_max>
+class OwnedPacket : private FixedArray<uint8_t, N>, private Packet {
+  static_assert(N >= 4 && N <= size_max, "OwnedPacket size must be 4 to 255");
+
+public:
+  using Packet::iterator;
+  using Packet::const_iterator;
+  using Packet::begin;
+  using Packet::end;
+  using Packet::at;
+  using Packet::find;
+  using Packet::append;
+  using Packet::clear;
+  using Packet::size;
+  using Packet::header_size;
+  using Packet::size_remain;
+  using Packet::getBuf;
+  using Packet::encode;
+#ifndef ARDUINO
+  using Packet::visit;
+#endif
+
+  using Packet::command;
+  using Packet::telemetry;
+  using Packet::setSequence;
+  using Packet::isNull;
+  using Packet::isCommand;
+  using Packet::isTelemetry;
+  using Packet::isLocal;
+  using Packet::isRemote;
+  using Packet::operator bool;
+  using Packet::operator!;
+  using Packet::packet_id;
+  using Packet::type_and_id;
+  using Packet::component_id;
+  using Packet::origin_unit_id;
+  using Packet::dest_unit_id;
+  using Packet::sequence;
+  using Packet::key;
+  using Packet::checksum;
+  using Packet::copyHeader;
+  using Packet::copyPayload;
+  using Packet::copy;
+
+  OwnedPacket() : Packet(Packet::empty(this->items_, N)) {}
+  explicit OwnedPacket(const Packet& packet) : OwnedPacket() { assign(packet); }
+  OwnedPacket(const OwnedPacket& packet) : OwnedPacket() { assign(packet); }
+  OwnedPacket(OwnedPacket&& packet) : OwnedPacket() { assign(packet); }
+
+  inline OwnedPacket& operator=(const Packet& packet) { assign(packet); return *this; }
+  inline OwnedPacket& operator=(const OwnedPacket& packet) { assign(packet); return *this; }
+  inline OwnedPacket& operator=(OwnedPacket&& packet) { assign(packet); return *this; }
+  template <unsigned M> explicit OwnedPacket(const OwnedPacket<M>& packet) : OwnedPacket() {
+    assign(packet.view());
+  }
+  template <unsigned M> inline OwnedPacket& operator=(const OwnedPacket<M>& packet) {
+    assign(packet.view());
+    return *this;
+  }
+
+  inline Packet view() { return *this; }
+  inline const Packet view() const { return *this; }
+
+  static constexpr unsigned capacity() { return N; }
+
+private:
+  void assign(const Packet& packet) {
+    if (&packet == static_cast<const Packet*>(this)) return;
+    uint8_t size = packet.size();
+    if (size == 0 || size > N) {
+      this->items_[0] = 0;
+      return;
+    }
+    std::memcpy(this->items_, packet.encode(), size);
+  }
+};
+
+} // namespace wcpp
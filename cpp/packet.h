@@ -4,21 +4,26 @@
 #include <Arduino.h>
 #else
 #include <stdint.h>
+#include <span>
+#include <string_view>
 #endif
 
 #include <cstring>
 #include <stdio.h>
 #include "cppcrc.h"
 #include "float16.h"
+#include "instrument.h"
 
 namespace wcpp {
 
 class Entries;
 class SubEntries;
 class Packet;
+class StructEdit;
 class EntriesIterator;
 class EntriesConstIterator;
 class Entry;
+class SequenceTable;
 
 constexpr unsigned size_max = 255;
 
@@ -28,13 +33,69 @@ constexpr uint8_t component_id_self = 0x00;
 constexpr uint8_t packet_type_mask  = 0b10000000;
 constexpr uint8_t packet_id_mask    = 0b01111111;
 
+#ifdef __cpp_consteval
+#define WCPP_CONSTEVAL consteval
+#else
+#define WCPP_CONSTEVAL constexpr
+#endif
+
+// Never defined as constexpr, so an invalid name that is a constant fails
+// to compile
+void invalidEntryName();
+
+// An entry name checked and packed at compile time:
+//   packet.find("Ax"_wn)
+// Names are two of A-Z (either case) and @[\]^_, 5 bits each, in the low
+// bits of the two type bytes. Finding one compares both bytes at once.
+class EntryName {
+public:
+  static constexpr uint16_t mask = 0x1F1F;
+
+  WCPP_CONSTEVAL EntryName(char c0, char c1) : bits_(checked(c0) | checked(c1) << 8) {}
+
+  // Without the check, for names only known at run time
+  static constexpr EntryName masked(const char name[2]) {
+    return EntryName((name[0] & 0x1F) | (name[1] & 0x1F) << 8);
+  }
+
+  // The two type bytes of an entry with this name, little endian, type bits zero
+  constexpr uint16_t bits() const { return bits_; }
+  // The 10-bit key (first character in the low bits)
+  constexpr uint16_t key() const { return (bits_ & 0x1F) | (bits_ >> 8) << 5; }
+
+  constexpr char operator[](int i) const {
+    return i == 0 ? (bits_ & 0x1F) + 64 : i == 1 ? (bits_ >> 8) + 96 : '\0';
+  }
+  constexpr bool operator==(EntryName name) const { return bits_ == name.bits_; }
+  constexpr bool operator!=(EntryName name) const { return bits_ != name.bits_; }
+
+private:
+  uint16_t bits_;
+
+  constexpr explicit EntryName(uint16_t bits) : bits_(bits) {}
+
+  static constexpr uint16_t checked(char c) {
+    if (!((c >= '@' && c <= '_') || (c >= 'a' && c <= 'z'))) invalidEntryName();
+    return c & 0x1F;
+  }
+};
+
+inline namespace literals {
+WCPP_CONSTEVAL EntryName operator""_wn(const char* name, size_t length) {
+  if (length != 2) invalidEntryName();
+  return EntryName(name[0], name[1]);
+}
+} // namespace literals
+
 
 class Entry {
 public:
   class Name {
   public:
     Name &operator=(const char name[2]);
+    Name &operator=(EntryName name);
     bool operator==(const char name[2]);
+    bool operator==(EntryName name);
     bool operator==(Name name);
 
     char operator[](int i) const; 
@@ -47,8 +108,13 @@ public:
     friend Entry;
   };
 
+  enum class Kind : uint8_t {
+    null, unsigned_int, signed_int, float16, float32, float64, bytes, structure, packet
+  };
+
   Name name() const;
   uint8_t size() const;
+  Kind kind() const;
 
   operator bool() const;
 
@@ -75,9 +141,20 @@ public:
   double  getFloat64() const;
   uint8_t getBytes(uint8_t* bytes) const;
   uint8_t getString(char* str) const;
+#ifndef ARDUINO
+  // Views point into the packet buffer and are valid until it is modified
+  std::span<const uint8_t> getBytesView() const;
+  std::string_view getStringView() const;
+  // Copy at most bytes.size() bytes (str.size() - 1 and a '\0' for strings)
+  // and return the full length, so truncation shows as a larger result
+  uint8_t getBytes(std::span<uint8_t> bytes) const;
+  uint8_t getString(std::span<char> str) const;
+#endif
   const SubEntries getStruct() const;
   const Packet getPacket() const;
 
+  const uint8_t* encode() const;
+
   void remove();
 
   bool setNull();
@@ -94,18 +171,31 @@ public:
     std::memcpy(bytes, &value, size);
     return setInt(bytes, size, is_negative);
   }
+  // Always encodes in width bytes, so rewriting the value never resizes
+  template<typename T> bool setInt(T value, uint8_t width) {
+    bool is_negative = value < 0;
+    if (is_negative) value = - value;
+    if (width == 0 || width > 8) return false;
+    if (width < sizeof(T) && (value >> (8 * width)) != 0) return false;
+    uint8_t bytes[8] = {};
+    std::memcpy(bytes, &value, width < sizeof(T) ? width : sizeof(T));
+    return setInt(bytes, width, is_negative, true);
+  }
   inline bool setBool(bool value) { return setInt(value); }
   template <typename T> inline bool setEnum(T value) {
     return setInt(static_cast<int>(value));
   }
-  bool setFloat16(float value);
-  bool setFloat32(float value);
-  bool setFloat64(double value);
+  bool setFloat16(float value, bool fixed = false);
+  bool setFloat32(float value, bool fixed = false);
+  bool setFloat64(double value, bool fixed = false);
   bool setBytes(const uint8_t *bytes, uint8_t length);
   bool setString(const char *str);
   SubEntries setStruct();
+  SubEntries editStruct();
   bool setPacket(const Packet& packet);
 
+  bool copy(const Entry& from);
+
 private: 
   Entries &entries_;
   uint8_t ptr_;
@@ -118,6 +208,7 @@ private:
 
   void setType(uint8_t type);
   uint8_t getType() const;
+  const uint8_t* getBytesBuf(uint8_t& len) const;
   bool setSize(uint8_t size_new);
 
   inline void setPayload(const uint8_t *payload, uint8_t size,
@@ -135,7 +226,7 @@ private:
   const uint8_t* getPayloadBuf() const;
   uint8_t* getPayloadBuf();
 
-  bool setInt(const uint8_t *bytes, uint8_t size, bool is_negative);
+  bool setInt(const uint8_t *bytes, uint8_t size, bool is_negative, bool fixed = false);
 
   int64_t getSignedInt() const;
   uint64_t getUnsignedInt() const;
@@ -154,7 +245,9 @@ public:
   inline bool operator!=(const EntriesIterator &i) const { return ptr_ != i.ptr_; }
 
   EntriesIterator &find(const char name[2]);
+  EntriesIterator &find(EntryName name);
   Entry insert(const char name[2]);
+  Entry insert(EntryName name);
   EntriesIterator remove() { (**this).remove(); return *this; }
 
 private:
@@ -174,6 +267,7 @@ public:
   bool operator!=(const EntriesConstIterator &i) const { return ptr_ != i.ptr_; }
 
   EntriesConstIterator &find(const char name[2]);
+  EntriesConstIterator &find(EntryName name);
 
 private:
   const Entries &entries_;
@@ -204,14 +298,24 @@ public:
 
   iterator find(const char name[2]);
   const_iterator find(const char name[2]) const;
+  iterator find(EntryName name);
+  const_iterator find(EntryName name) const;
 
   inline const uint8_t* getBuf() const { return buf_; }
   inline uint8_t* getBuf() { return buf_; }
 
   Entry append(const char name[2]);
+  Entry append(EntryName name);
 
   void clear();
 
+#ifndef ARDUINO
+  // Calls handler(entry, value) once per entry with the value decoded as
+  // uint64_t, int64_t, float16, float, double, std::span<const uint8_t>,
+  // const SubEntries&, const Packet& or nullptr for null.
+  template <typename Handler> void visit(Handler&& handler) const;
+#endif
+
 protected:
   uint8_t* buf_;
   uint8_t buf_size_;
@@ -222,8 +326,11 @@ protected:
 private:
   virtual uint8_t offset() const = 0;
   virtual bool resize(uint8_t ptr, uint8_t size_from_ptr, uint8_t size_from_ptr_old) = 0;
+  virtual void adjustSize(int diff) = 0;
+  virtual uint8_t data_end() const = 0;
 
   friend SubEntries;
+  friend StructEdit;
   friend Entry;
   friend iterator;
   friend const_iterator;
@@ -244,6 +351,10 @@ public:
     Packet p = Packet(const_cast<uint8_t*>(buf), ref_change); 
     return p;
   }
+  // decode() trusts the size byte and every length in the packet. Check
+  // bytes from outside with this first: the size must fit in length, and
+  // each entry, struct and nested packet must fit exactly in its parent.
+  static bool validate(const uint8_t* buf, size_t length);
 
   inline Packet(const Packet& packet): Packet(packet.buf_, packet.buf_size_, packet.ref_change_) {
     if (!isNull() && ref_change_ != nullptr) (*ref_change_)(*this, +1);
@@ -259,6 +370,17 @@ public:
   Packet &telemetry(uint8_t packet_id, uint8_t component_id = component_id_self);
   Packet &telemetry(uint8_t packet_id, uint8_t component_id,
                     uint8_t origin_unit_id, uint8_t dest_unit_id, uint16_t squence = 0);
+  // Stamp the next sequence number of the stream (see sequence.h)
+  Packet &command(uint8_t packet_id, uint8_t component_id,
+                  uint8_t origin_unit_id, uint8_t dest_unit_id, SequenceTable& sequences);
+  Packet &telemetry(uint8_t packet_id, uint8_t component_id,
+                    uint8_t origin_unit_id, uint8_t dest_unit_id, SequenceTable& sequences);
+  inline bool setSequence(uint16_t sequence) {
+    if (isNull() || isLocal()) return false;
+    buf_[5] = sequence & 0xFF;
+    buf_[6] = sequence >> 8;
+    return true;
+  }
 
   // Get info
 
@@ -280,10 +402,16 @@ public:
   inline uint8_t component_id()   const { return buf_[2]; }
   inline uint8_t origin_unit_id() const { return isRemote() ? buf_[3] : unit_id_local; }
   inline uint8_t dest_unit_id()   const { return isRemote() ? buf_[4] : unit_id_local; }
-  inline uint16_t sequence()      const { return isRemote() ? *(uint16_t*)(buf_ + 5) : 0; }
+  inline uint16_t sequence()      const { return isRemote() ? buf_[5] | buf_[6] << 8 : 0; }
+
+  // (origin unit, component, type and packet ID) packed as one key
+  inline uint32_t key() const {
+    return ((uint32_t)origin_unit_id() << 16) | ((uint32_t)component_id() << 8) | type_and_id();
+  }
 
   inline uint8_t checksum() const { return checksum(buf_, size()); };
   inline static uint8_t checksum(const uint8_t* buf, uint8_t size) {
+    WCPP_COUNT(checksum_bytes, size);
     return CRC8::CRC8::calc(buf, size);
   }
 
@@ -292,11 +420,13 @@ public:
 
   inline const uint8_t* encode() const { return buf_; }
 
+  bool copyHeader(const Packet& from);
   bool copyPayload(const Packet& from);
   bool copy(const Packet& from);
 
-  void clear();
-  inline ~Packet() { clear(); }
+  inline void clear() { if (!isNull()) buf_[0] = header_size(); }
+  void release();
+  inline ~Packet() { release(); }
 
 private:
   ref_change_t ref_change_;
@@ -309,6 +439,8 @@ private:
 
 
   bool resize(uint8_t ptr, uint8_t size_from_ptr, uint8_t size_from_ptr_old) override;
+  inline void adjustSize(int diff) override { buf_[0] += diff; }
+  inline uint8_t data_end() const override { return buf_[0]; }
 
   friend Entry;
 };
@@ -329,9 +461,64 @@ private:
     : Entries(buf, buf_size), parent_(parent), ptr_(ptr) {}
 
   bool resize(uint8_t ptr, uint8_t size_from_ptr, uint8_t size_from_ptr_old) override;
+  void adjustSize(int diff) override;
+  inline uint8_t data_end() const override { return parent_.data_end(); }
 
   friend Entry;
+  friend StructEdit;
 };
 
 
+// Batches edits inside a struct. Opening moves everything after the struct
+// to the end of the buffer, so edits inside only move bytes within the struct
+// and update its own size. commit() moves the tail back once and fixes the
+// sizes of the enclosing structs and packet in one pass. The enclosing
+// entries must not be read or edited until then.
+class StructEdit : public Entries {
+public:
+  StructEdit(SubEntries& target);
+  inline ~StructEdit() { commit(); }
+
+  StructEdit(const StructEdit&) = delete;
+  StructEdit& operator=(const StructEdit&) = delete;
+
+  inline uint8_t size() const override { return buf_[ptr_]; }
+  inline uint8_t header_size() const override { return 1; }
+
+  void commit();
+
+private:
+  Entries &parent_;
+  uint8_t ptr_;
+  uint8_t size_old_;
+  uint8_t tail_;
+  bool open_;
+
+  inline uint8_t offset() const override { return ptr_; }
+  bool resize(uint8_t ptr, uint8_t size_from_ptr, uint8_t size_from_ptr_old) override;
+  inline void adjustSize(int diff) override { buf_[ptr_] += diff; }
+  inline uint8_t data_end() const override { return ptr_ + size(); }
+};
+
+
+#ifndef ARDUINO
+template <typename Handler> void Entries::visit(Handler&& handler) const {
+  for (auto i = begin(); i != end(); ++i) {
+    const Entry e = *i;
+    switch (e.kind()) {
+    case Entry::Kind::null:         handler(e, nullptr); break;
+    case Entry::Kind::unsigned_int: handler(e, e.getUnsignedInt()); break;
+    case Entry::Kind::signed_int:   handler(e, e.getSignedInt()); break;
+    case Entry::Kind::float16:      handler(e, float16(e.getPayload<uint16_t>(2))); break;
+    case Entry::Kind::float32:      handler(e, e.getFloat32()); break;
+    case Entry::Kind::float64:      handler(e, e.getPayload<double>(8)); break;
+    case Entry::Kind::bytes:        handler(e, e.getBytesView()); break;
+    case Entry::Kind::structure:    handler(e, e.getStruct()); break;
+    case Entry::Kind::packet:       handler(e, e.getPacket()); break;
+    }
+  }
+}
+#endif
+
+
 } // namespace wccp
@@ -0,0 +1,391 @@
+#include "parse.h"
+
+#ifndef ARDUINO
+
+#include <charconv>
+#include <cmath>
+
+namespace wcpp {
+
+namespace {
+
+// Nested packets are built on the stack before being copied in
+constexpr int depth_max = 8;
+
+inline bool isLetter(char c) { return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z'); }
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+// The characters of the first and second character of an entry name
+inline bool isNameFirst(char c) { return c >= 0x40 && c <= 0x5F; }
+inline bool isNameSecond(char c) { return c >= 0x60 && c <= 0x7F; }
+
+inline bool equals(const char* s, size_t n, const char* word) {
+  return std::strlen(word) == n && std::memcmp(s, word, n) == 0;
+}
+
+bool isHeaderKey(const char* k, size_t n) {
+  return equals(k, n, "type") || equals(k, n, "id") || equals(k, n, "comp")
+      || equals(k, n, "from") || equals(k, n, "to") || equals(k, n, "seq");
+}
+
+// Sets the shortest float encoding of value (see parse.h)
+bool setShortestFloat(Entry& e, double value) {
+  if (value == 0) return e.setFloat16(0);
+
+  float f = (float)value;
+  char buf[32];
+  double back = 0;
+  if (std::isfinite(f)) {
+    char* end = std::to_chars(buf, buf + sizeof(buf), f).ptr;
+    std::from_chars(buf, end, back);
+  }
+  if (back != value) return e.setFloat64(value);
+  if ((float)float16(f) == f) return e.setFloat16(f);
+  return e.setFloat32(f);
+}
+
+class Parser {
+public:
+  Parser(const char* text, size_t length) : begin_(text), p_(text), end_(text + length) {}
+
+  size_t parse(Packet& out, size_t* error_at) {
+    space(true);
+    char close = '\n';
+    if (at('{') || at('[')) close = *p_++ == '{' ? '}' : ']';
+    if (packet(out, close, 0)) return p_ - begin_;
+    if (error_at != nullptr) *error_at = p_ - begin_;
+    return 0;
+  }
+
+private:
+  const char* begin_;
+  const char* p_;
+  const char* end_;
+  bool quoted_ = false;
+
+  inline bool at(char c) const { return p_ < end_ && *p_ == c; }
+
+  // Commas are separators like spaces, so JSON and text read alike
+  void space(bool lines) {
+    while (p_ < end_) {
+      char c = *p_;
+      if (c == ' ' || c == '\t' || c == '\r' || c == ',' || (lines && c == '\n')) p_++;
+      else break;
+    }
+  }
+
+  void blank() {
+    while (at(' ') || at('\t')) p_++;
+  }
+
+  // A bare entry name is any two name characters, as the text form
+  // writes them raw: "@k", "]a" or "\|"
+  bool nameAhead() const {
+    return end_ - p_ > 2 && isNameFirst(p_[0]) && isNameSecond(p_[1]) && (p_[2] == '=' || p_[2] == ':');
+  }
+
+  bool key(const char*& k, size_t& n) {
+    quoted_ = at('"');
+    if (quoted_) {
+      k = ++p_;
+      while (p_ < end_ && *p_ != '"') {
+        if (*p_ == '\\' && p_ + 1 < end_) p_++;
+        p_++;
+      }
+      if (p_ == end_) return false;
+      n = p_++ - k;
+    }
+    else if (nameAhead()) {
+      k = p_;
+      p_ += 2;
+      n = 2;
+    }
+    else {
+      k = p_;
+      while (p_ < end_ && (isLetter(*p_) || *p_ == '_')) p_++;
+      n = p_ - k;
+    }
+    return n > 0;
+  }
+
+  // Ends at close, or at the end of the line or text for bare text
+  bool end(char close) {
+    space(close != '\n');
+    if (p_ == end_) return close == '\n';
+    if (*p_ != close) return false;
+    p_++;
+    return true;
+  }
+
+  bool separator() {
+    blank();
+    if (!at(':') && !at('=')) return false;
+    p_++;
+    blank();
+    return true;
+  }
+
+  bool packet(Packet& out, char close, int depth) {
+    bool telemetry = false;
+    uint64_t id = 0, component = 0, origin = 0, dest = 0, sequence = 0;
+    bool remote_only = false;
+    bool started = false;
+
+    while (true) {
+      space(close != '\n');
+      if (p_ == end_ || (*p_ == close && !nameAhead())) break;
+
+      const char* k;
+      size_t n;
+      if (!key(k, n)) return false;
+
+      // The bare type word of the text form
+      blank();
+      if (!at(':') && !at('=') && (equals(k, n, "cmd") || equals(k, n, "tlm"))) {
+        if (started) return false;
+        telemetry = k[0] == 't';
+        continue;
+      }
+      if (!separator()) return false;
+
+      if (equals(k, n, "t")) {
+        uint64_t time;
+        if (started || !unsignedValue(time, UINT32_MAX)) return false;
+      }
+      else if (isHeaderKey(k, n)) {
+        if (started) return false;
+        if (equals(k, n, "type")) {
+          if (!typeValue(telemetry)) return false;
+        }
+        else if (equals(k, n, "id")) {
+          if (!idValue(id)) return false;
+        }
+        else if (equals(k, n, "comp")) {
+          if (!unsignedValue(component, 0xFF)) return false;
+        }
+        else if (equals(k, n, "from")) {
+          if (!unsignedValue(origin, 0xFF)) return false;
+        }
+        else {
+          if (!unsignedValue(k[0] == 't' ? dest : sequence, k[0] == 't' ? 0xFF : 0xFFFF)) return false;
+          remote_only = true;
+        }
+      }
+      else {
+        if (!started && !header(out, telemetry, id, component, origin, dest, sequence, remote_only)) return false;
+        started = true;
+        if (!entry(out, k, n, depth)) return false;
+      }
+    }
+
+    if (!started && !header(out, telemetry, id, component, origin, dest, sequence, remote_only)) return false;
+    return end(close);
+  }
+
+  bool header(Packet& out, bool telemetry, uint64_t id, uint64_t component,
+              uint64_t origin, uint64_t dest, uint64_t sequence, bool remote_only) {
+    if (origin == unit_id_local) {
+      // "to" and "seq" would be lost on a local packet
+      if (remote_only) return false;
+      if (telemetry) out.telemetry(id, component);
+      else           out.command(id, component);
+    }
+    else {
+      if (telemetry) out.telemetry(id, component, origin, dest, sequence);
+      else           out.command(id, component, origin, dest, sequence);
+    }
+    return out.size() == out.header_size();
+  }
+
+  bool members(Entries& entries, char close, int depth) {
+    while (true) {
+      space(true);
+      if (p_ == end_) return false;
+      if (*p_ == close && !nameAhead()) {
+        p_++;
+        return true;
+      }
+      const char* k;
+      size_t n;
+      if (!key(k, n) || !separator() || !entry(entries, k, n, depth)) return false;
+    }
+  }
+
+  bool entry(Entries& entries, const char* k, size_t n, int depth) {
+    // Either case of a letter names the same entry. JSON keys escape only a backslash
+    char name[2];
+    size_t i = 0;
+    for (size_t j = 0; j < n; j++) {
+      char c = k[j];
+      bool escaped = quoted_ && c == '\\';
+      if (escaped && j + 1 < n) c = k[++j];
+      if (i == 2 || !(isNameFirst(c) || isNameSecond(c)) || (escaped && c != '\\')) {
+        p_ = k;
+        return false;
+      }
+      name[i++] = c;
+    }
+    if (i != 2) {
+      p_ = k;
+      return false;
+    }
+    uint8_t size = entries.size();
+    Entry e = entries.append(name);
+    if (entries.size() != size + entry_type_size) return false;
+    return value(e, depth);
+  }
+
+  bool value(Entry& e, int depth) {
+    if (p_ == end_) return false;
+    char c = *p_;
+    if (c == '"') return string(e);
+    if (c == '-' || isDigit(c)) return number(e);
+    if (c == '{' || c == '[') {
+      if (depth + 1 >= depth_max) return false;
+      p_++;
+      if (c == '[' || packetAhead()) {
+        uint8_t buf[size_max];
+        Packet inner = Packet::empty(buf, size_max);
+        return packet(inner, c == '{' ? '}' : ']', depth + 1) && e.setPacket(inner);
+      }
+      SubEntries entries = e.setStruct();
+      return e.isStruct() && members(entries, '}', depth + 1);
+    }
+
+    const char* k;
+    size_t n;
+    if (!key(k, n)) return false;
+    if (equals(k, n, "null"))  return e.setNull();
+    if (equals(k, n, "true"))  return e.setInt(1);
+    if (equals(k, n, "false")) return e.setInt(0);
+    return false;
+  }
+
+  // A JSON object is a nested packet when it starts with a header key
+  bool packetAhead() {
+    const char* p = p_;
+    space(true);
+    const char* k;
+    size_t n;
+    bool header = key(k, n) && isHeaderKey(k, n);
+    p_ = p;
+    return header;
+  }
+
+  bool number(Entry& e) {
+    const char* s = p_;
+    bool fraction = false;
+    while (p_ < end_) {
+      char c = *p_;
+      if (c == '.' || c == 'e' || c == 'E') fraction = true;
+      else if (!isDigit(c) && c != '-' && c != '+') break;
+      p_++;
+    }
+
+    if (fraction) {
+      double value;
+      auto r = std::from_chars(s, p_, value);
+      if (r.ptr != p_ || r.ec != std::errc()) return false;
+      return setShortestFloat(e, value);
+    }
+
+    bool negative = *s == '-';
+    uint64_t magnitude;
+    auto r = std::from_chars(s + negative, p_, magnitude);
+    if (r.ptr != p_ || r.ec != std::errc()) return false;
+    if (!negative) return e.setInt(magnitude);
+    if (magnitude > INT64_MAX) return false;
+    return e.setInt(-(int64_t)magnitude);
+  }
+
+  bool unsignedValue(uint64_t& value, uint64_t max) {
+    const char* s = p_;
+    while (p_ < end_ && isDigit(*p_)) p_++;
+    auto r = std::from_chars(s, p_, value);
+    return r.ptr == p_ && r.ec == std::errc() && value <= max;
+  }
+
+  bool idValue(uint64_t& id) {
+    if (!at('"')) return unsignedValue(id, packet_id_mask);
+    if (p_ + 3 > end_ || p_[2] != '"') return false;
+    id = (uint8_t)p_[1];
+    p_ += 3;
+    return id <= packet_id_mask;
+  }
+
+  bool typeValue(bool& telemetry) {
+    const char* k;
+    size_t n;
+    if (!key(k, n)) return false;
+    telemetry = equals(k, n, "tlm");
+    return telemetry || equals(k, n, "cmd");
+  }
+
+  bool hex(int digits, uint32_t& value) {
+    if (end_ - p_ < digits) return false;
+    auto r = std::from_chars(p_, p_ + digits, value, 16);
+    if (r.ptr != p_ + digits) return false;
+    p_ += digits;
+    return true;
+  }
+
+  // \u00XX and \xXX are raw bytes, as the formatter writes them. Higher
+  // \u code points are UTF-8 encoded.
+  bool string(Entry& e) {
+    uint8_t buf[size_max];
+    size_t n = 0;
+    p_++;
+    while (true) {
+      if (p_ == end_) return false;
+      char c = *p_++;
+      if (c == '"') break;
+
+      uint32_t code = (uint8_t)c;
+      if (c == '\\') {
+        if (p_ == end_) return false;
+        switch (*p_++) {
+        case '"':  code = '"'; break;
+        case '\\': code = '\\'; break;
+        case '/':  code = '/'; break;
+        case 'b':  code = '\b'; break;
+        case 'f':  code = '\f'; break;
+        case 'n':  code = '\n'; break;
+        case 'r':  code = '\r'; break;
+        case 't':  code = '\t'; break;
+        case 'x':  if (!hex(2, code)) return false; break;
+        case 'u':  if (!hex(4, code)) return false; break;
+        default:   return false;
+        }
+      }
+
+      if (code <= 0xFF) {
+        if (n + 1 > size_max) return false;
+        buf[n++] = code;
+      }
+      else if (code <= 0x7FF) {
+        if (n + 2 > size_max) return false;
+        buf[n++] = 0xC0 | code >> 6;
+        buf[n++] = 0x80 | (code & 0x3F);
+      }
+      else {
+        if (n + 3 > size_max) return false;
+        buf[n++] = 0xE0 | code >> 12;
+        buf[n++] = 0x80 | (code >> 6 & 0x3F);
+        buf[n++] = 0x80 | (code & 0x3F);
+      }
+    }
+    return e.setBytes(buf, n);
+  }
+};
+
+} // namespace
+
+size_t parse(const char* text, size_t length, Packet& out, size_t* error_at) {
+  if (out.isNull()) return 0;
+  Parser parser(text, length);
+  return parser.parse(out, error_at);
+}
+
+} // namespace wcpp
+
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+
+#ifndef ARDUINO
+
+#include "packet.h"
+
+#include <cstddef>
+
+namespace wcpp {
+
+// Builds a packet from the JSON or text form that format.h writes, in one
+// pass straight into the packet buffer:
+//
+//   {"id":5,"comp":2,"Ax":1.5,"Nm":"abc","Gp":{"La":35.5}}
+//   cmd id=5 comp=2 Ax=1.5 Nm="abc" Gp={La=35.5} Pk=[tlm id=3]
+//
+// Header keys ("type", "id", "comp", "from", "to", "seq") are lower case and
+// must come before the entries. The type defaults to "cmd", and a non-zero
+// "from" makes the packet remote. "id" may also be a one character string.
+// A "t" key, as in timed NDJSON lines, is skipped. Entry names may be any
+// two characters a name holds, "@k" or "]a" as well as letters.
+//
+// Values take the shortest encoding, as the spec asks: integers by
+// magnitude, and a number with a fraction or exponent as the smallest float
+// type that holds it. A float16 must hold it exactly, a float32 must read
+// back as the same decimal. true and false are 1 and 0, strings are bytes.
+// In JSON a nested object starting with a header key is a packet; otherwise
+// it is a struct.
+//
+// Returns the number of characters read, up to the closing brace or the end
+// of the line, or 0 on error, with the offset of the problem in error_at.
+size_t parse(const char* text, size_t length, Packet& out, size_t* error_at = nullptr);
+
+} // namespace wcpp
+
+#endif
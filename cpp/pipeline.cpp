@@ -0,0 +1,256 @@
+#include "pipeline.h"
+
+#ifndef ARDUINO
+
+namespace wcpp {
+
+DedupTable::DedupTable(DedupSlot* slots, uint16_t size, uint32_t restart_gap)
+  : slots_(slots), size_(size), restart_gap_(restart_gap), duplicates_(0), overflowed_(0) {
+  for (uint16_t i = 0; i < size_; i++) slots_[i].key = 0;
+}
+
+void DedupTable::restart(DedupSlot& s, uint16_t sequence, uint32_t now) {
+  for (unsigned w = 0; w < dedup_history / 64; w++) s.seen[w] = 0;
+  word(s, sequence) |= bit(sequence);
+  s.newest = sequence;
+  s.time = now;
+}
+
+bool DedupTable::check(const Packet& packet, uint32_t now) {
+  if (!packet.isRemote()) return true;
+
+  uint32_t key = key_used | packet.key();
+  uint32_t i = probe(key, size_, size_, [&](uint32_t j) {
+    return slots_[j].key == key || slots_[j].key == 0;
+  });
+  if (i == size_) {
+    overflowed_++;
+    return true;
+  }
+
+  DedupSlot& s = slots_[i];
+  uint16_t sequence = packet.sequence();
+  int16_t ahead = sequence - s.newest;
+  // Times from several links may come slightly out of order
+  bool quiet = (int32_t)(now - s.time) >= (int32_t)restart_gap_;
+  if (s.key == 0 || -ahead >= dedup_history || (ahead <= 0 && quiet)) {
+    s.key = key;
+    restart(s, sequence, now);
+    return true;
+  }
+  if (ahead > 0) {
+    // The numbers the window moves past are free again
+    if (ahead >= dedup_history) {
+      restart(s, sequence, now);
+      return true;
+    }
+    for (uint16_t n = s.newest + 1; n != sequence; n++) word(s, n) &= ~bit(n);
+    s.newest = sequence;
+  }
+  else if (word(s, sequence) & bit(sequence)) {
+    duplicates_++;
+    return false;
+  }
+  word(s, sequence) |= bit(sequence);
+  if ((int32_t)(now - s.time) > 0) s.time = now;
+  return true;
+}
+
+
+Pipeline::Pipeline(PacketPool& pool, uint32_t queue_capacity)
+  : pool_(pool), queue_capacity_(queue_capacity), links_count_(0), bus_(nullptr), log_(nullptr),
+    cache_(nullptr), tracer_(nullptr), running_(false), stopping_(false), validated_(false) {}
+
+Pipeline::~Pipeline() {
+  stop();
+}
+
+bool Pipeline::addLink(LinkRead read) {
+  if (running_ || links_count_ >= links_max) return false;
+  PipelineLink& link = links_[links_count_++];
+  link.read = std::move(read);
+  link.deframer.reset();
+  link.queue.reset(new PacketQueue(queue_capacity_));
+  return true;
+}
+
+bool Pipeline::start() {
+  if (running_ || links_count_ == 0) return false;
+  running_ = true;
+  stopping_.store(false, std::memory_order_relaxed);
+  validated_.store(false, std::memory_order_relaxed);
+  // Before any thread starts, or validate could see no link open and end
+  for (unsigned i = 0; i < links_count_; i++) links_[i].open.store(true, std::memory_order_relaxed);
+
+  if (bus_ != nullptr)   sinks_[(unsigned)PipelineStage::route].reset(new PacketQueue(queue_capacity_));
+  if (log_ != nullptr)   sinks_[(unsigned)PipelineStage::log].reset(new PacketQueue(queue_capacity_));
+  if (cache_ != nullptr) sinks_[(unsigned)PipelineStage::cache].reset(new PacketQueue(queue_capacity_));
+  for (unsigned s = 1; s < pipeline_stages; s++) {
+    if (sinks_[s]) threads_[s] = std::thread(&Pipeline::runSink, this, (PipelineStage)s);
+  }
+  threads_[(unsigned)PipelineStage::validate] = std::thread(&Pipeline::runValidate, this);
+
+  for (unsigned i = 0; i < links_count_; i++) {
+    links_[i].thread = std::thread(&Pipeline::runLink, this, std::ref(links_[i]));
+  }
+  return true;
+}
+
+void Pipeline::join() {
+  if (!running_) return;
+  // Each stage ends once the stages before it have and its queue is empty
+  for (unsigned i = 0; i < links_count_; i++) links_[i].thread.join();
+  for (unsigned s = 0; s < pipeline_stages; s++) {
+    if (threads_[s].joinable()) threads_[s].join();
+  }
+  for (unsigned s = 1; s < pipeline_stages; s++) sinks_[s].reset();
+  running_ = false;
+}
+
+void Pipeline::stop() {
+  stopping_.store(true, std::memory_order_relaxed);
+  join();
+}
+
+uint32_t Pipeline::frames() const {
+  uint32_t n = 0;
+  for (unsigned i = 0; i < links_count_; i++) n += links_[i].deframer.frames();
+  return n;
+}
+
+uint32_t Pipeline::errors() const {
+  uint32_t n = 0;
+  for (unsigned i = 0; i < links_count_; i++) n += links_[i].deframer.errors();
+  return n;
+}
+
+// Gives up once stopping, so a stage that stopped taking packets cannot
+// hold up stop(). The caller's reference goes with the packet either way.
+bool Pipeline::pushWaiting(PacketQueue& queue, const uint8_t* buf) {
+  while (!queue.push(buf)) {
+    if (stopping_.load(std::memory_order_relaxed)) {
+      PacketPool::release(buf);
+      return false;
+    }
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+void Pipeline::runLink(PipelineLink& link) {
+  uint8_t rx[4096];
+  while (!stopping_.load(std::memory_order_relaxed)) {
+    long n = link.read(rx, sizeof(rx));
+    if (n < 0) break;
+    if (n == 0) {
+      std::this_thread::yield();
+      continue;
+    }
+    uint64_t arrived = traceTicks();
+    for (long i = 0; i < n; i++) {
+      if (!link.deframer.put(rx[i])) continue;
+      do ingest(link, arrived); while (link.deframer.next());
+    }
+  }
+  link.open.store(false, std::memory_order_release);
+}
+
+void Pipeline::ingest(PipelineLink& link, uint64_t arrived) {
+  const Packet received = link.deframer.packet();
+  Packet p = pool_.copy(received);
+  while (p.isNull()) {
+    // Nothing may ever return a buffer, as with a subscriber that stopped reading
+    if (stopping_.load(std::memory_order_relaxed)) return;
+    std::this_thread::yield();
+    p = pool_.copy(received);
+  }
+  const uint8_t* buf = p.encode();
+  Tracer::arrive(buf, arrived);
+  if (tracer_ != nullptr) tracer_->record(p, TraceStage::deframe);
+  // The queue takes a reference of its own, p drops the first one
+  PacketPool::retain(buf);
+  pushWaiting(*link.queue, buf);
+}
+
+void Pipeline::runValidate() {
+  unsigned idle = 0;
+  while (true) {
+    bool open = false;
+    bool got = false;
+    for (unsigned i = 0; i < links_count_; i++) {
+      PipelineLink& link = links_[i];
+      // Read open before the queue, so no packet pushed before it closed is missed
+      if (link.open.load(std::memory_order_acquire)) open = true;
+      const uint8_t* buf;
+      // A batch per link keeps one busy link from starving the others
+      for (unsigned n = 0; n < 64 && link.queue->pop(buf); n++) {
+        got = true;
+        Packet p = PacketPool::adopt(buf);
+        record(PipelineStage::validate, buf);
+        uint64_t arrived = PacketPool::stamps(buf)[0].load(std::memory_order_relaxed);
+        if (!dedup_.check(p, traceNanos(arrived) / 1000000)) continue;
+        if (tracer_ != nullptr) tracer_->record(p, TraceStage::validate);
+        for (unsigned s = 1; s < pipeline_stages; s++) {
+          if (!sinks_[s]) continue;
+          PacketPool::retain(buf);
+          pushWaiting(*sinks_[s], buf);
+        }
+      }
+    }
+    if (got) {
+      idle = 0;
+      continue;
+    }
+    if (!open) break;
+    if (++idle > 16) std::this_thread::yield();
+  }
+  validated_.store(true, std::memory_order_release);
+}
+
+void Pipeline::runSink(PipelineStage stage) {
+  PacketQueue& queue = *sinks_[(unsigned)stage];
+  unsigned idle = 0;
+  while (true) {
+    bool done = validated_.load(std::memory_order_acquire);
+    const uint8_t* buf;
+    if (queue.pop(buf)) {
+      idle = 0;
+      Packet p = PacketPool::adopt(buf);
+      handle(stage, p);
+      record(stage, buf);
+      continue;
+    }
+    if (done) break;
+    if (++idle > 16) std::this_thread::yield();
+  }
+  if (stage == PipelineStage::log) fflush(log_);
+}
+
+void Pipeline::record(PipelineStage stage, const uint8_t* buf) {
+  uint64_t arrived = PacketPool::stamps(buf)[0].load(std::memory_order_relaxed);
+  latency_[(unsigned)stage].record(traceNanos(traceTicks() - arrived));
+}
+
+void Pipeline::handle(PipelineStage stage, const Packet& packet) {
+  switch (stage) {
+  case PipelineStage::route:
+    // Before publishing, as subscribers read the stamp
+    if (tracer_ != nullptr) tracer_->record(packet, TraceStage::route);
+    bus_->publish(packet);
+    break;
+  case PipelineStage::log: {
+    uint8_t f[size_max + frame_overhead];
+    fwrite(f, 1, frame(packet, f), log_);
+    break;
+  }
+  case PipelineStage::cache:
+    cache_->update(packet, monotonicNanos() / 1000000);
+    break;
+  case PipelineStage::validate:
+    break;
+  }
+}
+
+} // namespace wcpp
+
+#endif
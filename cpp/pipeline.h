@@ -0,0 +1,171 @@
+#pragma once
+
+#ifndef ARDUINO
+
+#include "bus.h"
+#include "deframer.h"
+#include "fixed.h"
+#include "histogram.h"
+#include "telemetry_cache.h"
+#include "trace.h"
+
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <thread>
+
+namespace wcpp {
+
+// Multi-threaded ingest of framed links:
+//
+//   link threads  one per link, deframe into the pool and stamp the arrival
+//   validate      drops repeats of remote packets, from one link or several
+//   router        publishes to a Bus
+//   logger        appends the frames (deframer.h) to a file
+//   cache         updates a TelemetryCache
+//
+// Stages pass pooled buffers by reference through PacketQueues, so a packet
+// is copied once, out of its link's deframer. Each stage records the time
+// from when the last bytes of the frame were read to when it handled the
+// packet. A Tracer, if given, also gets the deframe, validate and route
+// stages. A full queue makes the stage before it wait, and a link thread
+// also waits for the pool, so bursts back up into the link reader. The
+// cache gets steady_clock milliseconds (monotonicNanos() / 1000000).
+
+// Reads up to size bytes of a link into buf. Returns the count, 0 when
+// nothing is available yet, or -1 at the end of the link.
+using LinkRead = std::function<long(uint8_t* buf, size_t size)>;
+
+enum class PipelineStage : uint8_t { validate, route, log, cache };
+constexpr unsigned pipeline_stages = 4;
+
+// Recent sequence numbers of each remote stream (origin unit, component,
+// packet type and ID): the newest one and which of the dedup_history before
+// it arrived. Only a number recorded there is a repeat. A restarted sender
+// counts from 0 again, so a number at or behind the newest is taken as a
+// restart when the stream was quiet for restart_gap before it, as is one
+// further behind than the history. A restart quicker than that goes
+// unnoticed until the sender's numbers pass the newest.
+constexpr uint16_t dedup_history = 1024;
+
+struct DedupSlot {
+  uint32_t key;
+  uint16_t newest;
+  uint32_t time; // of the last packet let through
+  uint64_t seen[dedup_history / 64]; // by sequence number modulo dedup_history
+};
+
+class DedupTable {
+public:
+  // restart_gap is in the unit of the times given to check()
+  DedupTable(DedupSlot* slots, uint16_t size, uint32_t restart_gap = 1000);
+
+  // True the first time a remote packet is seen. Local packets have no
+  // sequence number and are always new, as is everything once the table
+  // is full.
+  bool check(const Packet& packet, uint32_t now);
+
+  inline uint32_t duplicates() const { return duplicates_; }
+  inline uint32_t overflowed() const { return overflowed_; }
+
+private:
+  DedupSlot* slots_;
+  uint16_t size_;
+  uint32_t restart_gap_;
+  uint32_t duplicates_;
+  uint32_t overflowed_;
+
+  static constexpr uint32_t key_used = 0x80000000;
+
+  static inline uint64_t& word(DedupSlot& s, uint16_t sequence) {
+    return s.seen[sequence / 64 % (dedup_history / 64)];
+  }
+  static inline uint64_t bit(uint16_t sequence) { return (uint64_t)1 << sequence % 64; }
+  void restart(DedupSlot& s, uint16_t sequence, uint32_t now);
+};
+
+template <uint16_t N = 256>
+class StaticDedupTable : private FixedArray<DedupSlot, N>, public DedupTable {
+public:
+  StaticDedupTable(uint32_t restart_gap = 1000)
+    : DedupTable(FixedArray<DedupSlot, N>::items_, N, restart_gap) {}
+};
+
+
+struct PipelineLink {
+  LinkRead read;
+  Deframer deframer;
+  std::unique_ptr<PacketQueue> queue;
+  std::thread thread;
+  std::atomic<bool> open;
+};
+
+class Pipeline {
+public:
+  static constexpr unsigned links_max = 8;
+
+  Pipeline(PacketPool& pool, uint32_t queue_capacity = 4096);
+  ~Pipeline();
+
+  Pipeline(const Pipeline&) = delete;
+  Pipeline& operator=(const Pipeline&) = delete;
+
+  // Links and sinks are set up before start(); sinks left unset do not run
+  bool addLink(LinkRead read);
+  inline void routeTo(Bus& bus) { bus_ = &bus; }
+  inline void logTo(FILE* file) { log_ = file; }
+  inline void cacheTo(TelemetryCache& cache) { cache_ = &cache; }
+  inline void traceTo(Tracer& tracer) { tracer_ = &tracer; }
+
+  bool start();
+  // Waits for every link to end and every packet to go through
+  void join();
+  // Stops reading the links, then drains like join(). Packets waiting for
+  // a pool buffer or for room in a queue are dropped.
+  void stop();
+
+  inline bool running() const { return running_; }
+
+  // Deframer counts are read after join()
+  uint32_t frames() const;
+  uint32_t errors() const;
+  inline uint32_t duplicates() const { return dedup_.duplicates(); }
+  inline uint64_t handled(PipelineStage stage) const {
+    return latency_[(unsigned)stage].count();
+  }
+  inline const LatencyHistogram& latency(PipelineStage stage) const {
+    return latency_[(unsigned)stage];
+  }
+
+private:
+  PacketPool& pool_;
+  uint32_t queue_capacity_;
+  PipelineLink links_[links_max];
+  unsigned links_count_;
+  Bus* bus_;
+  FILE* log_;
+  TelemetryCache* cache_;
+  Tracer* tracer_;
+  bool running_;
+
+  StaticDedupTable<1024> dedup_;
+  std::unique_ptr<PacketQueue> sinks_[pipeline_stages];
+  std::thread threads_[pipeline_stages];
+  std::atomic<bool> stopping_;
+  std::atomic<bool> validated_;
+  LatencyHistogram latency_[pipeline_stages];
+
+  void runLink(PipelineLink& link);
+  void runValidate();
+  void runSink(PipelineStage stage);
+
+  void ingest(PipelineLink& link, uint64_t arrived);
+  void record(PipelineStage stage, const uint8_t* buf);
+  void handle(PipelineStage stage, const Packet& packet);
+  bool pushWaiting(PacketQueue& queue, const uint8_t* buf);
+};
+
+} // namespace wcpp
+
+#endif
@@ -0,0 +1,68 @@
+#include "pool.h"
+
+#include <cstring>
+
+namespace wcpp {
+
+PacketPool::PacketPool(PoolBlock* blocks, uint32_t count)
+  : blocks_(blocks), count_(count), head_(none), available_(count) {
+  for (uint32_t i = 0; i < count_; i++) {
+    blocks_[i].refs.store(0, std::memory_order_relaxed);
+    blocks_[i].next.store(i + 1 < count_ ? i + 1 : none, std::memory_order_relaxed);
+    blocks_[i].pool = this;
+  }
+  head_.store(count_ > 0 ? 0 : none, std::memory_order_release);
+}
+
+Packet PacketPool::allocate() {
+  uint64_t head = head_.load(std::memory_order_acquire);
+  while (true) {
+    uint32_t i = head & 0xFFFFFFFF;
+    if (i == none) return Packet::null();
+
+    // The tag in the upper half changes on every pop, so a block that was
+    // popped and pushed back in between does not fool the exchange
+    uint64_t next = ((head >> 32) + 1) << 32 | blocks_[i].next.load(std::memory_order_relaxed);
+    if (head_.compare_exchange_weak(head, next, std::memory_order_acquire)) {
+      available_.fetch_sub(1, std::memory_order_relaxed);
+      blocks_[i].refs.store(1, std::memory_order_relaxed);
+      blocks_[i].stamps[0].store(0, std::memory_order_relaxed);
+      return Packet::empty(blocks_[i].buf, size_max, &PacketPool::refChange);
+    }
+  }
+}
+
+Packet PacketPool::copy(const Packet& packet) {
+  Packet p = allocate();
+  if (p.isNull() || packet.isNull()) return p;
+  std::memcpy(p.getBuf(), packet.encode(), packet.size());
+  return p;
+}
+
+void PacketPool::free(PoolBlock* block) {
+  uint32_t i = block - blocks_;
+  uint64_t head = head_.load(std::memory_order_relaxed);
+  while (true) {
+    block->next.store(head & 0xFFFFFFFF, std::memory_order_relaxed);
+    uint64_t next = (head & 0xFFFFFFFF00000000) | i;
+    if (head_.compare_exchange_weak(head, next, std::memory_order_release)) break;
+  }
+  available_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PacketPool::retain(const uint8_t* buf) {
+  block(buf)->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PacketPool::release(const uint8_t* buf) {
+  PoolBlock* b = block(buf);
+  if (b->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) b->pool->free(b);
+}
+
+void PacketPool::refChange(const Packet& packet, int change) {
+  if (packet.isNull()) return;
+  if (change > 0) retain(packet.encode());
+  else            release(packet.encode());
+}
+
+} // namespace wcpp
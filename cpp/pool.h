@@ -0,0 +1,78 @@
+#pragma once
+
+#include "fixed.h"
+#include "packet.h"
+
+#include <atomic>
+#include <cstddef>
+
+namespace wcpp {
+
+// Fixed pool of refcounted packet buffers.
+//
+// Packets from allocate() carry PacketPool::refChange as their ref_change_t,
+// so copies of the Packet share the buffer, and the buffer returns to the
+// pool when the last copy is gone. The block header sits right before the
+// buffer, so the callback finds it from the buffer address alone.
+
+class PacketPool;
+
+constexpr unsigned pool_stamps = 4;
+
+struct PoolBlock {
+  std::atomic<int> refs;
+  std::atomic<uint32_t> next;
+  PacketPool* pool;
+  // When the packet arrived, then when it left each stage (trace.h). Set
+  // by whoever fills the buffer; allocate() clears the first. Atomic, as
+  // the threads handing the packet on may stamp it while others read.
+  std::atomic<uint64_t> stamps[pool_stamps];
+  uint8_t buf[size_max];
+};
+
+class PacketPool {
+public:
+  PacketPool(PoolBlock* blocks, uint32_t count);
+
+  Packet allocate();
+  Packet copy(const Packet& packet);
+
+  inline bool owns(const uint8_t* buf) const {
+    return buf >= blocks_[0].buf && buf < blocks_[count_ - 1].buf + size_max;
+  }
+
+  // Raw reference counting for holders that keep a buffer pointer, not a Packet
+  static void retain(const uint8_t* buf);
+  static void release(const uint8_t* buf);
+  static inline Packet adopt(const uint8_t* buf) {
+    return Packet::decode(buf, &PacketPool::refChange);
+  }
+
+  static void refChange(const Packet& packet, int change);
+
+  static inline std::atomic<uint64_t>* stamps(const uint8_t* buf) { return block(buf)->stamps; }
+
+  inline uint32_t count() const { return count_; }
+  inline uint32_t available() const { return available_.load(std::memory_order_relaxed); }
+
+private:
+  PoolBlock* blocks_;
+  uint32_t count_;
+  std::atomic<uint64_t> head_;
+  std::atomic<uint32_t> available_;
+
+  static constexpr uint32_t none = 0xFFFFFFFF;
+
+  static inline PoolBlock* block(const uint8_t* buf) {
+    return reinterpret_cast<PoolBlock*>(const_cast<uint8_t*>(buf) - offsetof(PoolBlock, buf));
+  }
+  void free(PoolBlock* block);
+};
+
+template <uint32_t N>
+class StaticPacketPool : private FixedArray<PoolBlock, N>, public PacketPool {
+public:
+  StaticPacketPool() : PacketPool(FixedArray<PoolBlock, N>::items_, N) {}
+};
+
+} // namespace wcpp
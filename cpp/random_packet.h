@@ -0,0 +1,145 @@
+#pragma once
+
+#ifndef ARDUINO
+
+#include "workload.h"
+
+#include <cstring>
+
+// The random packets of the packet tests. Reading a packet back with an
+// iterator from the same point of the sequence gets the same numbers, so
+// tests and tools can check what was built. Every rand() is its own
+// statement: the order of evaluation of function arguments is unspecified.
+
+inline wcpp::Packet generateRandomPacket(uint8_t* buf, RandomSequence::iterator& rand);
+
+inline bool appendRandomEntry(wcpp::Entries& p, RandomSequence::iterator& rand) {
+  char name[] = {(char)(rand()%32 + 64), (char)(rand()%32 + 96)};
+
+  wcpp::Entry e = p.append(name);
+
+  unsigned type = rand() % 13;
+  // printf("NAME %c%c %d %d %d %d\n", name[0], name[1], p.size_remain(), p.size(), type, bool(e));
+  // if (p.size_remain() <= 0) return false;
+
+  if (!e) return false;
+
+  switch (type) {
+    case 0:
+      return true;
+    case 1:
+      return e.setNull();
+    case 2:
+      return e.setInt(rand()%32);
+    case 3: {
+      long v = (long)(rand()%512) - 256;
+      return e.setInt(v);
+    }
+    case 4:
+      return e.setInt((long)rand() - 0x80000000);
+    case 5: {
+      uint64_t a = rand();
+      uint64_t b = rand();
+      return e.setInt((long)(a * (uint64_t)((long)b-0x80000000)));
+    }
+    case 6: {
+      uint64_t a = rand();
+      uint64_t b = rand();
+      return e.setFloat16((float)a/(float)((long)b-0x80000000));
+    }
+    case 7: {
+      uint64_t a = rand();
+      uint64_t b = rand();
+      return e.setFloat32((float)a/(float)((long)b-0x80000000));
+    }
+    case 8: {
+      uint64_t a = rand();
+      uint64_t b = rand();
+      return e.setFloat64((double)a/(double)((long)b-0x80000000));
+    }
+    case 9: {
+      uint8_t bytes[64];
+      int len = rand() % 64;
+      for (int i = 0; i < len; i++) {
+        bytes[i] = rand();
+      }
+      return e.setBytes(bytes, len);
+    }
+    case 10: {
+      char str[65];
+      int len = rand() % 64;
+      for (int i = 0; i < len; i++) {
+        str[i] = rand()%127 + 1;
+      }
+      str[len] = 0; 
+      return e.setString(str);
+    }
+    case 11: {
+      auto sub = e.setStruct();
+      if (e.size() < 1) return false;
+      auto r = rand;
+      auto s = sub.begin();
+      while (rand() % 8) {
+        if (!appendRandomEntry(sub, rand)) {
+          rand = r.reroll();
+          (*s).remove();
+        }
+        else ++s;
+        r = rand; 
+      }
+      return true;
+    }
+    case 12: {
+      uint8_t sub_buf[255];
+      memset(sub_buf, 0, 255);
+      if (p.size_remain() < 7) return false;
+      wcpp::Packet sp = generateRandomPacket(sub_buf, rand);
+      return e.setPacket(sp); 
+    }
+  }
+  return false;
+}
+
+inline wcpp::Packet generateRandomPacket(uint8_t* buf, RandomSequence::iterator& rand) {
+  wcpp::Packet p = wcpp::Packet::empty(buf, wcpp::size_max);
+  unsigned type = rand()%4;
+  uint8_t id = rand()%128;
+  uint8_t component = rand()%256;
+  switch (type) {
+  case 0:
+    p.command(id, component);
+    break;
+  case 1: {
+    uint8_t origin = rand()%255+1;
+    uint8_t dest = rand()%255+1;
+    uint16_t sequence = rand()%65536;
+    p.command(id, component, origin, dest, sequence);
+    break;
+  }
+  case 2:
+    p.telemetry(id, component);
+    break;
+  case 3: {
+    uint8_t origin = rand()%255+1;
+    uint8_t dest = rand()%255+1;
+    uint16_t sequence = rand()%65536;
+    p.telemetry(id, component, origin, dest, sequence);
+    break;
+  }
+  }
+
+  auto r = rand;
+  auto e = p.begin();
+  while (rand() % 8) {
+    if (!appendRandomEntry(p, rand)) {
+      rand = r.reroll();
+      (*e).remove();
+    }
+    else ++e;
+    r = rand; 
+  }
+
+  return p;
+}
+
+#endif
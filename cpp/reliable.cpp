@@ -0,0 +1,271 @@
+#include "reliable.h"
+
+#include <cstring>
+#ifndef ARDUINO
+#include <random>
+#endif
+
+namespace wcpp {
+
+// Different for each sender of a run, and from run to run where there is
+// a random source
+static uint16_t pickSession() {
+  static uint16_t last = 0;
+  if (last == 0) {
+#ifdef ARDUINO
+    last = micros();
+#else
+    last = std::random_device()();
+#endif
+  }
+  if (++last == 0) last = 1;
+  return last;
+}
+
+ReliableSender::ReliableSender(ReliableSlot* slots, uint8_t slots_size, uint8_t* heads,
+                               uint8_t wheel_size, uint32_t timeout, uint8_t tries_max,
+                               uint32_t tick, uint16_t first_sequence, uint16_t session,
+                               uint8_t ack_packet_id)
+  : slots_(slots), slots_size_(slots_size), heads_(heads), wheel_size_(wheel_size),
+    due_tail_(none), timeout_(timeout), tries_max_(tries_max), tick_(tick > 0 ? tick : 1),
+    current_tick_(0), next_sequence_(first_sequence),
+    session_(session != 0 ? session : pickSession()), ack_packet_id_(ack_packet_id),
+    in_flight_(0), acked_(0),
+    retransmits_(0), failed_(0) {
+  for (uint8_t i = 0; i <= wheel_size_; i++) heads_[i] = none;
+  for (uint8_t i = 0; i < slots_size_; i++) slots_[i].list = none;
+}
+
+bool ReliableSender::send(const Packet& command, uint32_t now) {
+  if (command.isNull() || !command.isCommand() || !command.isRemote()) return false;
+
+  uint16_t sequence = 0;
+  if (oldest(sequence) && (uint16_t)(next_sequence_ - sequence) >= reliable_window) return false;
+
+  uint8_t i = 0;
+  while (i < slots_size_ && slots_[i].list != none) i++;
+  if (i == slots_size_) return false;
+
+  ReliableSlot& s = slots_[i];
+  Packet p = Packet::empty(s.buf, size_max);
+  if (!p.copy(command) || !p.append(reliable_session_name).setInt(session_)) return false;
+
+  advance(now);
+  s.sequence = next_sequence_++;
+  s.buf[5] = s.sequence & 0xFF;
+  s.buf[6] = s.sequence >> 8;
+  s.tries = 0;
+  link(i, due());
+  in_flight_++;
+  return true;
+}
+
+bool ReliableSender::pop(Packet& out, uint32_t now) {
+  advance(now);
+  while (heads_[due()] != none) {
+    uint8_t i = heads_[due()];
+    ReliableSlot& s = slots_[i];
+    unlink(i);
+    if (s.tries >= tries_max_) {
+      release(i);
+      failed_++;
+      continue;
+    }
+
+    if (!out.copy(Packet::decode(s.buf))) {
+      // Keep it for a larger buffer
+      link(i, due());
+      return false;
+    }
+    if (s.tries > 0) retransmits_++;
+    s.tries++;
+
+    // Twice the wait after each try, up to eight times the timeout
+    uint8_t shift = s.tries - 1 < 3 ? s.tries - 1 : 3;
+    uint32_t deadline = (now + (timeout_ << shift) + tick_ - 1) / tick_;
+    if ((int32_t)(deadline - current_tick_) <= 0) deadline = current_tick_ + 1;
+    s.deadline = deadline;
+    link(i, deadline & (wheel_size_ - 1));
+    return true;
+  }
+  return false;
+}
+
+bool ReliableSender::ready(uint32_t now) {
+  advance(now);
+  return heads_[due()] != none;
+}
+
+bool ReliableSender::handle(const Packet& ack) {
+  if (ack.isNull() || !ack.isTelemetry() || !ack.isRemote()) return false;
+  if (ack.packet_id() != ack_packet_id_) return false;
+  auto cumulative = ack.find(reliable_ack_name);
+  if (cumulative == ack.end()) return false;
+  // An ACK for another session says nothing about this one's numbers
+  auto session = ack.find(reliable_session_name);
+  if (session == ack.end() || (*session).getUInt() != session_) return true;
+  uint16_t n = (*cumulative).getUInt();
+  uint32_t bitmap = 0;
+  auto bits = ack.find(reliable_bitmap_name);
+  if (bits != ack.end()) bitmap = (*bits).getUInt();
+
+  for (uint8_t i = 0; i < slots_size_; i++) {
+    ReliableSlot& s = slots_[i];
+    if (s.list == none) continue;
+    // Only the unit the command went to acknowledges it
+    if (Packet::decode(s.buf).dest_unit_id() != ack.origin_unit_id()) continue;
+    int16_t d = s.sequence - n;
+    if (d <= 0 || (d >= 2 && d - 2 < 32 && (bitmap & (1ul << (d - 2))))) {
+      unlink(i);
+      release(i);
+      acked_++;
+    }
+  }
+  return true;
+}
+
+void ReliableSender::advance(uint32_t now) {
+  uint32_t now_tick = now / tick_;
+  uint32_t steps = now_tick - current_tick_;
+  if ((int32_t)steps <= 0) return;
+  if (steps > wheel_size_) steps = wheel_size_;
+
+  for (uint32_t k = 1; k <= steps; k++) {
+    uint8_t bucket = (current_tick_ + k) & (wheel_size_ - 1);
+    uint8_t i = heads_[bucket];
+    while (i != none) {
+      uint8_t next = slots_[i].next;
+      // Deadlines more than a turn away wait for a later visit
+      if ((int32_t)(slots_[i].deadline - now_tick) <= 0) {
+        unlink(i);
+        link(i, due());
+      }
+      i = next;
+    }
+  }
+  current_tick_ = now_tick;
+}
+
+void ReliableSender::link(uint8_t i, uint8_t list) {
+  ReliableSlot& s = slots_[i];
+  s.list = list;
+  s.next = none;
+  if (list == due()) {
+    // By sequence, so commands go out in the order they were sent
+    uint8_t after = due_tail_;
+    while (after != none && (int16_t)(slots_[after].sequence - s.sequence) > 0) {
+      after = slots_[after].prev;
+    }
+    s.prev = after;
+    s.next = after != none ? slots_[after].next : heads_[list];
+    if (after != none) slots_[after].next = i;
+    else               heads_[list] = i;
+    if (s.next != none) slots_[s.next].prev = i;
+    else                due_tail_ = i;
+    return;
+  }
+  s.prev = none;
+  s.next = heads_[list];
+  if (s.next != none) slots_[s.next].prev = i;
+  heads_[list] = i;
+}
+
+void ReliableSender::unlink(uint8_t i) {
+  ReliableSlot& s = slots_[i];
+  if (s.prev != none) slots_[s.prev].next = s.next;
+  else                heads_[s.list] = s.next;
+  if (s.next != none) slots_[s.next].prev = s.prev;
+  else if (s.list == due()) due_tail_ = s.prev;
+}
+
+void ReliableSender::release(uint8_t i) {
+  slots_[i].list = none;
+  in_flight_--;
+}
+
+bool ReliableSender::oldest(uint16_t& sequence) const {
+  bool found = false;
+  for (uint8_t i = 0; i < slots_size_; i++) {
+    if (slots_[i].list == none) continue;
+    if (!found || (int16_t)(slots_[i].sequence - sequence) < 0) sequence = slots_[i].sequence;
+    found = true;
+  }
+  return found;
+}
+
+
+ReliablePeer& ReliableReceiver::peer(uint8_t unit_id) {
+  for (uint8_t i = 0; i < peers_size_; i++) {
+    if (peers_[i].active && peers_[i].unit_id == unit_id) return peers_[i];
+  }
+  for (uint8_t i = 0; i < peers_size_; i++) {
+    if (!peers_[i].active) return peers_[i];
+  }
+  ReliablePeer& p = peers_[evict_];
+  evict_ = (evict_ + 1) % peers_size_;
+  p.active = false;
+  return p;
+}
+
+bool ReliableReceiver::receive(const Packet& command) {
+  if (command.isNull() || !command.isCommand() || !command.isRemote()) return true;
+
+  ReliablePeer& p = peer(command.origin_unit_id());
+  uint16_t sequence = command.sequence();
+  auto s = command.find(reliable_session_name);
+  uint16_t session = s != command.end() ? (*s).getUInt() : 0;
+  if (p.active && p.retired != 0 && session == p.retired) {
+    // Late from before the restart: acknowledging it would cover the
+    // numbers of the current session
+    duplicates_++;
+    return false;
+  }
+
+  bool fresh = !p.active || session != p.session;
+  p.unit_id = command.origin_unit_id();
+  p.self_unit_id = command.dest_unit_id();
+  p.component_id = command.component_id();
+  p.ack_due = true;
+
+  int16_t d = sequence - p.expected;
+  if (fresh || d >= reliable_window || d < -(int16_t)reliable_history) {
+    // A new or restarted sender
+    p.retired = p.active && session != p.session ? p.session : 0;
+    p.active = true;
+    p.session = session;
+    p.expected = sequence + 1;
+    p.received = 0;
+    return true;
+  }
+  if (d < 0 || (p.received & (1ul << d))) {
+    duplicates_++;
+    return false;
+  }
+
+  p.received |= 1ul << d;
+  while (p.received & 1) {
+    p.received >>= 1;
+    p.expected++;
+  }
+  return true;
+}
+
+bool ReliableReceiver::ack(Packet& out) {
+  for (uint8_t i = 0; i < peers_size_; i++) {
+    ReliablePeer& p = peers_[i];
+    if (!p.active || !p.ack_due) continue;
+
+    out.telemetry(ack_packet_id_, p.component_id, p.self_unit_id, p.unit_id);
+    if (!out.append(reliable_ack_name).setInt((uint16_t)(p.expected - 1))) return false;
+    // Bit 0 of received is the expected one, never set here
+    if (p.received != 0 && !out.append(reliable_bitmap_name).setInt(p.received >> 1)) {
+      return false;
+    }
+    if (p.session != 0 && !out.append(reliable_session_name).setInt(p.session)) return false;
+    p.ack_due = false;
+    return true;
+  }
+  return false;
+}
+
+} // namespace wcpp
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "fixed.h"
+#include "packet.h"
+
+namespace wcpp {
+
+// Reliable delivery of remote commands.
+//
+// ReliableSender stamps consecutive sequence numbers into the remote header
+// and keeps each command until it is acknowledged, retransmitting it from a
+// timer wheel with exponential backoff. One sender serves one destination
+// unit. Each command also carries the sender's session in an "As" entry,
+// so a receiver tells a restarted sender, which starts its sequence numbers
+// over, from retransmits of what it already has. ReliableReceiver delivers
+// each sequence number once per origin unit and session, and answers with
+// telemetry packets carrying
+//   "Ak" = n     every sequence number up to n arrived
+//   "Ab" = bits  bit i set: n + 2 + i arrived too (absent when zero), as
+//                n + 1 is the one missing
+//   "As"         the session these are for
+// Commands of the session before the current one are dropped unanswered.
+// Without a session, sequence numbers more than a window ahead, or far
+// behind, are taken as the sender having restarted.
+
+constexpr char reliable_ack_name[2]     = {'A', 'k'};
+constexpr char reliable_bitmap_name[2]  = {'A', 'b'};
+constexpr char reliable_session_name[2] = {'A', 's'};
+
+constexpr uint8_t reliable_ack_packet_id = 0x7E;
+// Sequence numbers in flight at once, as far as the ACK bitmap reaches
+constexpr uint8_t reliable_window = 32;
+// Sequence numbers this far behind are duplicates, anything older a restart
+constexpr uint16_t reliable_history = 1024;
+
+struct ReliableSlot {
+  uint16_t sequence;
+  uint8_t tries;
+  uint8_t list;
+  uint8_t prev;
+  uint8_t next;
+  uint32_t deadline;
+  uint8_t buf[size_max];
+};
+
+class ReliableSender {
+public:
+  // heads holds wheel_size + 1 list heads, wheel_size a power of two below 255.
+  // Times are in the caller's unit, timeout and tick alike. session must
+  // differ from the one before the last restart; 0 picks one, at random on
+  // the host. On Arduino, pass one that changes on each boot, such as a
+  // counter kept in EEPROM. ack_packet_id is the receiver's.
+  ReliableSender(ReliableSlot* slots, uint8_t slots_size, uint8_t* heads, uint8_t wheel_size,
+                 uint32_t timeout, uint8_t tries_max = 5, uint32_t tick = 10,
+                 uint16_t first_sequence = 0, uint16_t session = 0,
+                 uint8_t ack_packet_id = reliable_ack_packet_id);
+
+  // Queues a remote command; false if it is not one, the window is full or
+  // there is no room left in it for the session
+  bool send(const Packet& command, uint32_t now);
+  // The next command due, first transmissions and retransmits alike
+  bool pop(Packet& out, uint32_t now);
+  // Takes an ACK, returns false if it is not one. An ACK only covers the
+  // commands sent to the unit it comes from.
+  bool handle(const Packet& ack);
+
+  bool ready(uint32_t now);
+
+  inline uint8_t in_flight() const { return in_flight_; }
+  inline uint16_t next_sequence() const { return next_sequence_; }
+  inline uint16_t session() const { return session_; }
+  inline uint32_t acked() const { return acked_; }
+  inline uint32_t retransmits() const { return retransmits_; }
+  inline uint32_t failed() const { return failed_; }
+
+private:
+  ReliableSlot* slots_;
+  uint8_t slots_size_;
+  uint8_t* heads_;
+  uint8_t wheel_size_;
+  uint8_t due_tail_;
+  uint32_t timeout_;
+  uint8_t tries_max_;
+  uint32_t tick_;
+  uint32_t current_tick_;
+  uint16_t next_sequence_;
+  uint16_t session_;
+  uint8_t ack_packet_id_;
+  uint8_t in_flight_;
+  uint32_t acked_;
+  uint32_t retransmits_;
+  uint32_t failed_;
+
+  static constexpr uint8_t none = 0xFF;
+
+  inline uint8_t due() const { return wheel_size_; }
+
+  void advance(uint32_t now);
+  void link(uint8_t i, uint8_t list);
+  void unlink(uint8_t i);
+  void release(uint8_t i);
+  bool oldest(uint16_t& sequence) const;
+};
+
+template <uint8_t N = 8, uint8_t W = 32>
+class StaticReliableSender : private FixedArray<ReliableSlot, N>,
+                             private FixedArray<uint8_t, W + 1>,
+                             public ReliableSender {
+  static_assert(N <= reliable_window, "more in flight than an ACK covers");
+  static_assert((W & (W - 1)) == 0 && W < 255, "wheel size must be a power of two");
+
+public:
+  StaticReliableSender(uint32_t timeout, uint8_t tries_max = 5, uint32_t tick = 10,
+                       uint16_t first_sequence = 0, uint16_t session = 0,
+                       uint8_t ack_packet_id = reliable_ack_packet_id)
+    : ReliableSender(FixedArray<ReliableSlot, N>::items_, N, FixedArray<uint8_t, W + 1>::items_,
+                     W, timeout, tries_max, tick, first_sequence, session, ack_packet_id) {}
+};
+
+
+struct ReliablePeer {
+  uint8_t unit_id;
+  uint8_t self_unit_id;
+  uint8_t component_id;
+  bool active;
+  bool ack_due;
+  uint16_t session;
+  uint16_t retired; // the session before, 0 if none
+  uint16_t expected;
+  uint32_t received;
+};
+
+class ReliableReceiver {
+public:
+  ReliableReceiver(ReliablePeer* peers, uint8_t peers_size,
+                   uint8_t ack_packet_id = reliable_ack_packet_id)
+    : peers_(peers), peers_size_(peers_size), ack_packet_id_(ack_packet_id), evict_(0),
+      duplicates_(0) {
+    for (uint8_t i = 0; i < peers_size_; i++) peers_[i].active = false;
+  }
+
+  // Returns true if the command is new and should be handled. Local packets
+  // and telemetry pass through.
+  bool receive(const Packet& command);
+  // Writes the next ACK due, header included, to out
+  bool ack(Packet& out);
+
+  inline uint32_t duplicates() const { return duplicates_; }
+
+private:
+  ReliablePeer* peers_;
+  uint8_t peers_size_;
+  uint8_t ack_packet_id_;
+  uint8_t evict_;
+  uint32_t duplicates_;
+
+  ReliablePeer& peer(uint8_t unit_id);
+};
+
+template <uint8_t N = 4>
+class StaticReliableReceiver : private FixedArray<ReliablePeer, N>, public ReliableReceiver {
+public:
+  StaticReliableReceiver(uint8_t ack_packet_id = reliable_ack_packet_id)
+    : ReliableReceiver(FixedArray<ReliablePeer, N>::items_, N, ack_packet_id) {}
+};
+
+} // namespace wcpp
@@ -0,0 +1,176 @@
+#include "scheduler.h"
+
+#include <cstring>
+
+namespace wcpp {
+
+SchedulerStream* Scheduler::find(uint16_t key) {
+  int lo = 0;
+  int hi = streams_count_;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    uint16_t k = streams_[order_[mid]].key;
+    if (k == key) return streams_ + order_[mid];
+    if (k < key) lo = mid + 1;
+    else         hi = mid;
+  }
+  return nullptr;
+}
+
+SchedulerStream* Scheduler::add(uint16_t key, uint8_t weight, uint32_t period) {
+  if (streams_count_ >= streams_size_) return nullptr;
+
+  uint8_t i = streams_count_;
+  SchedulerStream& s = streams_[i];
+  s.key = key;
+  s.weight = weight > 0 ? weight : 1;
+  s.period = period;
+  s.next_time = 0;
+  s.finish = virtual_time_;
+  s.pending = false;
+
+  int pos = streams_count_;
+  while (pos > 0 && streams_[order_[pos - 1]].key > key) {
+    order_[pos] = order_[pos - 1];
+    pos--;
+  }
+  order_[pos] = i;
+  streams_count_++;
+  return &s;
+}
+
+bool Scheduler::configure(uint8_t packet_id, uint8_t component_id, uint8_t weight, uint32_t period) {
+  uint16_t key = ((uint16_t)component_id << 8) | packet_type_mask | (packet_id & packet_id_mask);
+  SchedulerStream* s = find(key);
+  if (s == nullptr) return add(key, weight, period) != nullptr;
+  s->weight = weight > 0 ? weight : 1;
+  s->period = period;
+  return true;
+}
+
+bool Scheduler::push(const Packet& packet, uint32_t now) {
+  if (packet.isNull() || packet.size() == 0) return false;
+  if (packet.isCommand()) return pushCommand(packet);
+
+  uint16_t key = streamKey(packet);
+  SchedulerStream* s = find(key);
+  if (s == nullptr) s = add(key, default_weight_, default_period_);
+  if (s == nullptr) return false;
+
+  // Older telemetry still waiting is replaced by the newest one
+  std::memcpy(s->buf, packet.encode(), packet.size());
+  if (!s->pending) {
+    s->pending = true;
+    schedule(s - streams_, now);
+  }
+  return true;
+}
+
+bool Scheduler::pop(Packet& out, uint32_t now) {
+  // Commands go first, so one that does not fit in out holds up the rest
+  if (command_count_ > 0) return popCommand(out);
+
+  promote(now);
+  if (ready_count_ == 0) return false;
+
+  // The stream stays at the top of the heap until its packet is out
+  SchedulerStream& s = streams_[ready_[0]];
+  const Packet p = Packet::decode(s.buf);
+  if (!out.copyHeader(p) || !out.copyPayload(p)) return false;
+
+  heapPop(ready_, ready_count_, &Scheduler::readyBefore);
+  s.pending = false;
+  s.next_time = now + s.period;
+  virtual_time_ = s.finish;
+  return true;
+}
+
+bool Scheduler::ready(uint32_t now) const {
+  if (command_count_ > 0 || ready_count_ > 0) return true;
+  return waiting_count_ > 0 && (int32_t)(now - streams_[waiting_[0]].next_time) >= 0;
+}
+
+// Earliest time pop() can return a packet, or now if nothing is pending
+uint32_t Scheduler::next_time(uint32_t now) const {
+  if (ready(now) || waiting_count_ == 0) return now;
+  return streams_[waiting_[0]].next_time;
+}
+
+void Scheduler::schedule(uint8_t i, uint32_t now) {
+  SchedulerStream& s = streams_[i];
+  uint32_t start = (int32_t)(s.finish - virtual_time_) > 0 ? s.finish : virtual_time_;
+  s.finish = start + ((uint32_t)s.buf[0] << 8) / s.weight;
+
+  if ((int32_t)(s.next_time - now) > 0)
+    heapPush(waiting_, waiting_count_, i, &Scheduler::waitingBefore);
+  else
+    heapPush(ready_, ready_count_, i, &Scheduler::readyBefore);
+}
+
+void Scheduler::promote(uint32_t now) {
+  while (waiting_count_ > 0 && (int32_t)(now - streams_[waiting_[0]].next_time) >= 0) {
+    uint8_t i = heapPop(waiting_, waiting_count_, &Scheduler::waitingBefore);
+    heapPush(ready_, ready_count_, i, &Scheduler::readyBefore);
+  }
+}
+
+void Scheduler::heapPush(uint8_t* heap, uint8_t& count, uint8_t i,
+                         bool (Scheduler::*before)(uint8_t, uint8_t) const) {
+  int pos = count++;
+  while (pos > 0) {
+    int parent = (pos - 1) / 2;
+    if (!(this->*before)(i, heap[parent])) break;
+    heap[pos] = heap[parent];
+    pos = parent;
+  }
+  heap[pos] = i;
+}
+
+uint8_t Scheduler::heapPop(uint8_t* heap, uint8_t& count,
+                           bool (Scheduler::*before)(uint8_t, uint8_t) const) {
+  uint8_t top = heap[0];
+  uint8_t last = heap[--count];
+  int pos = 0;
+  while (true) {
+    int child = pos * 2 + 1;
+    if (child >= count) break;
+    if (child + 1 < count && (this->*before)(heap[child + 1], heap[child])) child++;
+    if (!(this->*before)(heap[child], last)) break;
+    heap[pos] = heap[child];
+    pos = child;
+  }
+  if (count > 0) heap[pos] = last;
+  return top;
+}
+
+bool Scheduler::pushCommand(const Packet& packet) {
+  uint8_t size = packet.size();
+  if (command_used_ + size > command_buf_size_) return false;
+
+  const uint8_t* buf = packet.encode();
+  unsigned tail = (command_head_ + command_used_) % command_buf_size_;
+  for (int i = 0; i < size; i++) {
+    command_buf_[tail] = buf[i];
+    tail = (tail + 1) % command_buf_size_;
+  }
+  command_used_ += size;
+  command_count_++;
+  return true;
+}
+
+// Removes the oldest command, unless it does not fit in out
+bool Scheduler::popCommand(Packet& out) {
+  uint8_t size = command_buf_[command_head_];
+  if (out.size() + out.size_remain() < size) return false;
+
+  uint8_t* buf = out.getBuf();
+  for (int i = 0; i < size; i++) {
+    buf[i] = command_buf_[command_head_];
+    command_head_ = (command_head_ + 1) % command_buf_size_;
+  }
+  command_used_ -= size;
+  command_count_--;
+  return true;
+}
+
+} // namespace wcpp
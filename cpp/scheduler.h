@@ -0,0 +1,106 @@
+#pragma once
+
+#include "packet.h"
+
+namespace wcpp {
+
+// Transmit scheduler for outgoing packets.
+//
+// Commands are sent first, in order. Telemetry is kept per stream of
+// (component ID, packet ID): only the newest packet of each stream waits,
+// and streams share the link by weighted fair queuing within their rate
+// limits. Memory is fixed and dequeue is O(log n) in the number of streams.
+
+struct SchedulerStream {
+  uint16_t key;
+  uint8_t weight;
+  uint32_t period;
+  uint32_t next_time;
+  uint32_t finish;
+  bool pending;
+  uint8_t buf[size_max];
+};
+
+class Scheduler {
+public:
+  Scheduler(SchedulerStream* streams, uint8_t* order, uint8_t* heaps, uint8_t streams_size,
+            uint8_t* command_buf, unsigned command_buf_size)
+    : streams_(streams), order_(order), ready_(heaps), waiting_(heaps + streams_size),
+      streams_size_(streams_size), streams_count_(0), ready_count_(0), waiting_count_(0),
+      command_buf_(command_buf), command_buf_size_(command_buf_size),
+      command_head_(0), command_used_(0), command_count_(0), virtual_time_(0),
+      default_weight_(1), default_period_(0) {}
+
+  static inline uint16_t streamKey(const Packet& packet) {
+    return ((uint16_t)packet.component_id() << 8) | packet.type_and_id();
+  }
+
+  bool configure(uint8_t packet_id, uint8_t component_id, uint8_t weight, uint32_t period);
+  inline void configureDefault(uint8_t weight, uint32_t period) {
+    default_weight_ = weight;
+    default_period_ = period;
+  }
+
+  bool push(const Packet& packet, uint32_t now);
+  bool pop(Packet& out, uint32_t now);
+
+  bool ready(uint32_t now) const;
+  uint32_t next_time(uint32_t now) const;
+
+  inline unsigned command_count() const { return command_count_; }
+  inline uint8_t pending_count() const { return ready_count_ + waiting_count_; }
+  inline bool empty() const { return command_count_ == 0 && pending_count() == 0; }
+
+private:
+  SchedulerStream* streams_;
+  uint8_t* order_;
+  uint8_t* ready_;
+  uint8_t* waiting_;
+  uint8_t streams_size_;
+  uint8_t streams_count_;
+  uint8_t ready_count_;
+  uint8_t waiting_count_;
+
+  uint8_t* command_buf_;
+  unsigned command_buf_size_;
+  unsigned command_head_;
+  unsigned command_used_;
+  unsigned command_count_;
+
+  uint32_t virtual_time_;
+  uint8_t default_weight_;
+  uint32_t default_period_;
+
+  SchedulerStream* find(uint16_t key);
+  SchedulerStream* add(uint16_t key, uint8_t weight, uint32_t period);
+
+  bool pushCommand(const Packet& packet);
+  bool popCommand(Packet& out);
+
+  void schedule(uint8_t i, uint32_t now);
+  void promote(uint32_t now);
+
+  inline bool readyBefore(uint8_t a, uint8_t b) const {
+    return (int32_t)(streams_[a].finish - streams_[b].finish) < 0;
+  }
+  inline bool waitingBefore(uint8_t a, uint8_t b) const {
+    return (int32_t)(streams_[a].next_time - streams_[b].next_time) < 0;
+  }
+  void heapPush(uint8_t* heap, uint8_t& count, uint8_t i,
+                bool (Scheduler::*before)(uint8_t, uint8_t) const);
+  uint8_t heapPop(uint8_t* heap, uint8_t& count,
+                  bool (Scheduler::*before)(uint8_t, uint8_t) const);
+};
+
+template <uint8_t N = 16, unsigned C = 512> class StaticScheduler : public Scheduler {
+public:
+  StaticScheduler() : Scheduler(streams_, order_, heaps_, N, command_buf_, C) {}
+
+private:
+  SchedulerStream streams_[N];
+  uint8_t order_[N];
+  uint8_t heaps_[N * 2];
+  uint8_t command_buf_[C];
+};
+
+} // namespace wcpp
@@ -0,0 +1,197 @@
+#include "segment.h"
+
+namespace wcpp {
+
+static inline bool testBit(const uint32_t* bits, uint32_t i) {
+  return bits[i >> 5] & (1u << (i & 31));
+}
+static inline void setBit(uint32_t* bits, uint32_t i) {
+  bits[i >> 5] |= 1u << (i & 31);
+}
+static inline void clearBit(uint32_t* bits, uint32_t i) {
+  bits[i >> 5] &= ~(1u << (i & 31));
+}
+
+static inline uint32_t segmentCount(uint32_t length, uint8_t chunk) {
+  // An empty message is still one (empty) segment
+  return length == 0 ? 1 : (length + chunk - 1) / chunk;
+}
+
+
+bool Segmenter::start(uint16_t message_id, const uint8_t* data, uint32_t length, uint8_t chunk) {
+  if (chunk == 0 || segmentCount(length, chunk) > segments_max_) return false;
+  data_ = data;
+  length_ = length;
+  chunk_ = chunk;
+  segments_ = segmentCount(length, chunk);
+  cursor_ = 0;
+  message_id_ = message_id;
+  done_ = false;
+
+  for (uint32_t i = 0; i < (segments_ + 31) / 32; i++) pending_[i] = 0xFFFFFFFF;
+  if (segments_ & 31) pending_[segments_ >> 5] = (1u << (segments_ & 31)) - 1;
+  return true;
+}
+
+bool Segmenter::next(Packet& out) {
+  if (done_ || out.isNull()) return false;
+
+  // From the last one sent, so a status arriving mid-burst does not restart it
+  uint32_t i = cursor_;
+  uint32_t n = 0;
+  while (n < segments_ && !testBit(pending_, i)) {
+    i = i + 1 == segments_ ? 0 : i + 1;
+    n++;
+  }
+  if (n == segments_) return false;
+
+  uint32_t offset = i * chunk_;
+  uint8_t size = offset + chunk_ <= length_ ? chunk_ : length_ - offset;
+  uint8_t out_size = out.size();
+  if (!out.append(segment_message_name).setInt(message_id_) ||
+      !out.append(segment_length_name).setInt(length_) ||
+      !out.append(segment_chunk_name).setInt(chunk_) ||
+      !out.append(segment_offset_name).setInt(offset) ||
+      !out.append(segment_data_name).setBytes(data_ + offset, size)) {
+    // Entries are appended at the end, so this drops the ones that fit
+    out.getBuf()[0] = out_size;
+    return false;
+  }
+  clearBit(pending_, i);
+  cursor_ = i + 1 == segments_ ? 0 : i + 1;
+  return true;
+}
+
+bool Segmenter::handle(const Packet& status) {
+  auto id = status.find(segment_message_name);
+  auto offset = status.find(segment_offset_name);
+  if (id == status.end() || offset == status.end()) return false;
+  if ((*id).getUInt() != message_id_ || done_) return false;
+
+  uint64_t base_offset = (*offset).getUInt();
+  auto nack = status.find(segment_nack_name);
+  if (nack == status.end() && base_offset >= length_) {
+    done_ = true;
+    for (uint32_t i = 0; i < (segments_ + 31) / 32; i++) pending_[i] = 0;
+    return true;
+  }
+  if (base_offset % chunk_ != 0 || base_offset >= length_) return false;
+
+  // Everything before the base arrived
+  uint32_t base = base_offset / chunk_;
+  for (uint32_t i = 0; i < base; i++) clearBit(pending_, i);
+
+  if (nack != status.end()) {
+    uint8_t bitmap[size_max];
+    uint8_t bytes = (*nack).getBytes(bitmap);
+    for (uint32_t i = 0; i < bytes * 8u && base + i < segments_; i++) {
+      if (bitmap[i >> 3] & (1 << (i & 7))) setBit(pending_, base + i);
+    }
+  }
+  cursor_ = base;
+  return true;
+}
+
+uint32_t Segmenter::pending() const {
+  if (done_) return 0;
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < (segments_ + 31) / 32; i++) n += __builtin_popcount(pending_[i]);
+  return n;
+}
+
+
+bool Reassembler::receive(const Packet& segment) {
+  auto id = segment.find(segment_message_name);
+  auto length = segment.find(segment_length_name);
+  auto chunk = segment.find(segment_chunk_name);
+  auto offset = segment.find(segment_offset_name);
+  auto data = segment.find(segment_data_name);
+  if (id == segment.end() || length == segment.end() || chunk == segment.end() ||
+      offset == segment.end() || data == segment.end() || !(*data).isBytes()) {
+    errors_++;
+    return false;
+  }
+
+  uint16_t message_id = (*id).getUInt();
+  uint64_t message_length = (*length).getUInt();
+  uint64_t chunk_size = (*chunk).getUInt();
+  uint64_t segment_offset = (*offset).getUInt();
+  if (chunk_size == 0 || chunk_size > size_max || message_length > buf_size_ ||
+      segmentCount(message_length, chunk_size) > segments_max_) {
+    errors_++;
+    return false;
+  }
+
+  if (!active_ || message_id != message_id_) {
+    // A late segment of an earlier message must not replace this one
+    if (active_ && (int16_t)(message_id - message_id_) < 0) {
+      duplicates_++;
+      return false;
+    }
+    active_ = true;
+    message_id_ = message_id;
+    length_ = message_length;
+    chunk_ = chunk_size;
+    segments_ = segmentCount(length_, chunk_);
+    next_ = 0;
+    read_ = 0;
+    for (uint32_t i = 0; i < (segments_ + 31) / 32; i++) received_[i] = 0;
+  }
+  else if (message_length != length_ || chunk_size != chunk_) {
+    errors_++;
+    return false;
+  }
+
+  uint8_t bytes[size_max];
+  uint8_t size = (*data).getBytes(bytes);
+  uint32_t index = segment_offset / chunk_;
+  if (segment_offset % chunk_ != 0 || index >= segments_ ||
+      size != (uint32_t)(offsetOf(index + 1) - offsetOf(index))) {
+    errors_++;
+    return false;
+  }
+  if (testBit(received_, index)) {
+    duplicates_++;
+    return false;
+  }
+
+  std::memcpy(buf_ + segment_offset, bytes, size);
+  setBit(received_, index);
+  while (next_ < segments_ && testBit(received_, next_)) next_++;
+  return true;
+}
+
+const uint8_t* Reassembler::read(uint32_t& length) {
+  uint32_t end = prefix();
+  length = end - read_;
+  const uint8_t* data = buf_ + read_;
+  read_ = end;
+  return data;
+}
+
+bool Reassembler::status(Packet& out) const {
+  if (!active_ || out.isNull()) return false;
+
+  uint8_t out_size = out.size();
+  if (!out.append(segment_message_name).setInt(message_id_) ||
+      !out.append(segment_offset_name).setInt(prefix())) {
+    out.getBuf()[0] = out_size;
+    return false;
+  }
+  if (complete()) return true;
+
+  // Missing segments from the first one, as far as the bitmap reaches
+  uint8_t bitmap[segment_nack_bytes_max] = {};
+  uint32_t bits = segments_ - next_;
+  if (bits > segment_nack_bytes_max * 8) bits = segment_nack_bytes_max * 8;
+  for (uint32_t i = 0; i < bits; i++) {
+    if (!testBit(received_, next_ + i)) bitmap[i >> 3] |= 1 << (i & 7);
+  }
+  if (!out.append(segment_nack_name).setBytes(bitmap, (bits + 7) / 8)) {
+    out.getBuf()[0] = out_size;
+    return false;
+  }
+  return true;
+}
+
+} // namespace wcpp
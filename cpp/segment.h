@@ -0,0 +1,136 @@
+#pragma once
+
+#include "packet.h"
+
+namespace wcpp {
+
+// Segmentation of messages larger than a packet.
+//
+// Each segment is a packet with the header the caller chose, carrying
+//   "Mi" message ID   "Ln" total length   "Ck" chunk size
+//   "Of" byte offset  "Dt" chunk bytes (shorter for the last segment)
+// so any segment can start the reassembly. The receiver answers with a
+// status packet:
+//   "Mi" message ID
+//   "Of" offset of the first missing segment (the total length once complete)
+//   "Nk" bitmap of the missing segments from there, bit i of byte i / 8
+// Everything before "Of" is acknowledged; the sender resends what "Nk" asks
+// for, so only lost segments go out again.
+
+constexpr char segment_message_name[2] = {'M', 'i'};
+constexpr char segment_length_name[2]  = {'L', 'n'};
+constexpr char segment_chunk_name[2]   = {'C', 'k'};
+constexpr char segment_offset_name[2]  = {'O', 'f'};
+constexpr char segment_data_name[2]    = {'D', 't'};
+constexpr char segment_nack_name[2]    = {'N', 'k'};
+
+// Entries around the data, at their largest
+constexpr uint8_t segment_overhead = 22;
+constexpr uint8_t segment_nack_bytes_max = 32;
+
+// The largest chunk that fits a packet of mtu bytes
+constexpr uint8_t segmentChunk(uint8_t mtu, bool remote) {
+  return mtu - (remote ? 7 : 4) - segment_overhead;
+}
+
+class Segmenter {
+public:
+  Segmenter(uint32_t* pending, uint32_t segments_max)
+    : pending_(pending), segments_max_(segments_max), data_(nullptr), length_(0),
+      chunk_(0), segments_(0), cursor_(0), message_id_(0), done_(true) {}
+
+  // data must stay valid until done() or the next start()
+  bool start(uint16_t message_id, const uint8_t* data, uint32_t length, uint8_t chunk);
+
+  // Appends the next segment due to out, which already has its header.
+  // Returns false when none is due.
+  bool next(Packet& out);
+  // Takes a receiver status, returns false if it is not for this message
+  bool handle(const Packet& status);
+
+  uint32_t pending() const;
+  inline bool done() const { return done_; }
+  inline uint16_t message_id() const { return message_id_; }
+  inline uint32_t segments() const { return segments_; }
+
+private:
+  uint32_t* pending_;
+  uint32_t segments_max_;
+  const uint8_t* data_;
+  uint32_t length_;
+  uint8_t chunk_;
+  uint32_t segments_;
+  uint32_t cursor_;
+  uint16_t message_id_;
+  bool done_;
+};
+
+template <uint32_t Segments> class StaticSegmenter : public Segmenter {
+public:
+  StaticSegmenter() : Segmenter(pending_, Segments) {}
+
+private:
+  uint32_t pending_[(Segments + 31) / 32];
+};
+
+
+class Reassembler {
+public:
+  Reassembler(uint8_t* buf, uint32_t buf_size, uint32_t* received, uint32_t segments_max)
+    : buf_(buf), buf_size_(buf_size), received_(received), segments_max_(segments_max),
+      length_(0), chunk_(0), segments_(0), next_(0), read_(0), message_id_(0),
+      active_(false), duplicates_(0), errors_(0) {}
+
+  // Returns true for a new segment of the current message or of a newer
+  // one, which drops whatever is left of the current one
+  bool receive(const Packet& segment);
+
+  // Bytes that became contiguous from the start of the message since the
+  // last call, returned as they arrive so consumers can stream them
+  const uint8_t* read(uint32_t& length);
+
+  // Appends the receiver status to out, which already has its header
+  bool status(Packet& out) const;
+
+  inline bool active() const { return active_; }
+  inline bool complete() const { return active_ && next_ == segments_; }
+  inline uint16_t message_id() const { return message_id_; }
+  inline uint32_t length() const { return length_; }
+  inline const uint8_t* data() const { return buf_; }
+  // Bytes received in order from the start of the message
+  inline uint32_t prefix() const { return offsetOf(next_); }
+  inline uint32_t duplicates() const { return duplicates_; }
+  inline uint32_t errors() const { return errors_; }
+
+private:
+  uint8_t* buf_;
+  uint32_t buf_size_;
+  uint32_t* received_;
+  uint32_t segments_max_;
+  uint32_t length_;
+  uint8_t chunk_;
+  uint32_t segments_;
+  uint32_t next_;
+  uint32_t read_;
+  uint16_t message_id_;
+  bool active_;
+  uint32_t duplicates_;
+  uint32_t errors_;
+
+  inline uint32_t offsetOf(uint32_t segment) const {
+    uint32_t offset = segment * chunk_;
+    return offset < length_ ? offset : length_;
+  }
+};
+
+template <uint32_t Size, uint32_t Segments = Size / 32 + 1>
+class StaticReassembler : public Reassembler {
+public:
+  StaticReassembler() : Reassembler(buf_, Size, received_, Segments) {}
+
+private:
+  uint8_t buf_[Size];
+  uint32_t received_[(Segments + 31) / 32];
+};
+
+} // namespace wcpp
@@ -0,0 +1,60 @@
+#include "sequence.h"
+
+namespace wcpp {
+
+// Keys are stored with this bit set, so 0 marks a free slot
+static constexpr uint32_t key_used = 0x10000;
+
+SequenceTable::SequenceTable(SequenceSlot* slots, uint16_t size)
+  : slots_(slots), size_(size), shared_(0), overflowed_(0) {
+  for (uint16_t i = 0; i < size_; i++) {
+    slots_[i].key.store(0, std::memory_order_relaxed);
+    slots_[i].next.store(0, std::memory_order_relaxed);
+  }
+}
+
+uint16_t SequenceTable::next(uint8_t component_id, uint8_t type_and_id) {
+  uint32_t key = key_used | ((uint32_t)component_id << 8) | type_and_id;
+  uint32_t i = probe(key, size_, size_, [&](uint32_t j) {
+    uint32_t k = slots_[j].key.load(std::memory_order_acquire);
+    // Claim a free slot, unless another thread just claimed it for some stream
+    if (k == 0 && slots_[j].key.compare_exchange_strong(k, key, std::memory_order_acq_rel)) return true;
+    return k == key;
+  });
+  if (i < size_) return slots_[i].next.fetch_add(1, std::memory_order_relaxed);
+
+  overflowed_.fetch_add(1, std::memory_order_relaxed);
+  return shared_.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool SequenceTable::stamp(Packet& packet) {
+  if (packet.isNull() || !packet.isRemote()) return false;
+  return packet.setSequence(next(packet.component_id(), packet.type_and_id()));
+}
+
+uint16_t SequenceTable::used() const {
+  uint16_t n = 0;
+  for (uint16_t i = 0; i < size_; i++) {
+    if (slots_[i].key.load(std::memory_order_relaxed) != 0) n++;
+  }
+  return n;
+}
+
+
+// The Packet header setters that take their sequence number from a table
+
+Packet &Packet::command(uint8_t packet_id, uint8_t component_id,
+                        uint8_t origin_unit_id, uint8_t dest_unit_id, SequenceTable& sequences) {
+  uint8_t type_and_id = packet_id & ~(packet_type_mask);
+  return command(packet_id, component_id, origin_unit_id, dest_unit_id,
+                 sequences.next(component_id, type_and_id));
+}
+
+Packet &Packet::telemetry(uint8_t packet_id, uint8_t component_id,
+                          uint8_t origin_unit_id, uint8_t dest_unit_id, SequenceTable& sequences) {
+  uint8_t type_and_id = packet_id | packet_type_mask;
+  return telemetry(packet_id, component_id, origin_unit_id, dest_unit_id,
+                   sequences.next(component_id, type_and_id));
+}
+
+} // namespace wcpp
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "fixed.h"
+#include "packet.h"
+
+#include <atomic>
+
+namespace wcpp {
+
+// Sequence numbers for remote packets, counted per (component ID, packet
+// type and ID) so receivers can tell repeats of a packet from new ones.
+//
+// Counters live in a fixed open-addressing table. A stream claims its slot
+// with a compare-exchange on first use and counts with fetch_add after, so
+// any number of threads and interrupts can take numbers without a lock.
+// When the table is full, the remaining streams share one counter.
+
+struct SequenceSlot {
+  std::atomic<uint32_t> key;
+  std::atomic<uint16_t> next;
+};
+
+class SequenceTable {
+public:
+  SequenceTable(SequenceSlot* slots, uint16_t size);
+
+  uint16_t next(uint8_t component_id, uint8_t type_and_id);
+  // Sets the next number of the packet's stream, false for local packets
+  bool stamp(Packet& packet);
+
+  uint16_t used() const;
+  inline uint16_t size() const { return size_; }
+  inline uint32_t overflowed() const { return overflowed_.load(std::memory_order_relaxed); }
+
+private:
+  SequenceSlot* slots_;
+  uint16_t size_;
+  std::atomic<uint16_t> shared_;
+  std::atomic<uint32_t> overflowed_;
+};
+
+template <uint16_t N = 64>
+class StaticSequenceTable : private FixedArray<SequenceSlot, N>, public SequenceTable {
+public:
+  StaticSequenceTable() : SequenceTable(FixedArray<SequenceSlot, N>::items_, N) {}
+};
+
+} // namespace wcpp
@@ -0,0 +1,104 @@
+#include "telemetry_cache.h"
+
+#include <cstring>
+
+namespace wcpp {
+
+TelemetryCache::TelemetryCache(TelemetryCacheSlot* slots, unsigned capacity)
+  : slots_(slots), capacity_(capacity), size_(0) {
+  for (unsigned i = 0; i < capacity_; i++) {
+    slots_[i].key.store(0, std::memory_order_relaxed);
+    slots_[i].seq.store(0, std::memory_order_relaxed);
+  }
+}
+
+bool TelemetryCache::update(const Packet& packet, uint32_t now) {
+  if (packet.isNull() || packet.size() == 0 || capacity_ == 0) return false;
+
+  uint32_t key = packet.key() | key_used;
+  unsigned i = probe(key, capacity_, capacity_, [&](uint32_t j) {
+    uint32_t k = slots_[j].key.load(std::memory_order_relaxed);
+    return k == key || k == 0;
+  });
+  if (i == capacity_) return false;
+  TelemetryCacheSlot* slot = slots_ + i;
+  if (slot->key.load(std::memory_order_relaxed) == 0) {
+    slot->count.store(0, std::memory_order_relaxed);
+    slot->interval.store(0, std::memory_order_relaxed);
+    slot->words[0].store(0, std::memory_order_relaxed);
+    slot->key.store(key, std::memory_order_release);
+    size_.fetch_add(1, std::memory_order_release);
+  }
+
+  uint32_t seq = slot->seq.load(std::memory_order_relaxed);
+  slot->seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  // Only this thread writes, so relaxed loads see its own stores
+  uint32_t count = slot->count.load(std::memory_order_relaxed);
+  if (count > 0) {
+    uint32_t dt = now - slot->time.load(std::memory_order_relaxed);
+    uint32_t interval = slot->interval.load(std::memory_order_relaxed);
+    slot->interval.store(interval == 0 ? dt : (interval * 7 + dt) / 8, std::memory_order_relaxed);
+  }
+  slot->time.store(now, std::memory_order_relaxed);
+  slot->count.store(count + 1, std::memory_order_relaxed);
+
+  const uint8_t* buf = packet.encode();
+  unsigned size = packet.size();
+  for (unsigned w = 0; w * 4 < size; w++) {
+    uint32_t word = 0;
+    std::memcpy(&word, buf + w * 4, size - w * 4 < 4 ? size - w * 4 : 4);
+    slot->words[w].store(word, std::memory_order_relaxed);
+  }
+
+  slot->seq.store(seq + 2, std::memory_order_release);
+  return true;
+}
+
+const TelemetryCacheSlot* TelemetryCache::find(uint32_t key) const {
+  if (capacity_ == 0) return nullptr;
+
+  key |= key_used;
+  unsigned i = probe(key, capacity_, capacity_, [&](uint32_t j) {
+    uint32_t k = slots_[j].key.load(std::memory_order_acquire);
+    return k == key || k == 0;
+  });
+  if (i == capacity_ || slots_[i].key.load(std::memory_order_acquire) != key) return nullptr;
+  return slots_ + i;
+}
+
+void TelemetryCache::read(const TelemetryCacheSlot& slot, Snapshot& snapshot) {
+  uint32_t seq;
+  while (true) {
+    seq = slot.seq.load(std::memory_order_acquire);
+    if (seq & 1) continue;
+
+    snapshot.time = slot.time.load(std::memory_order_relaxed);
+    snapshot.count = slot.count.load(std::memory_order_relaxed);
+    snapshot.interval = slot.interval.load(std::memory_order_relaxed);
+    // All of it: the size byte may be torn
+    for (unsigned w = 0; w < telemetry_cache_words; w++) {
+      uint32_t word = slot.words[w].load(std::memory_order_relaxed);
+      std::memcpy(snapshot.buf + w * 4, &word, size_max - w * 4 < 4 ? size_max - w * 4 : 4);
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) == seq) break;
+  }
+}
+
+bool TelemetryCache::get(uint32_t key, Snapshot& snapshot) const {
+  const TelemetryCacheSlot* slot = find(key);
+  if (slot == nullptr) return false;
+  read(*slot, snapshot);
+  return snapshot.count > 0;
+}
+
+bool TelemetryCache::at(unsigned i, Snapshot& snapshot) const {
+  if (i >= capacity_ || slots_[i].key.load(std::memory_order_acquire) == 0) return false;
+  read(slots_[i], snapshot);
+  return snapshot.count > 0;
+}
+
+} // namespace wcpp
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "fixed.h"
+#include "packet.h"
+
+#include <atomic>
+
+namespace wcpp {
+
+// Latest packet of each (origin unit, component, packet ID).
+//
+// One writer (the decoder) updates the cache while any number of readers
+// take snapshots without locking. Each slot is a seqlock: the writer makes
+// the sequence odd while it copies, and readers retry if it changed. The
+// data is copied through relaxed atomics, a word at a time, so a reader
+// racing the writer gets a torn copy to throw away rather than undefined
+// behavior.
+
+constexpr unsigned telemetry_cache_words = (size_max + 3) / 4;
+
+struct TelemetryCacheSlot {
+  std::atomic<uint32_t> key;
+  std::atomic<uint32_t> seq;
+  std::atomic<uint32_t> time;
+  std::atomic<uint32_t> count;
+  std::atomic<uint32_t> interval;
+  std::atomic<uint32_t> words[telemetry_cache_words];
+};
+
+class TelemetryCache {
+public:
+  struct Snapshot {
+    uint32_t time;
+    uint32_t count;
+    uint32_t interval; // moving average of the interval between packets
+    uint8_t buf[size_max];
+
+    inline const Packet packet() const { return Packet::decode(buf); }
+    inline float rate() const { return interval > 0 ? 1000.0f / interval : 0.0f; }
+  };
+
+  TelemetryCache(TelemetryCacheSlot* slots, unsigned capacity);
+
+  // now is in milliseconds, from the clock readers judge staleness by:
+  // millis() on Arduino, steady_clock on the host
+  bool update(const Packet& packet, uint32_t now);
+
+  bool get(uint32_t key, Snapshot& snapshot) const;
+  inline bool get(uint8_t origin_unit_id, uint8_t component_id, uint8_t type_and_id,
+                  Snapshot& snapshot) const {
+    return get(((uint32_t)origin_unit_id << 16) | ((uint32_t)component_id << 8) | type_and_id,
+               snapshot);
+  }
+  bool at(unsigned i, Snapshot& snapshot) const;
+
+  inline unsigned capacity() const { return capacity_; }
+  inline unsigned size() const { return size_.load(std::memory_order_acquire); }
+
+private:
+  TelemetryCacheSlot* slots_;
+  unsigned capacity_;
+  std::atomic<unsigned> size_;
+
+  static constexpr uint32_t key_used = 0x80000000;
+
+  const TelemetryCacheSlot* find(uint32_t key) const;
+  static void read(const TelemetryCacheSlot& slot, Snapshot& snapshot);
+};
+
+template <unsigned N = 256>
+class StaticTelemetryCache : private FixedArray<TelemetryCacheSlot, N>, public TelemetryCache {
+public:
+  StaticTelemetryCache() : TelemetryCache(FixedArray<TelemetryCacheSlot, N>::items_, N) {}
+};
+
+} // namespace wcpp
@@ -0,0 +1,86 @@
+#include "arena.h"
+
+#ifndef ARDUINO
+
+#include <gtest/gtest.h>
+#include <thread>
+
+TEST(ArenaTest, Allocate) {
+  wcpp::PacketArena arena;
+  EXPECT_EQ(arena.blocks(), 0);
+
+  uint8_t buf[32];
+  wcpp::Packet src = wcpp::Packet::empty(buf, sizeof(buf));
+  src.telemetry(1, 2);
+  src.append("Ax").setInt(1000);
+
+  wcpp::Packet first = arena.copy(src);
+  EXPECT_EQ(first.size_remain(), 0);
+  EXPECT_EQ((*first.find("Ax")).getInt(), 1000);
+  EXPECT_EQ(arena.blocks(), 1);
+
+  // Fill more than one block
+  uint8_t* last = nullptr;
+  for (int i = 0; i < 1000; i++) {
+    wcpp::Packet p = arena.allocate();
+    ASSERT_FALSE(p.isNull());
+    EXPECT_EQ(p.size_remain(), wcpp::size_max);
+    p.telemetry(1, 2);
+    p.append("Ct").setInt(i);
+    last = p.getBuf();
+  }
+  EXPECT_EQ(arena.blocks(), 4);
+  EXPECT_EQ((*first.find("Ax")).getInt(), 1000);
+  EXPECT_EQ((*wcpp::Packet::decode(last).find("Ct")).getInt(), 999);
+
+  // Blocks are reused after reset
+  arena.reset();
+  EXPECT_EQ(arena.blocks(), 4);
+  for (int i = 0; i < 1000; i++) EXPECT_FALSE(arena.allocate().isNull());
+  EXPECT_EQ(arena.blocks(), 4);
+
+  EXPECT_TRUE(arena.allocate(0).isNull());
+}
+
+TEST(ArenaTest, Pin) {
+  wcpp::Packet kept = wcpp::Packet::null();
+  {
+    wcpp::PacketArena arena;
+    wcpp::Packet p = arena.allocate(32, true);
+    p.telemetry(1, 2);
+    p.append("Ax").setInt(1000);
+    wcpp::Packet q = p;
+    arena.allocate(64);
+
+    // The block is pinned, so reset leaves it to the packets
+    arena.reset();
+    EXPECT_EQ(arena.blocks(), 0);
+    EXPECT_EQ((*p.find("Ax")).getInt(), 1000);
+
+    wcpp::Packet r = arena.allocate(32);
+    EXPECT_NE(r.getBuf(), p.getBuf());
+    EXPECT_EQ(arena.blocks(), 1);
+    kept = std::move(q);
+  }
+  // Outlives the arena and is freed with the last copy
+  EXPECT_EQ((*kept.find("Ax")).getInt(), 1000);
+}
+
+TEST(ArenaTest, Local) {
+  wcpp::PacketArena* main_arena = &wcpp::PacketArena::local();
+  EXPECT_EQ(main_arena, &wcpp::PacketArena::local());
+
+  wcpp::PacketArena* other = nullptr;
+  wcpp::Packet pinned = wcpp::Packet::null();
+  std::thread t([&]() {
+    other = &wcpp::PacketArena::local();
+    pinned = other->allocate(16, true);
+    pinned.telemetry(3, 4);
+  });
+  t.join();
+  EXPECT_NE(other, main_arena);
+  // The thread's arena is gone, the pinned block is still alive
+  EXPECT_EQ(pinned.packet_id(), 3);
+}
+
+#endif
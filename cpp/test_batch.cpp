@@ -0,0 +1,106 @@
+#include "batch.h"
+
+#ifndef ARDUINO
+
+#include <cstring>
+#include <gtest/gtest.h>
+
+static wcpp::Packet buildPacket(uint8_t* buf, uint8_t id, int entries) {
+  wcpp::Packet p = wcpp::Packet::empty(buf, wcpp::size_max);
+  p.telemetry(id, 0x10);
+  for (int i = 0; i < entries; i++) p.append("Va").setInt(1000 + i);
+  return p;
+}
+
+TEST(BatchTest, PackAndUnpack) {
+  wcpp::StaticBatch<64, 8> batch(100);
+
+  uint8_t bufs[3][wcpp::size_max];
+  wcpp::Packet a = buildPacket(bufs[0], 1, 2);
+  wcpp::Packet b = buildPacket(bufs[1], 2, 3);
+  wcpp::Packet c = buildPacket(bufs[2], 3, 1);
+
+  EXPECT_TRUE(batch.push(a, 0));
+  EXPECT_TRUE(batch.push(b, 0, 5));
+  EXPECT_TRUE(batch.push(c, 0));
+  EXPECT_EQ(batch.count(), 3);
+  EXPECT_FALSE(batch.ready(50));
+  EXPECT_TRUE(batch.ready(100));
+
+  uint8_t frame[64];
+  uint8_t length = batch.flush(frame);
+  EXPECT_EQ(length, a.size() + b.size() + c.size() + wcpp::batch_trailer_size);
+  EXPECT_TRUE(batch.empty());
+
+  wcpp::Unbatcher unbatcher(frame, length);
+  EXPECT_TRUE(unbatcher.isValid());
+
+  // Higher priority goes first, others keep their order
+  const uint8_t expected[] = {2, 1, 3};
+  int n = 0;
+  for (auto i = unbatcher.begin(); i != unbatcher.end(); ++i, ++n) {
+    const wcpp::Packet p = *i;
+    ASSERT_LT(n, 3);
+    EXPECT_EQ(p.packet_id(), expected[n]);
+    EXPECT_GE(p.encode(), frame);
+    EXPECT_LT(p.encode(), frame + length);
+  }
+  EXPECT_EQ(n, 3);
+
+  const wcpp::Packet first = *unbatcher.begin();
+  EXPECT_EQ(std::memcmp(first.encode(), b.encode(), b.size()), 0);
+}
+
+TEST(BatchTest, SplitsAtMTU) {
+  wcpp::StaticBatch<32, 8> batch(100);
+
+  uint8_t buf[wcpp::size_max];
+  wcpp::Packet p = buildPacket(buf, 1, 3); // 4 + 3 * 4 bytes
+
+  EXPECT_TRUE(batch.push(p, 0));
+  EXPECT_FALSE(batch.ready(0));
+  EXPECT_TRUE(batch.push(p, 0));
+  EXPECT_TRUE(batch.push(p, 0));
+  EXPECT_TRUE(batch.ready(0));
+
+  uint8_t frame[32];
+  uint8_t length = batch.flush(frame);
+  EXPECT_LE(length, 32);
+  EXPECT_EQ(batch.count(), 2);
+
+  length = batch.flush(frame);
+  EXPECT_LE(length, 32);
+  EXPECT_EQ(batch.count(), 1);
+}
+
+TEST(BatchTest, RejectsOversizedPacket) {
+  wcpp::StaticBatch<16, 4> batch(100);
+
+  uint8_t buf[wcpp::size_max];
+  EXPECT_FALSE(batch.push(buildPacket(buf, 1, 3), 0));
+  EXPECT_TRUE(batch.empty());
+}
+
+TEST(BatchTest, CorruptFrame) {
+  wcpp::StaticBatch<64, 4> batch(0);
+
+  uint8_t buf[wcpp::size_max];
+  batch.push(buildPacket(buf, 1, 2), 0);
+  batch.push(buildPacket(buf, 2, 2), 0);
+
+  uint8_t frame[64];
+  uint8_t length = batch.flush(frame);
+  EXPECT_TRUE(wcpp::Unbatcher(frame, length).isValid());
+
+  frame[5] ^= 0x40;
+  EXPECT_FALSE(wcpp::Unbatcher(frame, length).isValid());
+  frame[5] ^= 0x40;
+
+  // A broken size byte never lets iteration run past the frame
+  frame[0] = 200;
+  wcpp::Unbatcher broken(frame, length);
+  EXPECT_FALSE(broken.isValid());
+  EXPECT_EQ(broken.begin(), broken.end());
+}
+
+#endif
@@ -0,0 +1,138 @@
+#include "bus.h"
+
+#ifndef ARDUINO
+
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+static wcpp::Packet buildTelemetry(uint8_t* buf, uint8_t unit, uint8_t component, uint8_t id) {
+  wcpp::Packet p = wcpp::Packet::empty(buf, wcpp::size_max);
+  p.telemetry(id, component, unit, 0xFE);
+  p.append("Va").setInt(id);
+  return p;
+}
+
+TEST(PoolTest, RefCounting) {
+  static wcpp::StaticPacketPool<4> pool;
+  EXPECT_EQ(pool.available(), 4);
+  {
+    wcpp::Packet a = pool.allocate();
+    ASSERT_FALSE(a.isNull());
+    a.telemetry(1, 2);
+    EXPECT_EQ(pool.available(), 3);
+
+    wcpp::Packet b = a;
+    wcpp::Packet c = pool.allocate();
+    EXPECT_EQ(pool.available(), 2);
+    c = b;
+    EXPECT_EQ(pool.available(), 3);
+    EXPECT_EQ(c.encode(), a.encode());
+  }
+  EXPECT_EQ(pool.available(), 4);
+
+  std::vector<wcpp::Packet> held;
+  for (int i = 0; i < 4; i++) held.push_back(pool.allocate());
+  EXPECT_TRUE(pool.allocate().isNull());
+  held.clear();
+  EXPECT_EQ(pool.available(), 4);
+}
+
+TEST(BusTest, Filters) {
+  static wcpp::StaticPacketPool<16> pool;
+  wcpp::Bus bus(pool);
+
+  wcpp::BusFilter all;
+  wcpp::BusFilter unit2;
+  unit2.origin_unit_id = 2;
+  wcpp::BusFilter named;
+  named.name("Zz").name("Va");
+  wcpp::BusFilter none;
+  none.name("Zz");
+
+  wcpp::Subscriber* s_all = bus.subscribe(all);
+  wcpp::Subscriber* s_unit2 = bus.subscribe(unit2);
+  wcpp::Subscriber* s_named = bus.subscribe(named);
+  wcpp::Subscriber* s_none = bus.subscribe(none);
+
+  uint8_t buf[wcpp::size_max];
+  EXPECT_EQ(bus.publish(buildTelemetry(buf, 1, 1, 1)), 2);
+  EXPECT_EQ(bus.publish(buildTelemetry(buf, 2, 1, 2)), 3);
+
+  uint8_t out_buf[wcpp::size_max];
+  wcpp::Packet out = wcpp::Packet::empty(out_buf, wcpp::size_max);
+  ASSERT_TRUE(s_unit2->receive(out));
+  EXPECT_EQ(out.origin_unit_id(), 2);
+  const uint8_t* shared = out.encode();
+  EXPECT_FALSE(s_unit2->receive(out));
+
+  ASSERT_TRUE(s_all->receive(out));
+  EXPECT_EQ(out.packet_id(), 1);
+  ASSERT_TRUE(s_all->receive(out));
+  EXPECT_EQ(out.packet_id(), 2);
+  EXPECT_EQ(out.encode(), shared);
+
+  EXPECT_EQ(s_named->delivered(), 2);
+  EXPECT_EQ(s_none->delivered(), 0);
+}
+
+TEST(BusTest, DropPolicy) {
+  static wcpp::StaticPacketPool<16> pool;
+  {
+    wcpp::Bus bus(pool);
+    wcpp::Subscriber* s = bus.subscribe(wcpp::BusFilter(), 2, wcpp::BusPolicy::drop);
+
+    uint8_t buf[wcpp::size_max];
+    for (int i = 0; i < 5; i++) bus.publish(buildTelemetry(buf, 1, 1, i));
+    EXPECT_EQ(s->delivered(), 2);
+    EXPECT_EQ(s->dropped(), 3);
+    EXPECT_EQ(pool.available(), 14);
+  }
+  EXPECT_EQ(pool.available(), 16);
+}
+
+TEST(BusTest, Threads) {
+  static wcpp::StaticPacketPool<256> pool;
+  wcpp::Bus bus(pool);
+
+  const int subscribers = 4;
+  const int packets = 20000;
+  wcpp::Subscriber* s[subscribers];
+  for (int i = 0; i < subscribers; i++) {
+    s[i] = bus.subscribe(wcpp::BusFilter(), 64, wcpp::BusPolicy::block);
+  }
+
+  std::vector<std::thread> threads;
+  std::atomic<int> mismatches(0);
+  for (int i = 0; i < subscribers; i++) {
+    threads.emplace_back([&, i]() {
+      uint8_t buf[wcpp::size_max];
+      wcpp::Packet out = wcpp::Packet::empty(buf, wcpp::size_max);
+      for (int n = 0; n < packets;) {
+        if (!s[i]->receive(out)) {
+          std::this_thread::yield();
+          continue;
+        }
+        if ((*out.begin()).getInt() != n % 100) mismatches++;
+        n++;
+      }
+    });
+  }
+
+  for (int n = 0; n < packets; n++) {
+    wcpp::Packet p = pool.allocate();
+    while (p.isNull()) {
+      std::this_thread::yield();
+      p = pool.allocate();
+    }
+    p.telemetry(1, 1);
+    p.append("Va").setInt(n % 100);
+    EXPECT_EQ(bus.publish(p), subscribers);
+  }
+  for (auto& t : threads) t.join();
+
+  EXPECT_EQ(mismatches, 0);
+  EXPECT_EQ(pool.available(), 256);
+}
+
+#endif
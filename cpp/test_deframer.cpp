@@ -0,0 +1,90 @@
+#include "deframer.h"
+
+#ifndef ARDUINO
+
+#include <gtest/gtest.h>
+#include <vector>
+
+static std::vector<uint8_t> stream(int count, std::vector<int>& ids) {
+  std::vector<uint8_t> out;
+  for (int i = 0; i < count; i++) {
+    uint8_t buf[64];
+    wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+    p.telemetry(i % 128, 2);
+    p.append("Ct").setInt(i * 1000, 4);
+    p.append("Zr").setBytes((const uint8_t*)"\0\0\0", 3);
+    uint8_t f[64];
+    uint16_t n = wcpp::frame(p, f);
+    out.insert(out.end(), f, f + n);
+    ids.push_back(i);
+  }
+  return out;
+}
+
+TEST(DeframerTest, Split) {
+  std::vector<int> ids;
+  std::vector<uint8_t> s = stream(50, ids);
+
+  wcpp::Deframer d;
+  int received = 0;
+  for (uint8_t b : s) {
+    if (d.put(b)) {
+      EXPECT_EQ((*d.packet().find("Ct")).getInt(), received * 1000);
+      received++;
+    }
+  }
+  EXPECT_EQ(received, 50);
+  EXPECT_EQ(d.frames(), 50);
+  EXPECT_EQ(d.errors(), 0);
+}
+
+TEST(DeframerTest, Resync) {
+  std::vector<int> ids;
+  std::vector<uint8_t> s = stream(20, ids);
+  uint8_t frame_size = s[0] + wcpp::frame_overhead;
+
+  // Start in the middle of a frame, corrupt one, truncate one
+  std::vector<uint8_t> damaged(s.begin() + 5, s.end());
+  damaged[frame_size * 3 + 6 - 5] ^= 0x55;
+  damaged.erase(damaged.begin() + frame_size * 7 + 3 - 5,
+                damaged.begin() + frame_size * 7 + 10 - 5);
+
+  wcpp::Deframer d;
+  std::vector<int> got;
+  for (uint8_t b : damaged) {
+    if (d.put(b)) got.push_back((*d.packet().find("Ct")).getInt() / 1000);
+  }
+  while (d.next()) got.push_back((*d.packet().find("Ct")).getInt() / 1000);
+  EXPECT_GT(d.errors(), 0);
+
+  // Frame 0 is cut, 3 is corrupt and 7 is cut; the rest get through
+  std::vector<int> expect;
+  for (int i = 1; i < 20; i++) if (i != 3 && i != 7) expect.push_back(i);
+  EXPECT_EQ(got, expect);
+}
+
+TEST(DeframerTest, Malformed) {
+  std::vector<int> ids;
+  std::vector<uint8_t> s = stream(3, ids);
+  uint8_t frame_size = s[0] + wcpp::frame_overhead;
+
+  // The middle frame has a good CRC, but "Zr" turned into bytes with a
+  // length byte that runs past the end
+  uint8_t* f = s.data() + frame_size;
+  uint8_t size = f[0];
+  f[10] = (f[10] & 0x1F) | 0b011 << 5;
+  f[11] = f[11] & 0x1F;
+  f[12] = 0x1F;
+  f[size] = wcpp::Packet::checksum(f, size);
+
+  wcpp::Deframer d;
+  std::vector<int> got;
+  for (uint8_t b : s) {
+    if (d.put(b)) got.push_back((*d.packet().find("Ct")).getInt() / 1000);
+  }
+  EXPECT_EQ(got, std::vector<int>({0, 2}));
+  EXPECT_EQ(d.frames(), 2);
+  EXPECT_EQ(d.errors(), 1);
+}
+
+#endif
@@ -0,0 +1,208 @@
+#include "delta.h"
+
+#ifndef ARDUINO
+
+#include <cstring>
+#include <gtest/gtest.h>
+
+static wcpp::Packet buildTelemetry(uint8_t* buf, int i) {
+  wcpp::Packet p = wcpp::Packet::empty(buf, wcpp::size_max);
+  p.telemetry(0x12, 0x34, 0x01, 0xFE, i);
+  p.append("Ct").setInt(1000 + i);
+  p.append("Ax").setFloat32(0.5f);
+  p.append("Ay").setFloat32(i % 3 == 0 ? 1.0f : 2.0f);
+  p.append("Tp").setInt(-250 - (i % 4));
+  p.append("Nm").setString("flight computer");
+  p.append("Pr").setInt(101325);
+  return p;
+}
+
+static void expectSamePacket(const wcpp::Packet& a, const wcpp::Packet& b) {
+  ASSERT_EQ(a.size(), b.size());
+  EXPECT_EQ(std::memcmp(a.encode(), b.encode(), a.size()), 0);
+}
+
+TEST(DeltaTest, ZigZag) {
+  EXPECT_EQ(wcpp::zigzag(0), 0);
+  EXPECT_EQ(wcpp::zigzag(-1), 1);
+  EXPECT_EQ(wcpp::zigzag(1), 2);
+  EXPECT_EQ(wcpp::zigzag(-2), 3);
+  for (int64_t v : std::initializer_list<int64_t>{0, 1, -1, 12345, -98765, INT64_MAX, INT64_MIN}) {
+    EXPECT_EQ(wcpp::unzigzag(wcpp::zigzag(v)), v);
+  }
+}
+
+TEST(DeltaTest, RoundTrip) {
+  wcpp::StaticDeltaEncoder<4> encoder(10);
+  wcpp::StaticDeltaDecoder<4> decoder;
+
+  unsigned total_raw = 0;
+  unsigned total_encoded = 0;
+
+  for (int i = 0; i < 50; i++) {
+    uint8_t buf[wcpp::size_max];
+    uint8_t enc_buf[wcpp::size_max];
+    uint8_t dec_buf[wcpp::size_max];
+
+    wcpp::Packet p = buildTelemetry(buf, i);
+    wcpp::Packet enc = wcpp::Packet::empty(enc_buf, wcpp::size_max);
+    wcpp::Packet dec = wcpp::Packet::empty(dec_buf, wcpp::size_max);
+
+    ASSERT_TRUE(encoder.encode(p, enc));
+    EXPECT_EQ(enc.packet_id(), wcpp::delta_packet_id);
+    EXPECT_EQ(enc.isTelemetry(), p.isTelemetry());
+    EXPECT_EQ(enc.component_id(), p.component_id());
+    EXPECT_EQ(enc.sequence(), p.sequence());
+
+    bool is_keyframe = (*enc.begin()).name() == wcpp::delta_keyframe_name;
+    EXPECT_EQ(is_keyframe, i % 10 == 0);
+    if (!is_keyframe) {
+      EXPECT_LT(enc.size(), p.size());
+    }
+
+    ASSERT_TRUE(decoder.decode(enc, dec));
+    expectSamePacket(dec, p);
+
+    total_raw += p.size();
+    total_encoded += enc.size();
+  }
+  EXPECT_LT(total_encoded * 2, total_raw);
+}
+
+TEST(DeltaTest, LostKeyframe) {
+  wcpp::StaticDeltaEncoder<2> encoder(4);
+  wcpp::StaticDeltaDecoder<2> decoder;
+
+  for (int i = 0; i < 10; i++) {
+    uint8_t buf[wcpp::size_max];
+    uint8_t enc_buf[wcpp::size_max];
+    uint8_t dec_buf[wcpp::size_max];
+
+    wcpp::Packet p = buildTelemetry(buf, i);
+    wcpp::Packet enc = wcpp::Packet::empty(enc_buf, wcpp::size_max);
+    wcpp::Packet dec = wcpp::Packet::empty(dec_buf, wcpp::size_max);
+    ASSERT_TRUE(encoder.encode(p, enc));
+
+    // The first keyframe is lost, so deltas cannot be decoded until the next one
+    if (i == 0) continue;
+    bool decoded = decoder.decode(enc, dec);
+    EXPECT_EQ(decoded, i >= 4);
+    if (decoded) expectSamePacket(dec, p);
+  }
+}
+
+TEST(DeltaTest, LayoutChange) {
+  wcpp::StaticDeltaEncoder<2> encoder;
+  wcpp::StaticDeltaDecoder<2> decoder;
+
+  uint8_t buf[wcpp::size_max];
+  uint8_t enc_buf[wcpp::size_max];
+  uint8_t dec_buf[wcpp::size_max];
+
+  wcpp::Packet p = buildTelemetry(buf, 0);
+  wcpp::Packet enc = wcpp::Packet::empty(enc_buf, wcpp::size_max);
+  wcpp::Packet dec = wcpp::Packet::empty(dec_buf, wcpp::size_max);
+  ASSERT_TRUE(encoder.encode(p, enc));
+  ASSERT_TRUE(decoder.decode(enc, dec));
+
+  p.append("Ex").setInt(7);
+  enc = wcpp::Packet::empty(enc_buf, wcpp::size_max);
+  dec = wcpp::Packet::empty(dec_buf, wcpp::size_max);
+  ASSERT_TRUE(encoder.encode(p, enc));
+  EXPECT_TRUE((*enc.begin()).name() == wcpp::delta_keyframe_name);
+  ASSERT_TRUE(decoder.decode(enc, dec));
+  expectSamePacket(dec, p);
+}
+
+TEST(DeltaTest, ExtremeInts) {
+  wcpp::StaticDeltaEncoder<2> encoder;
+  wcpp::StaticDeltaDecoder<2> decoder;
+
+  // The difference does not fit in int64_t
+  const int64_t values[] = {INT64_MAX, -((int64_t)1 << 50), INT64_MAX, -1};
+  for (int i = 0; i < 4; i++) {
+    uint8_t buf[wcpp::size_max];
+    uint8_t enc_buf[wcpp::size_max];
+    uint8_t dec_buf[wcpp::size_max];
+
+    wcpp::Packet p = buildTelemetry(buf, 0);
+    p.append("Bg").setInt(values[i]);
+    wcpp::Packet enc = wcpp::Packet::empty(enc_buf, wcpp::size_max);
+    wcpp::Packet dec = wcpp::Packet::empty(dec_buf, wcpp::size_max);
+    ASSERT_TRUE(encoder.encode(p, enc));
+    ASSERT_TRUE(decoder.decode(enc, dec));
+    expectSamePacket(dec, p);
+  }
+}
+
+TEST(DeltaTest, PlainPacket) {
+  wcpp::StaticDeltaDecoder<2> decoder;
+
+  uint8_t buf[wcpp::size_max];
+  uint8_t dec_buf[wcpp::size_max];
+  wcpp::Packet p = buildTelemetry(buf, 3);
+  wcpp::Packet dec = wcpp::Packet::empty(dec_buf, wcpp::size_max);
+  ASSERT_TRUE(decoder.decode(p, dec));
+  expectSamePacket(dec, p);
+
+  // Names like the markers are only markers in a frame
+  for (const char* first : {"@k", "@D", "@S"}) {
+    wcpp::Packet q = wcpp::Packet::empty(buf, wcpp::size_max);
+    q.telemetry(0x12, 0x34);
+    q.append(first).setInt(3);
+    q.append("Ct").setInt(5);
+    dec = wcpp::Packet::empty(dec_buf, wcpp::size_max);
+    ASSERT_TRUE(decoder.decode(q, dec));
+    expectSamePacket(dec, q);
+  }
+}
+
+TEST(DeltaTest, MarkerNames) {
+  wcpp::StaticDeltaEncoder<2> encoder(10, 0x70);
+  wcpp::StaticDeltaDecoder<2> decoder(0x70);
+
+  for (int i = 0; i < 4; i++) {
+    uint8_t buf[wcpp::size_max];
+    uint8_t enc_buf[wcpp::size_max];
+    uint8_t dec_buf[wcpp::size_max];
+
+    // Entries named like the markers, "@S" changing every frame
+    wcpp::Packet p = wcpp::Packet::empty(buf, wcpp::size_max);
+    p.telemetry(0x12, 0x34);
+    p.append("@k").setInt(7);
+    p.append("@D").setString("same");
+    p.append("@S").setInt(i);
+    p.append("Ct").setInt(i);
+    wcpp::Packet enc = wcpp::Packet::empty(enc_buf, wcpp::size_max);
+    wcpp::Packet dec = wcpp::Packet::empty(dec_buf, wcpp::size_max);
+    ASSERT_TRUE(encoder.encode(p, enc));
+    EXPECT_EQ(enc.packet_id(), 0x70);
+    ASSERT_TRUE(decoder.decode(enc, dec));
+    expectSamePacket(dec, p);
+  }
+
+  // Too large for a keyframe, so it goes as it is
+  uint8_t buf[wcpp::size_max];
+  uint8_t enc_buf[wcpp::size_max];
+  uint8_t dec_buf[wcpp::size_max];
+  uint8_t bytes[25] = {};
+  wcpp::Packet p = wcpp::Packet::empty(buf, wcpp::size_max);
+  p.telemetry(0x12, 0x34);
+  p.append("@K").setInt(1);
+  for (int i = 0; i < 8; i++) p.append("Bs").setBytes(bytes, sizeof(bytes));
+  while (p.size() + wcpp::entry_type_size <= wcpp::size_max) p.append("Nl").setNull();
+  wcpp::Packet enc = wcpp::Packet::empty(enc_buf, wcpp::size_max);
+  wcpp::Packet dec = wcpp::Packet::empty(dec_buf, wcpp::size_max);
+  ASSERT_TRUE(encoder.encode(p, enc));
+  EXPECT_EQ(enc.packet_id(), 0x12);
+  ASSERT_TRUE(decoder.decode(enc, dec));
+  expectSamePacket(dec, p);
+
+  // The reserved ID cannot be told from a frame
+  p = wcpp::Packet::empty(buf, wcpp::size_max);
+  p.telemetry(0x70, 0x34);
+  enc = wcpp::Packet::empty(enc_buf, wcpp::size_max);
+  EXPECT_FALSE(encoder.encode(p, enc));
+}
+
+#endif
@@ -0,0 +1,132 @@
+#include "fields.h"
+
+#ifndef ARDUINO
+
+#include <gtest/gtest.h>
+
+namespace {
+
+enum class Mode { idle, armed, flight };
+
+struct Gps {
+  double lat;
+  double lon;
+  int32_t alt;
+};
+
+struct Telemetry {
+  uint32_t count;
+  float ax;
+  float ay;
+  int16_t temp;
+  bool armed;
+  Mode mode;
+  std::string_view name;
+  Gps gps;
+};
+
+using namespace wcpp::literals;
+
+// Checked names and plain ones make the same fields
+constexpr auto gps_fields = wcpp::fields(
+  wcpp::field("La"_wn, &Gps::lat),
+  wcpp::field("Lo"_wn, &Gps::lon),
+  wcpp::field("Al"_wn, &Gps::alt));
+static_assert(wcpp::field("Al"_wn, &Gps::alt).key == wcpp::field("Al", &Gps::alt).key);
+
+constexpr auto telemetry_fields = wcpp::fields(
+  wcpp::field("Ct", &Telemetry::count),
+  wcpp::field("Ax", &Telemetry::ax),
+  wcpp::field("Ay", &Telemetry::ay),
+  wcpp::field("Tp", &Telemetry::temp),
+  wcpp::field("Ar", &Telemetry::armed),
+  wcpp::field("Md", &Telemetry::mode),
+  wcpp::field("Nm", &Telemetry::name),
+  wcpp::field("Gp", &Telemetry::gps, gps_fields));
+
+}
+
+TEST(VisitTest, BasicAssertions) {
+  uint8_t buf[128];
+  wcpp::Packet p = wcpp::Packet::empty(buf, 128);
+  p.telemetry(1, 2);
+  p.append("Nl").setNull();
+  p.append("Us").setInt(3);
+  p.append("Ul").setInt(100000);
+  p.append("Ng").setInt(-5);
+  p.append("Fh").setFloat16(1.5f);
+  p.append("Fs").setFloat32(2.5f);
+  p.append("Fz").setFloat32(0.0f);
+  p.append("Fd").setFloat64(3.25);
+  p.append("Bs").setString("abc");
+  auto st = p.append("St").setStruct();
+  st.append("Sx").setInt(1);
+
+  std::string log;
+  p.visit([&](const wcpp::Entry& e, const auto& value) {
+    using V = std::decay_t<decltype(value)>;
+    log += e.name()[0];
+    log += e.name()[1];
+    log += ':';
+    if constexpr (std::is_same_v<V, std::nullptr_t>) log += "null";
+    else if constexpr (std::is_same_v<V, uint64_t>) log += "u" + std::to_string(value);
+    else if constexpr (std::is_same_v<V, int64_t>) log += "i" + std::to_string(value);
+    else if constexpr (std::is_same_v<V, float16>) log += "h" + std::to_string((float)value);
+    else if constexpr (std::is_same_v<V, float>) log += "f" + std::to_string(value);
+    else if constexpr (std::is_same_v<V, double>) log += "d" + std::to_string(value);
+    else if constexpr (std::is_same_v<V, std::span<const uint8_t>>)
+      log += "b" + std::string((const char*)value.data(), value.size());
+    else if constexpr (std::is_same_v<V, wcpp::SubEntries>) log += "s" + std::to_string(value.size());
+    else log += "?";
+    log += ' ';
+  });
+  EXPECT_EQ(log, "Nl:null Us:u3 Ul:u100000 Ng:i-5 Fh:h1.500000 Fs:f2.500000 "
+                 "Fz:f0.000000 Fd:d3.250000 Bs:babc St:s3 ");
+}
+
+TEST(FieldsTest, BasicAssertions) {
+  Telemetry in{123456, 1.5f, -2.5f, -40, true, Mode::flight, "rocket",
+               {35.5, 139.25, 1200}};
+
+  uint8_t buf[128];
+  wcpp::Packet p = wcpp::Packet::empty(buf, 128);
+  p.telemetry(1, 2);
+  EXPECT_TRUE(telemetry_fields.encode(p, in));
+  EXPECT_EQ((*p.find("Ct")).getInt(), 123456);
+  EXPECT_EQ((*p.find("Nm")).getStringView(), "rocket");
+
+  Telemetry out{};
+  EXPECT_EQ(telemetry_fields.decode(p, out), telemetry_fields.all());
+  EXPECT_EQ(out.count, in.count);
+  EXPECT_EQ(out.ax, in.ax);
+  EXPECT_EQ(out.ay, in.ay);
+  EXPECT_EQ(out.temp, in.temp);
+  EXPECT_EQ(out.armed, in.armed);
+  EXPECT_EQ(out.mode, in.mode);
+  EXPECT_EQ(out.name, in.name);
+  EXPECT_EQ(out.gps.lat, in.gps.lat);
+  EXPECT_EQ(out.gps.lon, in.gps.lon);
+  EXPECT_EQ(out.gps.alt, in.gps.alt);
+
+  // Missing entries and mismatched types leave the member untouched
+  (*p.find("Ay")).remove();
+  (*p.find("Tp")).setString("x");
+  (*p.find("Ax")).setInt(7);
+  p.append("Zz").setInt(1);
+  Telemetry partial{};
+  partial.ay = 9.0f;
+  partial.temp = 3;
+  uint32_t found = telemetry_fields.decode(p, partial);
+  EXPECT_EQ(found, telemetry_fields.all() & ~0b1100u);
+  EXPECT_EQ(partial.ax, 7.0f);
+  EXPECT_EQ(partial.ay, 9.0f);
+  EXPECT_EQ(partial.temp, 3);
+
+  // Not enough room
+  uint8_t small[24];
+  wcpp::Packet q = wcpp::Packet::empty(small, sizeof(small));
+  q.telemetry(1, 2);
+  EXPECT_FALSE(telemetry_fields.encode(q, in));
+}
+
+#endif
@@ -0,0 +1,172 @@
+#include "format.h"
+
+#ifndef ARDUINO
+
+#include "deframer.h"
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <string>
+
+static wcpp::Packet nested(uint8_t* buf, uint8_t* inner_buf) {
+  wcpp::Packet inner = wcpp::Packet::empty(inner_buf, wcpp::size_max);
+  inner.command('C', 4);
+  inner.append("Md").setInt(2);
+
+  wcpp::Packet p = wcpp::Packet::empty(buf, wcpp::size_max);
+  p.telemetry('T', 2, 1, 5, 3);
+  p.append("Ax").setFloat32(1.5);
+  p.append("Ct").setInt(-7);
+  p.append("Nm").setString("abc");
+  wcpp::SubEntries gps = p.append("Gp").setStruct();
+  gps.append("La").setFloat64(35.25);
+  gps.append("Al").setFloat16(100);
+  p.append("Pk").setPacket(inner);
+  p.append("Nl").setNull();
+  return p;
+}
+
+TEST(FormatTest, Json) {
+  uint8_t buf[wcpp::size_max], inner[wcpp::size_max];
+  wcpp::Packet p = nested(buf, inner);
+
+  char out[512];
+  size_t n = wcpp::format(p, out, sizeof(out));
+  EXPECT_EQ(std::string(out),
+            "{\"type\":\"tlm\",\"id\":84,\"comp\":2,\"from\":1,\"to\":5,\"seq\":3,"
+            "\"Ax\":1.5,\"Ct\":-7,\"Nm\":\"abc\",\"Gp\":{\"La\":35.25,\"Al\":100.0},"
+            "\"Pk\":{\"type\":\"cmd\",\"id\":67,\"comp\":4,\"Md\":2},\"Nl\":null}");
+  EXPECT_EQ(n, strlen(out));
+}
+
+TEST(FormatTest, Text) {
+  uint8_t buf[wcpp::size_max], inner[wcpp::size_max];
+  wcpp::Packet p = nested(buf, inner);
+
+  char out[512];
+  wcpp::format(p, out, sizeof(out), wcpp::TextStyle::text);
+  EXPECT_EQ(std::string(out),
+            "[tlm id=84 comp=2 from=1 to=5 seq=3 Ax=1.5 Ct=-7 Nm=\"abc\" "
+            "Gp={La=35.25 Al=100.0} Pk=[cmd id=67 comp=4 Md=2] Nl=null]");
+}
+
+TEST(FormatTest, Escapes) {
+  uint8_t buf[wcpp::size_max];
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+  p.telemetry('T', 2);
+  p.append("Bs").setBytes((const uint8_t*)"a\"\\\n\x01\xff", 6);
+  p.append("Nn").setFloat32(NAN);
+  p.append("If").setFloat64(INFINITY);
+
+  char out[256];
+  wcpp::format(p, out, sizeof(out));
+  EXPECT_EQ(std::string(out),
+            "{\"type\":\"tlm\",\"id\":84,\"comp\":2,"
+            "\"Bs\":\"a\\\"\\\\\\n\\u0001\\u00ff\",\"Nn\":null,\"If\":null}");
+
+  wcpp::format(p, out, sizeof(out), wcpp::TextStyle::text);
+  EXPECT_EQ(std::string(out),
+            "[tlm id=84 comp=2 Bs=\"a\\\"\\\\\\n\\x01\\xff\" Nn=null If=null]");
+}
+
+TEST(FormatTest, Truncated) {
+  uint8_t buf[wcpp::size_max], inner[wcpp::size_max];
+  wcpp::Packet p = nested(buf, inner);
+
+  char out[32];
+  EXPECT_EQ(wcpp::format(p, out, sizeof(out)), 0u);
+  EXPECT_EQ(out[0], '\0');
+
+  wcpp::Formatter f(out, sizeof(out));
+  EXPECT_FALSE(f.write(p));
+  EXPECT_TRUE(f.truncated());
+  EXPECT_LE(f.length(), sizeof(out));
+  EXPECT_FALSE(f.write(wcpp::Packet::null()));
+  f.clear();
+  EXPECT_TRUE(f.write(wcpp::Packet::null()));
+  EXPECT_EQ(std::string(f.data(), f.length()), "null");
+}
+
+TEST(FormatTest, Stream) {
+  uint8_t buf[wcpp::size_max], inner[wcpp::size_max];
+  wcpp::Packet p = nested(buf, inner);
+
+  char expected[512];
+  size_t n = wcpp::format(p, expected, sizeof(expected));
+
+  // A buffer much smaller than a line still writes it whole
+  FILE* file = tmpfile();
+  char small[32];
+  wcpp::Formatter f(small, sizeof(small), file);
+  for (int i = 0; i < 3; i++) EXPECT_TRUE(f.writeLine(p));
+  EXPECT_TRUE(f.flush());
+  EXPECT_FALSE(f.truncated());
+
+  rewind(file);
+  char line[512];
+  for (int i = 0; i < 3; i++) {
+    ASSERT_NE(fgets(line, sizeof(line), file), nullptr);
+    EXPECT_EQ(std::string(line), std::string(expected, n) + "\n");
+  }
+  fclose(file);
+}
+
+TEST(FormatTest, ConvertFramed) {
+  FILE* in = tmpfile();
+  for (int i = 0; i < 1000; i++) {
+    uint8_t buf[64], f[64];
+    wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+    p.telemetry('T', 2);
+    p.append("Ct").setInt(i);
+    // Garbage between frames is skipped
+    if (i == 500) fwrite("\x07\x01\x02\x00", 1, 4, in);
+    fwrite(f, 1, wcpp::frame(p, f), in);
+  }
+  fwrite("\x05\x01\x02", 1, 3, in);
+  rewind(in);
+
+  FILE* out = tmpfile();
+  EXPECT_EQ(wcpp::convertLog(in, out, wcpp::LogFormat::framed), 1000u);
+  rewind(out);
+  char line[128];
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_NE(fgets(line, sizeof(line), out), nullptr);
+    EXPECT_EQ(std::string(line),
+              "{\"type\":\"tlm\",\"id\":84,\"comp\":2,\"Ct\":" + std::to_string(i) + "}\n");
+  }
+  EXPECT_EQ(fgets(line, sizeof(line), out), nullptr);
+  fclose(in);
+  fclose(out);
+}
+
+TEST(FormatTest, ConvertTimed) {
+  FILE* in = tmpfile();
+  for (uint32_t i = 0; i < 1000; i++) {
+    uint8_t buf[64];
+    wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+    p.command('C', 3);
+    p.append("Xv").setFloat16(0.5);
+    uint32_t time = 1000 * i;
+    uint8_t size = p.size();
+    fwrite(&time, 4, 1, in);
+    fwrite(&size, 1, 1, in);
+    fwrite(buf, 1, size, in);
+  }
+  // A record cut short at the end of the file
+  fwrite("\x01\x00\x00\x00\x20\x20", 1, 6, in);
+  rewind(in);
+
+  FILE* out = tmpfile();
+  EXPECT_EQ(wcpp::convertLog(in, out, wcpp::LogFormat::timed, wcpp::TextStyle::text), 1000u);
+  rewind(out);
+  char line[128];
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_NE(fgets(line, sizeof(line), out), nullptr);
+    EXPECT_EQ(std::string(line), "t=" + std::to_string(1000 * i) + " cmd id=67 comp=3 Xv=0.5\n");
+  }
+  EXPECT_EQ(fgets(line, sizeof(line), out), nullptr);
+  fclose(in);
+  fclose(out);
+}
+
+#endif
@@ -0,0 +1,230 @@
+#include "gateway.h"
+#include "link.h"
+
+#ifndef ARDUINO
+
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct Peer {
+  int fd;
+
+  Peer(uint16_t gateway_port) : fd(wcpp::openUdp(0, "127.0.0.1", gateway_port)) {}
+  ~Peer() { if (fd >= 0) close(fd); }
+
+  void send(const wcpp::Packet& p) {
+    uint8_t buf[wcpp::size_max + wcpp::frame_overhead];
+    ASSERT_EQ(::send(fd, buf, wcpp::frame(p, buf), 0), (ssize_t)p.size() + wcpp::frame_overhead);
+  }
+
+  void subscribe(int component_id) {
+    uint8_t buf[32];
+    wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+    p.command(wcpp::gateway_subscribe, 0);
+    if (component_id >= 0) p.append("Cp").setInt(component_id);
+    send(p);
+  }
+
+  // Counters of every packet received so far
+  std::vector<int> receive() {
+    std::vector<int> got;
+    uint8_t buf[2048];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+      wcpp::Deframer d;
+      for (ssize_t i = 0; i < n; i++) {
+        if (d.put(buf[i])) got.push_back((*d.packet().find("Ct")).getInt());
+      }
+    }
+    return got;
+  }
+};
+
+void writeFrames(int fd, int count, uint8_t component_id, int first = 0) {
+  std::vector<uint8_t> stream;
+  for (int i = first; i < first + count; i++) {
+    uint8_t buf[32];
+    wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+    p.telemetry('T', component_id);
+    p.append("Ct").setInt(i);
+    uint8_t framed[32 + wcpp::frame_overhead];
+    uint16_t len = wcpp::frame(p, framed);
+    stream.insert(stream.end(), framed, framed + len);
+  }
+  ASSERT_EQ(write(fd, stream.data(), stream.size()), (ssize_t)stream.size());
+}
+
+void spin(wcpp::Gateway& gateway, int rounds = 20) {
+  for (int i = 0; i < rounds; i++) ASSERT_TRUE(gateway.runOnce(5));
+}
+
+} // namespace
+
+TEST(GatewayTest, FilteredFanOut) {
+  static wcpp::StaticPacketPool<256> pool;
+  int udp_fd = wcpp::openUdp(0);
+  uint16_t port = wcpp::localPort(udp_fd);
+  wcpp::Gateway gateway(pool, udp_fd);
+  ASSERT_TRUE(gateway.isValid());
+
+  int fds[2];
+  ASSERT_TRUE(wcpp::openPair(fds));
+  ASSERT_TRUE(gateway.addSource(fds[0]));
+
+  Peer all(port), one(port), two(port);
+  all.subscribe(-1);
+  one.subscribe(1);
+  two.subscribe(2);
+  spin(gateway);
+  EXPECT_EQ(gateway.clients(), 3u);
+
+  writeFrames(fds[1], 10, 1, 0);
+  writeFrames(fds[1], 10, 2, 10);
+  spin(gateway);
+
+  std::vector<int> got = all.receive();
+  ASSERT_EQ(got.size(), 20u);
+  for (int i = 0; i < 20; i++) EXPECT_EQ(got[i], i);
+  got = one.receive();
+  ASSERT_EQ(got.size(), 10u);
+  EXPECT_EQ(got.front(), 0);
+  got = two.receive();
+  ASSERT_EQ(got.size(), 10u);
+  EXPECT_EQ(got.front(), 10);
+  EXPECT_EQ(gateway.sourceAt(0).received, 20u);
+
+  // Everything sent, so every buffer is back
+  EXPECT_EQ(pool.available(), pool.count());
+
+  uint8_t buf[32];
+  wcpp::Packet bye = wcpp::Packet::empty(buf, sizeof(buf));
+  bye.command(wcpp::gateway_unsubscribe, 0);
+  two.send(bye);
+  spin(gateway);
+  EXPECT_EQ(gateway.clients(), 2u);
+
+  // Uplinking after leaving does not subscribe again, 'S' does
+  wcpp::Packet command = wcpp::Packet::empty(buf, sizeof(buf));
+  command.command('C', 3, 1, 2, 7);
+  two.send(command);
+  spin(gateway);
+  EXPECT_EQ(gateway.clients(), 2u);
+  two.subscribe(2);
+  spin(gateway);
+  EXPECT_EQ(gateway.clients(), 3u);
+
+  close(fds[1]);
+}
+
+TEST(GatewayTest, Uplink) {
+  static wcpp::StaticPacketPool<16> pool;
+  int udp_fd = wcpp::openUdp(0);
+  uint16_t port = wcpp::localPort(udp_fd);
+  wcpp::Gateway gateway(pool, udp_fd);
+
+  int fds[2];
+  ASSERT_TRUE(wcpp::openPair(fds));
+  ASSERT_TRUE(gateway.addSource(fds[0]));
+
+  Peer ground(port);
+  uint8_t buf[32];
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+  p.command('C', 3, 1, 2, 7);
+  p.append("Ct").setInt(42);
+  ground.send(p);
+  spin(gateway);
+  EXPECT_EQ(gateway.uplinked(), 1u);
+
+  uint8_t rx[64];
+  ssize_t n = read(fds[1], rx, sizeof(rx));
+  ASSERT_GT(n, 0);
+  wcpp::Deframer d;
+  bool ready = false;
+  for (ssize_t i = 0; i < n; i++) ready = d.put(rx[i]) || ready;
+  ASSERT_TRUE(ready);
+  EXPECT_EQ(d.packet().sequence(), 7);
+  EXPECT_EQ((*d.packet().find("Ct")).getInt(), 42);
+
+  // The sender registered as a catch-all client
+  EXPECT_EQ(gateway.clients(), 1u);
+  close(fds[1]);
+}
+
+TEST(GatewayTest, QueueFull) {
+  static wcpp::StaticPacketPool<512> pool;
+  int udp_fd = wcpp::openUdp(0);
+  wcpp::Gateway gateway(pool, udp_fd, 8);
+
+  // The client is never read, so the gateway only sees what fits its queue
+  // per round; publish() past the capacity drops
+  sockaddr_in addr;
+  ASSERT_TRUE(wcpp::parseAddress("127.0.0.1", 9, addr));
+  ASSERT_NE(gateway.addClient(addr), nullptr);
+
+  for (int i = 0; i < 20; i++) {
+    uint8_t buf[32];
+    wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+    p.telemetry('T', 1);
+    p.append("Ct").setInt(i);
+    gateway.publish(p);
+  }
+  EXPECT_EQ(gateway.clientAt(0).dropped(), 12u);
+  EXPECT_EQ(pool.available(), pool.count() - 8);
+
+  spin(gateway, 2);
+  EXPECT_EQ(gateway.clientAt(0).sent, 8u);
+  EXPECT_EQ(pool.available(), pool.count());
+}
+
+TEST(GatewayTest, ClientsReused) {
+  static wcpp::StaticPacketPool<64> pool;
+  int udp_fd = wcpp::openUdp(0);
+  wcpp::Gateway gateway(pool, udp_fd, 4);
+
+  // Far more clients over time than the bus has subscribers
+  for (unsigned i = 0; i < 3 * wcpp::Gateway::clients_max; i++) {
+    sockaddr_in addr;
+    ASSERT_TRUE(wcpp::parseAddress("127.0.0.1", 10000 + i, addr));
+    ASSERT_NE(gateway.addClient(addr), nullptr);
+    EXPECT_EQ(gateway.clientAt(0).dropped(), 0u);
+    for (int j = 0; j < 6; j++) {
+      uint8_t buf[32];
+      wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+      p.telemetry('T', 1);
+      p.append("Ct").setInt(j);
+      gateway.publish(p);
+    }
+    EXPECT_EQ(gateway.clientAt(0).dropped(), 2u);
+    gateway.removeClient(addr);
+    EXPECT_EQ(pool.available(), pool.count());
+  }
+}
+
+TEST(GatewayTest, PoolExhausted) {
+  static wcpp::StaticPacketPool<4> pool;
+  int udp_fd = wcpp::openUdp(0);
+  uint16_t port = wcpp::localPort(udp_fd);
+  wcpp::Gateway gateway(pool, udp_fd);
+
+  int fds[2];
+  ASSERT_TRUE(wcpp::openPair(fds));
+  ASSERT_TRUE(gateway.addSource(fds[0]));
+  Peer client(port);
+  client.subscribe(-1);
+  spin(gateway);
+
+  // Far more than the pool holds at once, none lost since the source waits
+  writeFrames(fds[1], 100, 1);
+  spin(gateway, 200);
+  std::vector<int> got = client.receive();
+  ASSERT_EQ(got.size(), 100u);
+  for (int i = 0; i < 100; i++) EXPECT_EQ(got[i], i);
+  EXPECT_EQ(gateway.sourceAt(0).dropped, 0u);
+  close(fds[1]);
+}
+
+#endif
@@ -0,0 +1,56 @@
+#include "histogram.h"
+
+#ifndef ARDUINO
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+TEST(HistogramTest, Buckets) {
+  using H = wcpp::LatencyHistogram;
+  for (uint64_t v = 0; v < 100000; v++) {
+    unsigned b = H::bucket(v);
+    ASSERT_LT(b, H::buckets);
+    EXPECT_GE(H::highest(b), v);
+    // The bucket below ends below the value
+    if (b > 0) {
+      EXPECT_LT(H::highest(b - 1), v);
+    }
+  }
+  EXPECT_EQ(H::bucket(UINT64_MAX), H::buckets - 1);
+  EXPECT_EQ(H::highest(H::buckets - 1), UINT64_MAX);
+}
+
+TEST(HistogramTest, Percentiles) {
+  wcpp::LatencyHistogram h;
+  EXPECT_EQ(h.percentile(0.5), 0u);
+
+  std::mt19937_64 rand(1);
+  std::lognormal_distribution<double> latency(9, 1);
+  std::vector<uint64_t> values;
+  for (int i = 0; i < 100000; i++) {
+    values.push_back(latency(rand));
+    h.record(values.back());
+  }
+  std::sort(values.begin(), values.end());
+  EXPECT_EQ(h.count(), values.size());
+  EXPECT_EQ(h.max(), values.back());
+  EXPECT_EQ(h.percentile(1.0), values.back());
+  for (double q : {0.01, 0.5, 0.9, 0.99, 0.999}) {
+    double exact = values[(size_t)(q * values.size()) - 1];
+    EXPECT_GE(h.percentile(q), exact) << q;
+    EXPECT_LE(h.percentile(q), exact * (1 + 1.0 / 16)) << q;
+  }
+
+  wcpp::LatencyHistogram other;
+  other.record(1);
+  other.record(values.back() + 1);
+  h.merge(other);
+  EXPECT_EQ(h.count(), values.size() + 2);
+  EXPECT_EQ(h.max(), values.back() + 1);
+  h.reset();
+  EXPECT_EQ(h.count(), 0u);
+}
+
+#endif
@@ -0,0 +1,86 @@
+#include "packet.h"
+
+#ifndef ARDUINO
+
+#include <gtest/gtest.h>
+
+TEST(InstrumentTest, Counters) {
+  uint8_t buf[32];
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+  p.telemetry(1, 2);
+
+  wcpp::instrument::reset();
+  wcpp::instrument::Counters c = wcpp::instrument::snapshot();
+  EXPECT_EQ(c.packet_resize, 0);
+
+  p.append("Aa").setInt(1);      // insert only, no payload
+  p.append("Bb").setInt(1000);   // insert + setSize, no bytes after
+  p.begin().insert("Cc");        // moves 2 entries (6 bytes)
+
+  auto st = p.append("Sb").setStruct();
+  st.append("Xx").setInt(1);
+
+  c = wcpp::instrument::snapshot();
+  EXPECT_EQ(c.sub_entries_resize, 1);
+  EXPECT_EQ(c.packet_resize, 7);
+  EXPECT_EQ(c.resize_failed, 0);
+  EXPECT_EQ(c.memmove_bytes, 6);
+
+  uint8_t bytes[32] = {};
+  EXPECT_FALSE(p.append("Dd").setBytes(bytes, 20));
+  c = wcpp::instrument::snapshot();
+  EXPECT_EQ(c.resize_failed, 1);
+
+  wcpp::instrument::reset();
+  p.find("Bb");
+  p.at(2);
+  p.checksum();
+  c = wcpp::instrument::snapshot();
+  EXPECT_EQ(c.iterator_steps, 4);
+  EXPECT_EQ(c.checksum_bytes, p.size());
+}
+
+TEST(InstrumentTest, StructEdit) {
+  uint8_t buf[64];
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+  p.telemetry(1, 2);
+  auto a = p.append("Sa").setStruct();
+  auto b = a.append("Sb").setStruct();
+  p.append("Ax").setInt(1000);
+  p.append("Ay").setInt(2000);  // 8 bytes after the structs
+
+  wcpp::instrument::reset();
+  {
+    wcpp::StructEdit edit(b);
+    edit.append("Bx").setInt(1);
+    edit.append("By").setInt(1000);
+    edit.begin().insert("Bz");   // moves 2 entries (6 bytes)
+  }
+  wcpp::instrument::Counters c = wcpp::instrument::snapshot();
+  EXPECT_EQ(c.packet_resize, 0);
+  EXPECT_EQ(c.sub_entries_resize, 4);
+  EXPECT_EQ(c.memmove_bytes, 8 + 6 + 8);
+  EXPECT_EQ(a.size(), 1 + 2 + 1 + 2 + 4 + 2);
+  EXPECT_EQ((*p.find("Ay")).getInt(), 2000);
+}
+
+TEST(InstrumentTest, FixedWidth) {
+  uint8_t buf[32];
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+  p.telemetry(1, 2);
+  wcpp::Entry ct = p.append("Ct");
+  ct.setInt(0, 4);
+  wcpp::Entry ax = p.append("Ax");
+  ax.setFloat32(0.0f, true);
+
+  wcpp::instrument::reset();
+  for (int i = 0; i < 100; i++) {
+    ct.setInt(i, 4);
+    ax.setFloat32(i * 0.1f, true);
+  }
+  wcpp::instrument::Counters c = wcpp::instrument::snapshot();
+  EXPECT_EQ(c.packet_resize, 0);
+  EXPECT_EQ(c.memmove_bytes, 0);
+}
+
+#endif
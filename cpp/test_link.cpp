@@ -0,0 +1,126 @@
+#include "link.h"
+
+#ifndef ARDUINO
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <vector>
+
+static wcpp::Task sender(wcpp::Link& link, int count, int& sent) {
+  uint8_t buf[64];
+  for (int i = 0; i < count; i++) {
+    wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+    p.telemetry(i % 128, 2);
+    p.append("Ct").setInt(i);
+    if (co_await link.send(p)) sent++;
+  }
+}
+
+static wcpp::Task receiver(wcpp::Link& link, int count, std::vector<int>& got) {
+  while ((int)got.size() < count) {
+    wcpp::Packet p = co_await link.receive();
+    if (p.isNull()) break;
+    got.push_back((*p.find("Ct")).getInt());
+  }
+}
+
+static wcpp::Task echo(wcpp::Link& link, int count) {
+  for (int i = 0; i < count; i++) {
+    wcpp::Packet p = co_await link.receive();
+    if (p.isNull()) break;
+    uint8_t buf[wcpp::size_max];
+    wcpp::Packet reply = wcpp::Packet::empty(buf, wcpp::size_max);
+    reply.copyHeader(p);
+    reply.copyPayload(p);
+    reply.append("Ec").setInt(1);
+    co_await link.send(reply);
+  }
+}
+
+static void expectSequence(const std::vector<int>& got, int count) {
+  ASSERT_EQ((int)got.size(), count);
+  for (int i = 0; i < count; i++) EXPECT_EQ(got[i], i);
+}
+
+TEST(LinkTest, SocketPair) {
+  wcpp::EventLoop loop;
+  ASSERT_TRUE(loop.isValid());
+  int fds[2];
+  ASSERT_TRUE(wcpp::openPair(fds));
+  wcpp::Link a(loop, fds[0]);
+  wcpp::Link b(loop, fds[1]);
+
+  // More than the socket buffer holds, so the sender has to wait
+  const int count = 20000;
+  int sent = 0;
+  std::vector<int> got;
+  receiver(b, count, got);
+  sender(a, count, sent);
+  loop.run();
+
+  EXPECT_EQ(sent, count);
+  expectSequence(got, count);
+  EXPECT_EQ(b.deframer().errors(), 0);
+}
+
+TEST(LinkTest, Closed) {
+  wcpp::EventLoop loop;
+  int fds[2];
+  ASSERT_TRUE(wcpp::openPair(fds));
+  wcpp::Link b(loop, fds[1]);
+  std::vector<int> got;
+  {
+    wcpp::Link a(loop, fds[0]);
+    int sent = 0;
+    sender(a, 3, sent);
+  }
+  receiver(b, 10, got);
+  loop.run();
+  EXPECT_EQ(got.size(), 3);
+  EXPECT_TRUE(b.isClosed());
+}
+
+TEST(LinkTest, Udp) {
+  wcpp::EventLoop loop;
+  int server_fd = wcpp::openUdp(0);
+  ASSERT_GE(server_fd, 0);
+  uint16_t port = wcpp::localPort(server_fd);
+  wcpp::Link server(loop, server_fd, true);
+  wcpp::Link client(loop, wcpp::openUdp(0, "127.0.0.1", port), true);
+  ASSERT_TRUE(client.isValid());
+
+  // The server replies to whoever sent the last datagram
+  const int count = 200;
+  int sent = 0;
+  std::vector<int> got;
+  echo(server, count);
+  receiver(client, count, got);
+  sender(client, count, sent);
+  loop.run();
+
+  EXPECT_EQ(sent, count);
+  expectSequence(got, count);
+}
+
+TEST(LinkTest, Pty) {
+  wcpp::EventLoop loop;
+  char path[64];
+  int master_fd = wcpp::openPty(path, sizeof(path));
+  ASSERT_GE(master_fd, 0);
+  wcpp::Link master(loop, master_fd);
+  wcpp::Link serial(loop, wcpp::openSerial(path, 115200));
+  ASSERT_TRUE(serial.isValid());
+  EXPECT_EQ(wcpp::openSerial(path, 12345), -1);
+
+  const int count = 1000;
+  int sent = 0;
+  std::vector<int> got;
+  receiver(master, count, got);
+  sender(serial, count, sent);
+  loop.run();
+
+  EXPECT_EQ(sent, count);
+  expectSequence(got, count);
+}
+
+#endif
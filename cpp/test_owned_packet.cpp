@@ -0,0 +1,71 @@
+#include "owned_packet.h"
+
+#ifndef ARDUINO
+
+#include <gtest/gtest.h>
+#include <vector>
+
+TEST(OwnedPacketTest, BasicAssertions) {
+  wcpp::OwnedPacket<> p;
+  EXPECT_FALSE(p.isNull());
+  EXPECT_EQ(p.size(), 0);
+  p.telemetry(1, 2, 3, 4, 5);
+  p.append("Ax").setInt(1000);
+  p.append("Nm").setString("abcdefghijk");
+
+  // Copies are independent
+  wcpp::OwnedPacket<> q = p;
+  (*q.find("Ax")).setInt(2000);
+  EXPECT_EQ((*p.find("Ax")).getInt(), 1000);
+  EXPECT_EQ((*q.find("Ax")).getInt(), 2000);
+  EXPECT_NE(q.getBuf(), p.getBuf());
+
+  // Views of an owned packet
+  const wcpp::Packet view = q.view();
+  EXPECT_EQ(view.sequence(), 5);
+  wcpp::Packet copy = view;
+  EXPECT_EQ(copy.getBuf(), q.getBuf());
+  // Rebinding a view leaves the owned packet alone
+  copy = p.view();
+  EXPECT_EQ(q.view().getBuf(), q.getBuf());
+  EXPECT_EQ((*q.find("Ax")).getInt(), 2000);
+  // A view can be published or copied like any Packet
+  wcpp::OwnedPacket<> r(q.view());
+  EXPECT_EQ((*r.find("Ax")).getInt(), 2000);
+
+  // From a view
+  uint8_t buf[32];
+  wcpp::Packet v = wcpp::Packet::empty(buf, sizeof(buf));
+  v.command(7, 8);
+  v.append("Cm").setInt(1);
+  wcpp::OwnedPacket<16> small(v);
+  EXPECT_EQ(small.size(), v.size());
+  EXPECT_EQ(small.packet_id(), 7);
+  EXPECT_EQ(small.checksum(), v.checksum());
+
+  // Too large for the buffer
+  small = p;
+  EXPECT_EQ(small.size(), 0);
+  small = v;
+  EXPECT_EQ((*small.find("Cm")).getInt(), 1);
+  EXPECT_EQ(small.size_remain(), 16 - v.size());
+}
+
+TEST(OwnedPacketTest, Vector) {
+  std::vector<wcpp::OwnedPacket<64>> packets;
+  for (int i = 0; i < 100; i++) {
+    wcpp::OwnedPacket<64> p;
+    p.telemetry(i % 128, 2);
+    p.append("Ct").setInt(i);
+    packets.push_back(std::move(p));
+  }
+  packets.erase(packets.begin());
+  for (int i = 0; i < 99; i++) {
+    EXPECT_EQ(packets[i].packet_id(), i + 1);
+    EXPECT_EQ((*packets[i].find("Ct")).getInt(), i + 1);
+    EXPECT_GE(packets[i].getBuf(), (const uint8_t*)&packets[i]);
+    EXPECT_LT(packets[i].getBuf(), (const uint8_t*)(packets.data() + i + 1));
+  }
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include "float16.h"
 #include "packet.h"
+#include "random_packet.h"
 
 #ifndef ARDUINO
 
@@ -11,139 +12,9 @@
 #include <random>
 
 
-class RandomSequence {
-public:
-  class iterator {
-  public:
-    iterator(RandomSequence& sequence_): sequence_(sequence_), i_(-1) {
-      ++(*this);
-    }
-    iterator(const iterator& it): sequence_(it.sequence_), i_(it.i_) {}
-    uint64_t operator*() const { 
-      return sequence_.history_.at(i_);
-    }
-    uint64_t operator()() { 
-      uint64_t rand(**this);
-      ++(*this);
-      return rand;
-    }
-    iterator& operator++() {
-      i_++;
-      while (i_ >= sequence_.history_.size()) {
-        sequence_.history_.push_back(sequence_.engine_());
-      }
-      return *this;
-    }
-    iterator& operator=(const iterator& it) {
-      sequence_ = it.sequence_;
-      i_ = it.i_;
-      return *this;
-    }
-    iterator next() {
-      iterator n(*this);
-      ++n;
-      return n;
-    }
-    iterator& reroll() {
-      sequence_.history_.erase(std::next(sequence_.history_.begin(), i_), sequence_.history_.end());
-      sequence_.history_.push_back(sequence_.engine_());
-      return *this;
-    }
-  // private:
-    RandomSequence& sequence_;
-    int i_;
-  };
-
-  RandomSequence(uint64_t seed): engine_(seed) {}
-  iterator begin() { return iterator(*this); }
-
-private:
-  std::vector<uint64_t> history_;
-  std::mt19937_64 engine_;
-};
-
-
-wcpp::Packet generateRandomPacket(uint8_t* buf, RandomSequence::iterator& rand);
-// bool appendRandomEntry_(wcpp::Entries& p, RandomSequence::iterator rand);
 void assertRandomPacket(const wcpp::Packet& p, RandomSequence::iterator& rand);
 void assertRandomEntry(wcpp::EntriesConstIterator e, RandomSequence::iterator& rand);
 
-bool appendRandomEntry(wcpp::Entries& p, RandomSequence::iterator& rand) {
-  char name[] = {(char)(rand()%32 + 64), (char)(rand()%32 + 96)};
-
-  wcpp::Entry e = p.append(name);
-
-  unsigned type = rand() % 13;
-  // printf("NAME %c%c %d %d %d %d\n", name[0], name[1], p.size_remain(), p.size(), type, bool(e));
-  // if (p.size_remain() <= 0) return false;
-
-  if (!e) return false;
-
-  switch (type) {
-    case 0:
-      return true;
-    case 1:
-      return e.setNull();
-    case 2:
-      return e.setInt(rand()%32);
-    case 3: {
-      long v = (long)(rand()%512) - 256;
-      return e.setInt(v);
-    }
-    case 4:
-      return e.setInt((long)rand() - 0x80000000);
-    case 5:
-      return e.setInt((long)rand() * ((long)rand()-0x80000000));
-    case 6:
-      return e.setFloat16((float)rand()/(float)((long)rand()-0x80000000));
-    case 7:
-      return e.setFloat32((float)rand()/(float)((long)rand()-0x80000000));
-    case 8: {
-      return e.setFloat64((double)rand()/(double)((long)rand()-0x80000000));
-    }
-    case 9: {
-      uint8_t bytes[64];
-      int len = rand() % 64;
-      for (int i = 0; i < len; i++) {
-        bytes[i] = rand();
-      }
-      return e.setBytes(bytes, len);
-    }
-    case 10: {
-      char str[65];
-      int len = rand() % 64;
-      for (int i = 0; i < len; i++) {
-        str[i] = rand()%127 + 1;
-      }
-      str[len] = 0; 
-      return e.setString(str);
-    }
-    case 11: {
-      auto sub = e.setStruct();
-      if (e.size() < 1) return false;
-      auto r = rand;
-      auto s = sub.begin();
-      while (rand() % 8) {
-        if (!appendRandomEntry(sub, rand)) {
-          rand = r.reroll();
-          (*s).remove();
-        }
-        else ++s;
-        r = rand; 
-      }
-      return true;
-    }
-    case 12: {
-      uint8_t sub_buf[255];
-      memset(sub_buf, 0, 255);
-      if (p.size_remain() < 7) return false;
-      wcpp::Packet sp = generateRandomPacket(sub_buf, rand);
-      return e.setPacket(sp); 
-    }
-  }
-  return false;
-}
-
 void assertRandomEntry(wcpp::EntriesConstIterator e, RandomSequence::iterator& rand) {
   char name[] = {(char)(rand()%32 + 64), (char)(rand()%32 + 96)};
 
@@ -173,25 +44,33 @@ void assertRandomEntry(wcpp::EntriesConstIterator e, RandomSequence::iterator& r
     }
     case 5: {
       EXPECT_TRUE((*e).isInt());
-      EXPECT_EQ((*e).getInt(), (long)rand() * ((long)rand()-0x80000000));
+      uint64_t a = rand();
+      uint64_t b = rand();
+      EXPECT_EQ((*e).getInt(), (long)(a * (uint64_t)((long)b-0x80000000)));
       break;
     }
     case 6: {
       EXPECT_TRUE((*e).isFloat());
       EXPECT_TRUE((*e).isFloat16());
-      EXPECT_EQ((*e).getFloat16(), float16((float)rand()/(float)((long)rand()-0x80000000)));
+      uint64_t a = rand();
+      uint64_t b = rand();
+      EXPECT_EQ((*e).getFloat16(), float16((float)a/(float)((long)b-0x80000000)));
       break;
     }
     case 7: {
       EXPECT_TRUE((*e).isFloat());
       EXPECT_TRUE((*e).isFloat32());
-      EXPECT_EQ((*e).getFloat32(), (float)rand()/(float)((long)rand()-0x80000000));
+      uint64_t a = rand();
+      uint64_t b = rand();
+      EXPECT_EQ((*e).getFloat32(), (float)a/(float)((long)b-0x80000000));
       break;
     }
     case 8: {
       EXPECT_TRUE((*e).isFloat());
       EXPECT_TRUE((*e).isFloat64());
-      EXPECT_EQ((*e).getFloat64(), (double)rand()/(double)((long)rand()-0x80000000));
+      uint64_t a = rand();
+      uint64_t b = rand();
+      EXPECT_EQ((*e).getFloat64(), (double)a/(double)((long)b-0x80000000));
       break;
     }
     case 9: {
@@ -240,37 +119,6 @@ void assertRandomEntry(wcpp::EntriesConstIterator e, RandomSequence::iterator& r
   }
 }
 
-wcpp::Packet generateRandomPacket(uint8_t* buf, RandomSequence::iterator& rand) {
-  wcpp::Packet p = wcpp::Packet::empty(buf, wcpp::size_max);
-  switch (rand()%4) {
-  case 0:
-    p.command(rand()%128, rand()%256);
-    break;
-  case 1:
-    p.command(rand()%128, rand()%256, rand()%255+1, rand()%255+1, rand()%65536);
-    break;
-  case 2:
-    p.telemetry(rand()%128, rand()%256);
-    break;
-  case 3:
-    p.telemetry(rand()%128, rand()%256, rand()%255+1, rand()%255+1, rand()%65536);
-    break;
-  }
-
-  auto r = rand;
-  auto e = p.begin();
-  while (rand() % 8) {
-    if (!appendRandomEntry(p, rand)) {
-      rand = r.reroll();
-      (*e).remove();
-    }
-    else ++e;
-    r = rand; 
-  }
-
-  return p;
-}
-
 void assertRandomPacket(const wcpp::Packet& p, RandomSequence::iterator& rand) {
   switch (rand()%4) {
   case 0:
@@ -515,5 +363,281 @@ TEST(PacketTest, BasicAssertions) {
   fout.close();
 }
 
+TEST(ClearTest, BasicAssertions) {
+  uint8_t buf[64];
+  wcpp::Packet p = wcpp::Packet::empty(buf, 64);
+  p.telemetry(1, 2, 3, 4, 5);
+  p.append("Ax").setInt(1000);
+  auto st = p.append("St").setStruct();
+  st.append("Sx").setInt(1);
+  st.append("Sy").setFloat32(1.5f);
+  p.append("Ay").setInt(-1000);
+
+  uint8_t size = p.size();
+  st.clear();
+  EXPECT_EQ(st.size(), 1);
+  EXPECT_EQ(p.size(), size - 8);
+  EXPECT_EQ(st.begin(), st.end());
+  auto e = p.find("Ay");
+  EXPECT_NE(e, p.end());
+  EXPECT_EQ((*e).getInt(), -1000);
+
+  p.clear();
+  EXPECT_EQ(p.size(), 7);
+  EXPECT_EQ(p.begin(), p.end());
+  EXPECT_TRUE(p.isRemote());
+  EXPECT_EQ(p.sequence(), 5);
+
+  p.clear();
+  EXPECT_EQ(p.size(), 7);
+}
+
+TEST(StructEditTest, BasicAssertions) {
+  uint8_t buf[128];
+  wcpp::Packet p = wcpp::Packet::empty(buf, 128);
+  p.telemetry(1, 2, 3, 4, 5);
+  p.append("Ax").setInt(1000);
+  auto a = p.append("Sa").setStruct();
+  a.append("Aa").setInt(1);
+  auto b = a.append("Sb").setStruct();
+  b.append("Bb").setInt(2);
+  auto c = b.append("Sc").setStruct();
+  c.append("Cc").setInt(3);
+  b.append("Bd").setInt(4);
+  a.append("Ad").setInt(5);
+  p.append("Ay").setInt(-1000);
+
+  uint8_t size = p.size();
+  uint8_t size_a = a.size();
+  uint8_t size_b = b.size();
+  {
+    wcpp::StructEdit edit(c);
+    edit.append("Cd").setInt(300);
+    edit.append("Ce").setFloat32(1.5f);
+    (*edit.find("Cc")).setInt(100000);
+    (*edit.find("Cd")).remove();
+    EXPECT_EQ(edit.size(), 1 + 5 + 6);
+    EXPECT_EQ(p.size(), size);
+  }
+  EXPECT_EQ(c.size(), 1 + 5 + 6);
+  EXPECT_EQ(b.size(), size_b + 9);
+  EXPECT_EQ(a.size(), size_a + 9);
+  EXPECT_EQ(p.size(), size + 9);
+
+  EXPECT_EQ((*p.find("Ay")).getInt(), -1000);
+  auto sa = (*p.find("Sa")).getStruct();
+  EXPECT_EQ((*sa.find("Ad")).getInt(), 5);
+  auto sb = (*sa.find("Sb")).getStruct();
+  EXPECT_EQ((*sb.find("Bd")).getInt(), 4);
+  auto sc = (*sb.find("Sc")).getStruct();
+  EXPECT_EQ((*sc.find("Cc")).getInt(), 100000);
+  EXPECT_EQ((*sc.find("Ce")).getFloat32(), 1.5f);
+  EXPECT_EQ(sc.find("Cd"), sc.end());
+
+  // Nested sessions and shrinking
+  {
+    wcpp::StructEdit edit_a(a);
+    auto eb = (*edit_a.find("Sb")).editStruct();
+    {
+      wcpp::StructEdit edit_b(eb);
+      edit_b.clear();
+      edit_b.append("Bz").setInt(7);
+    }
+    edit_a.append("Az").setInt(8);
+    edit_a.commit();
+    edit_a.append("Ay").setInt(9);
+  }
+  auto sa2 = (*p.find("Sa")).getStruct();
+  auto sb2 = (*sa2.find("Sb")).getStruct();
+  EXPECT_EQ(sb2.size(), 1 + 2);
+  EXPECT_EQ((*sb2.find("Bz")).getInt(), 7);
+  EXPECT_EQ((*sa2.find("Az")).getInt(), 8);
+  EXPECT_EQ(sa2.find("Ay"), sa2.end());
+  EXPECT_EQ((*p.find("Ay")).getInt(), -1000);
+  EXPECT_EQ(p.size(), 7 + 4 + 2 + 1 + 2 + 2 + 1 + 2 + 2 + 2 + 4);
+
+  // Not enough room
+  {
+    wcpp::StructEdit edit(a);
+    uint8_t bytes[128] = {};
+    EXPECT_FALSE(edit.append("Bs").setBytes(bytes, 100));
+  }
+  EXPECT_EQ((*p.find("Ay")).getInt(), -1000);
+}
+
+TEST(FixedWidthTest, BasicAssertions) {
+  uint8_t buf[64];
+  wcpp::Packet p = wcpp::Packet::empty(buf, 64);
+  p.telemetry(1, 2);
+  p.append("Ct").setInt(0, 4);
+  p.append("Ng").setInt(-1, 2);
+  p.append("Ax").setFloat32(0.0f, true);
+  p.append("Ah").setFloat16(0.0f, true);
+  p.append("Ad").setFloat64(0.0, true);
+  EXPECT_FALSE(p.append("Ov").setInt(0x10000, 2));
+  (*p.find("Ov")).remove();
+
+  uint8_t size = p.size();
+  EXPECT_EQ(size, 4 + 6 + 4 + 6 + 4 + 10);
+
+  // Layout stays fixed, so entries can be kept and rewritten
+  wcpp::Entry ct = *p.find("Ct");
+  wcpp::Entry ng = *p.find("Ng");
+  wcpp::Entry ax = *p.find("Ax");
+  wcpp::Entry ah = *p.find("Ah");
+  wcpp::Entry ad = *p.find("Ad");
+  for (int i = 0; i < 1000; i += 7) {
+    EXPECT_TRUE(ct.setInt(i * 1000, 4));
+    EXPECT_TRUE(ng.setInt(-i, 2));
+    EXPECT_TRUE(ax.setFloat32(i * 0.5f, true));
+    EXPECT_TRUE(ah.setFloat16(i * 0.5f, true));
+    EXPECT_TRUE(ad.setFloat64(i * 0.25, true));
+    EXPECT_EQ(p.size(), size);
+    EXPECT_EQ((*p.find("Ct")).getInt(), i * 1000);
+    EXPECT_EQ((*p.find("Ng")).getInt(), -i);
+    EXPECT_EQ((*p.find("Ax")).getFloat32(), i * 0.5f);
+    EXPECT_EQ((*p.find("Ah")).getFloat32(), (float)float16(i * 0.5f));
+    EXPECT_EQ((*p.find("Ad")).getFloat64(), i * 0.25);
+  }
+  EXPECT_FALSE(ct.setInt(-0x100000000LL, 4));
+  EXPECT_EQ(p.size(), size);
+
+  // The shortest form still shrinks the entry
+  ct.setInt(1);
+  EXPECT_EQ(p.size(), size - 4);
+  EXPECT_EQ((*p.find("Ng")).getInt(), -994);
+}
+
+TEST(ViewTest, BasicAssertions) {
+  uint8_t buf[64];
+  wcpp::Packet p = wcpp::Packet::empty(buf, 64);
+  p.telemetry(1, 2);
+  p.append("Bs").setString("abc");
+  p.append("Bl").setString("abcdefghijk");
+  p.append("Ax").setInt(1000);
+
+  auto bs = (*p.find("Bs")).getStringView();
+  EXPECT_EQ(bs, "abc");
+  auto bl = (*p.find("Bl")).getBytesView();
+  EXPECT_EQ(bl.size(), 11);
+  EXPECT_EQ(std::string_view((const char*)bl.data(), bl.size()), "abcdefghijk");
+  EXPECT_GE(bl.data(), buf);
+  EXPECT_LT(bl.data(), buf + p.size());
+  EXPECT_TRUE((*p.find("Ax")).getStringView().empty());
+  EXPECT_TRUE((*p.find("Ax")).getBytesView().empty());
+
+  uint8_t bytes[4] = {0, 0, 0, 0xFF};
+  EXPECT_EQ((*p.find("Bl")).getBytes(std::span<uint8_t>(bytes, 3)), 11);
+  EXPECT_EQ(bytes[2], 'c');
+  EXPECT_EQ(bytes[3], 0xFF);
+
+  char str[5];
+  EXPECT_EQ((*p.find("Bl")).getString(std::span<char>(str)), 11);
+  EXPECT_STREQ(str, "abcd");
+  EXPECT_EQ((*p.find("Bs")).getString(std::span<char>(str)), 3);
+  EXPECT_STREQ(str, "abc");
+  EXPECT_EQ((*p.find("Bs")).getString(std::span<char>()), 3);
+}
+
+TEST(ValidateTest, BasicAssertions) {
+  RandomSequence sequence(7);
+  auto rand = sequence.begin();
+  for (int i = 0; i < 200; i++) {
+    uint8_t buf[256];
+    wcpp::Packet p = generateRandomPacket(buf, rand);
+    EXPECT_TRUE(wcpp::Packet::validate(buf, p.size()));
+    EXPECT_FALSE(wcpp::Packet::validate(buf, p.size() - 1));
+  }
+
+  uint8_t buf[64];
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+  p.telemetry(1, 2, 3, 4);
+  p.append("Bl").setString("abcdefghijk");
+  wcpp::SubEntries st = p.append("St").setStruct();
+  st.append("Ax").setInt(1000);
+  ASSERT_TRUE(wcpp::Packet::validate(buf, p.size()));
+
+  // A bytes length past the end of the packet
+  buf[9] = 40;
+  EXPECT_FALSE(wcpp::Packet::validate(buf, sizeof(buf)));
+  buf[9] = 255;
+  EXPECT_FALSE(wcpp::Packet::validate(buf, sizeof(buf)));
+  buf[9] = 11;
+  // A struct larger than what is left
+  buf[9 + 12 + 2] = 10;
+  EXPECT_FALSE(wcpp::Packet::validate(buf, sizeof(buf)));
+  buf[9 + 12 + 2] = 5;
+  // Remote packets need their longer header
+  uint8_t header[6] = {6, 1, 2, 3, 0, 0};
+  EXPECT_FALSE(wcpp::Packet::validate(header, sizeof(header)));
+  EXPECT_TRUE(wcpp::Packet::validate(buf, p.size()));
+}
+
+TEST(CopyPayloadTest, BasicAssertions) {
+  uint8_t local_buf[64], remote_buf[64];
+  wcpp::Packet local = wcpp::Packet::empty(local_buf, sizeof(local_buf));
+  local.telemetry(1, 2);
+  local.append("Ax").setInt(1000);
+  local.append("Nm").setString("abc");
+
+  // Between local and remote headers, which differ in size
+  wcpp::Packet remote = wcpp::Packet::empty(remote_buf, sizeof(remote_buf));
+  remote.telemetry(1, 2, 3, 4, 5);
+  ASSERT_TRUE(remote.copyPayload(local));
+  EXPECT_EQ(remote.size(), local.size() + 3);
+  EXPECT_EQ((*remote.find("Ax")).getInt(), 1000);
+  EXPECT_EQ(remote.sequence(), 5);
+
+  local.clear();
+  ASSERT_TRUE(local.copyPayload(remote));
+  EXPECT_EQ(local.size(), remote.size() - 3);
+  EXPECT_EQ((*local.find("Ax")).getInt(), 1000);
+  EXPECT_EQ(memcmp(local_buf + 4, remote_buf + 7, local.size() - 4), 0);
+}
+
+TEST(EntryNameTest, BasicAssertions) {
+  using wcpp::operator""_wn;
+
+  // Packed at compile time, case does not matter
+  static_assert("Ax"_wn.key() == (1 | 24 << 5));
+  static_assert("AX"_wn == "Ax"_wn);
+  static_assert("ax"_wn == "Ax"_wn);
+  static_assert("@K"_wn.bits() == 0x0B00);
+  static_assert("Ax"_wn[0] == 'A' && "Ax"_wn[1] == 'x');
+  static_assert("Ax"_wn != "Ay"_wn);
+  // "A1"_wn, "A"_wn and "Abc"_wn do not compile
+
+  uint8_t buf[64];
+  wcpp::Packet p = wcpp::Packet::empty(buf, 64);
+  p.telemetry(1, 2);
+  p.append("Ax"_wn).setInt(1);
+  p.append("Ay").setInt(2);
+  p.append("Az"_wn).setFloat32(3.5f);
+
+  EXPECT_EQ((*p.find("AY"_wn)).getInt(), 2);
+  EXPECT_EQ((*p.find("Az"_wn)).getFloat32(), 3.5f);
+  EXPECT_EQ(p.find("Ax"_wn), p.find("Ax"));
+  EXPECT_EQ(p.find("Bx"_wn), p.end());
+  EXPECT_TRUE((*p.find("Ax")).name() == "Ax"_wn);
+  EXPECT_FALSE((*p.find("Ax")).name() == "Ay"_wn);
+
+  const wcpp::Packet& c = p;
+  EXPECT_EQ((*c.find("Ay"_wn)).getInt(), 2);
+
+  // From a position, like the char overloads
+  auto it = p.begin();
+  ++it;
+  EXPECT_EQ(it.find("Ax"_wn), p.end());
+  (*p.find("Ay"_wn)).name() = "By"_wn;
+  EXPECT_EQ((*p.find("By")).getInt(), 2);
+
+  p.find("Az"_wn).insert("Aw"_wn).setInt(9);
+  EXPECT_EQ((*p.at(2)).name()[1], 'w');
+
+  // Run time names skip the check but match the same way
+  char name[2] = {'a', 'Z'};
+  EXPECT_EQ(wcpp::EntryName::masked(name), "Az"_wn);
+}
+
 #endif
 
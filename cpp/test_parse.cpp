@@ -0,0 +1,192 @@
+#include "parse.h"
+
+#ifndef ARDUINO
+
+#include "format.h"
+#include "random_packet.h"
+
+#include <gtest/gtest.h>
+#include <cstring>
+#include <string>
+
+static size_t parseString(const std::string& text, wcpp::Packet& out, size_t* error_at = nullptr) {
+  return wcpp::parse(text.data(), text.size(), out, error_at);
+}
+
+TEST(ParseTest, Basic) {
+  uint8_t buf[wcpp::size_max];
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+
+  std::string text = "{\"id\":5,\"comp\":2,\"AX\":1.5,\"NM\":\"abc\"}";
+  EXPECT_EQ(parseString(text, p), text.size());
+  EXPECT_TRUE(p.isCommand());
+  EXPECT_TRUE(p.isLocal());
+  EXPECT_EQ(p.packet_id(), 5);
+  EXPECT_EQ(p.component_id(), 2);
+  EXPECT_TRUE((*p.find("Ax")).isFloat16());
+  EXPECT_EQ((*p.find("Ax")).getFloat16(), 1.5f);
+  char s[8];
+  (*p.find("Nm")).getString(s);
+  EXPECT_STREQ(s, "abc");
+
+  // The same packet built by hand
+  uint8_t expected_buf[wcpp::size_max];
+  wcpp::Packet expected = wcpp::Packet::empty(expected_buf, sizeof(expected_buf));
+  expected.command(5, 2);
+  expected.append("Ax").setFloat16(1.5);
+  expected.append("Nm").setString("abc");
+  ASSERT_EQ(p.size(), expected.size());
+  EXPECT_EQ(std::memcmp(buf, expected_buf, p.size()), 0);
+}
+
+TEST(ParseTest, Shortest) {
+  uint8_t buf[wcpp::size_max];
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+
+  std::string text = "tlm id=\"T\" comp=1 Sm=7 Bg=300 Ng=-70000 Mx=18446744073709551615 "
+                     "Zr=0.0 Hf=0.25 Fl=4.56 Db=0.1234567890123 Tr=true Fa=false Nl=null";
+  ASSERT_EQ(parseString(text, p), text.size());
+  EXPECT_TRUE(p.isTelemetry());
+  EXPECT_EQ(p.packet_id(), 'T');
+
+  EXPECT_EQ((*p.find("Sm")).size(), 0);
+  EXPECT_EQ((*p.find("Sm")).getInt(), 7);
+  EXPECT_EQ((*p.find("Bg")).size(), 2);
+  EXPECT_EQ((*p.find("Ng")).size(), 3);
+  EXPECT_EQ((*p.find("Ng")).getInt(), -70000);
+  EXPECT_EQ((*p.find("Mx")).size(), 8);
+  EXPECT_EQ((*p.find("Mx")).getUInt(), UINT64_MAX);
+
+  EXPECT_TRUE((*p.find("Zr")).isFloat());
+  EXPECT_EQ((*p.find("Zr")).size(), 0);
+  EXPECT_TRUE((*p.find("Hf")).isFloat16());
+  EXPECT_TRUE((*p.find("Fl")).isFloat32());
+  EXPECT_EQ((*p.find("Fl")).getFloat32(), 4.56f);
+  EXPECT_TRUE((*p.find("Db")).isFloat64());
+  EXPECT_EQ((*p.find("Db")).getFloat64(), 0.1234567890123);
+
+  EXPECT_EQ((*p.find("Tr")).getInt(), 1);
+  EXPECT_EQ((*p.find("Fa")).getInt(), 0);
+  EXPECT_TRUE((*p.find("Nl")).isNull());
+}
+
+TEST(ParseTest, RoundTrip) {
+  uint8_t inner_buf[wcpp::size_max];
+  wcpp::Packet inner = wcpp::Packet::empty(inner_buf, sizeof(inner_buf));
+  inner.command('C', 4);
+  inner.append("Md").setInt(2);
+
+  uint8_t buf[wcpp::size_max];
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+  p.telemetry('T', 2, 1, 5, 300);
+  p.append("Ax").setFloat32(-0.1f);
+  p.append("Ct").setInt(-7);
+  p.append("Bs").setBytes((const uint8_t*)"a\"\\\n\x01\xff", 6);
+  p.append("Lg").setString("a longer string");
+  wcpp::SubEntries gps = p.append("Gp").setStruct();
+  gps.append("La").setFloat64(35.123456789);
+  gps.append("Al").setFloat16(100);
+  gps.append("Em").setStruct();
+  p.append("Pk").setPacket(inner);
+  p.append("Nl").setNull();
+
+  for (auto style : {wcpp::TextStyle::json, wcpp::TextStyle::text}) {
+    char text[512];
+    size_t n = wcpp::format(p, text, sizeof(text), style);
+    ASSERT_GT(n, 0u);
+
+    uint8_t out_buf[wcpp::size_max];
+    wcpp::Packet out = wcpp::Packet::empty(out_buf, sizeof(out_buf));
+    EXPECT_EQ(wcpp::parse(text, n, out), n) << text;
+    ASSERT_EQ(out.size(), p.size()) << text;
+    EXPECT_EQ(std::memcmp(out_buf, buf, p.size()), 0) << text;
+  }
+}
+
+TEST(ParseTest, Names) {
+  uint8_t buf[wcpp::size_max];
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+  ASSERT_GT(parseString("{\"id\":5,\"\\\\|\":1,\"@k\":2}", p), 0u);
+  EXPECT_EQ((*p.find("\\|")).getInt(), 1);
+  EXPECT_EQ((*p.find("@k")).getInt(), 2);
+
+  // "]a" is a name, not the end of the packet
+  ASSERT_GT(parseString("[cmd id=5 ]a=3 _\x7f=4]", p), 0u);
+  EXPECT_EQ((*p.find("]a")).getInt(), 3);
+  EXPECT_EQ((*p.find("_\x7f")).getInt(), 4);
+}
+
+// Random packets use every name a 5-bit name can hold, like "@k" or "]~"
+TEST(ParseTest, RandomRoundTrip) {
+  RandomSequence sequence(testing::UnitTest::GetInstance()->random_seed());
+  auto rand = sequence.begin();
+  for (int i = 0; i < 200; i++) {
+    uint8_t buf[wcpp::size_max];
+    wcpp::Packet p = generateRandomPacket(buf, rand);
+
+    for (auto style : {wcpp::TextStyle::json, wcpp::TextStyle::text}) {
+      char text[4096];
+      size_t n = wcpp::format(p, text, sizeof(text), style);
+      ASSERT_GT(n, 0u);
+
+      // Values may come back in a shorter encoding, so compare the text
+      uint8_t out_buf[wcpp::size_max];
+      wcpp::Packet out = wcpp::Packet::empty(out_buf, sizeof(out_buf));
+      ASSERT_EQ(wcpp::parse(text, n, out), n) << text;
+      char again[4096];
+      size_t m = wcpp::format(out, again, sizeof(again), style);
+      EXPECT_EQ(std::string(again, m), std::string(text, n));
+    }
+  }
+}
+
+TEST(ParseTest, Lines) {
+  std::string text = "{\"t\":100,\"type\":\"cmd\",\"id\":1,\"comp\":2,\"Ct\":1}\n"
+                     "\n"
+                     "t=200 cmd id=1 comp=2 Ct=2\n"
+                     "cmd id=1 comp=2 Ct=3";
+
+  uint8_t buf[wcpp::size_max];
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+  size_t pos = 0;
+  for (int i = 1; i <= 3; i++) {
+    size_t n = wcpp::parse(text.data() + pos, text.size() - pos, p);
+    ASSERT_GT(n, 0u);
+    pos += n;
+    EXPECT_EQ(p.packet_id(), 1);
+    EXPECT_EQ((*p.find("Ct")).getInt(), i);
+  }
+  EXPECT_EQ(pos, text.size());
+}
+
+TEST(ParseTest, Errors) {
+  uint8_t buf[wcpp::size_max];
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+  size_t error_at = 0;
+
+  EXPECT_EQ(parseString("{\"id\":5,\"Ax\":1.5", p, &error_at), 0u);
+  EXPECT_EQ(parseString("{\"id\":5,\"A1\":1}", p, &error_at), 0u);
+  EXPECT_EQ(error_at, 9u);
+  EXPECT_EQ(parseString("{\"id\":5,\"\\n\":1}", p, &error_at), 0u);
+  EXPECT_EQ(parseString("{\"Ax\":1,\"id\":5}", p, &error_at), 0u);
+  EXPECT_EQ(parseString("{\"id\":128}", p, &error_at), 0u);
+  EXPECT_EQ(parseString("{\"id\":1,\"seq\":3}", p, &error_at), 0u);
+  EXPECT_EQ(parseString("{\"id\":1,\"Ax\":1.5.5}", p, &error_at), 0u);
+  EXPECT_EQ(parseString("{\"id\":1,\"Ax\":-9223372036854775809}", p, &error_at), 0u);
+  EXPECT_EQ(parseString("{\"id\":1,\"Ax\":\"\\q\"}", p, &error_at), 0u);
+  EXPECT_EQ(parseString("{\"id\":1,\"Ax\":maybe}", p, &error_at), 0u);
+  EXPECT_EQ(parseString("cmd id=1 Pk=[cmd Pk=[cmd Pk=[cmd Pk=[cmd Pk=[cmd Pk=[cmd Pk=[cmd Pk=[cmd]]]]]]]]",
+                        p, &error_at), 0u);
+
+  // More than fits in the buffer
+  std::string big = "{\"id\":1";
+  for (int i = 0; i < 30; i++) big += ",\"Bs\":\"0123456789\"";
+  big += "}";
+  EXPECT_EQ(parseString(big, p, &error_at), 0u);
+
+  uint8_t small_buf[16];
+  wcpp::Packet small = wcpp::Packet::empty(small_buf, sizeof(small_buf));
+  EXPECT_EQ(parseString("{\"id\":1,\"Nm\":\"0123456789abcdef\"}", small, &error_at), 0u);
+}
+
+#endif
@@ -0,0 +1,259 @@
+#include "pipeline.h"
+
+#ifndef ARDUINO
+
+#include "workload.h"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// Framed telemetry of 24 streams from 3 units. Packet i is number i / 24
+// of stream i % 24.
+static std::vector<uint8_t> stream(unsigned packets, uint64_t seed) {
+  std::mt19937_64 rand(seed);
+  std::vector<uint8_t> bytes;
+  for (unsigned i = 0; i < packets; i++) {
+    uint8_t entries[wcpp::size_max], buf[wcpp::size_max], f[wcpp::size_max + wcpp::frame_overhead];
+    wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+    p.telemetry(i % 24 / 3, 0x10, 1 + i % 3, 0xFE, i / 24);
+    p.copyPayload(wcpp::generatePacket(wcpp::workload_telemetry, entries, rand));
+    uint16_t n = wcpp::frame(p, f);
+    bytes.insert(bytes.end(), f, f + n);
+  }
+  return bytes;
+}
+
+// Reads a stream in pieces of up to 700 bytes, then ends
+static wcpp::LinkRead reader(const std::vector<uint8_t>& bytes) {
+  size_t pos = 0;
+  unsigned turn = 0;
+  return [&bytes, pos, turn](uint8_t* buf, size_t size) mutable -> long {
+    if (pos == bytes.size()) return -1;
+    // Nothing now and then, as a serial port would
+    if (++turn % 7 == 0) return 0;
+    size_t n = std::min({size, bytes.size() - pos, (size_t)(turn * 97 % 700 + 1)});
+    std::memcpy(buf, bytes.data() + pos, n);
+    pos += n;
+    return n;
+  };
+}
+
+TEST(DedupTest, Window) {
+  wcpp::StaticDedupTable<4> dedup;
+  uint8_t buf[wcpp::size_max];
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+
+  auto check = [&](uint8_t unit, uint16_t sequence) {
+    p.telemetry('T', 1, unit, 0, sequence);
+    return dedup.check(p, 0);
+  };
+  EXPECT_TRUE(check(1, 10));
+  EXPECT_FALSE(check(1, 10));
+  EXPECT_TRUE(check(1, 12));
+  // Late but new, then a repeat of it
+  EXPECT_TRUE(check(1, 11));
+  EXPECT_FALSE(check(1, 11));
+  EXPECT_TRUE(check(1, 80));
+  EXPECT_TRUE(check(1, 17));
+  EXPECT_FALSE(check(1, 17));
+  // Far behind but never seen
+  EXPECT_TRUE(check(1, 16));
+  EXPECT_TRUE(check(1, 1000));
+  EXPECT_FALSE(check(1, 80));
+  // Further behind than the history: the sender restarted
+  EXPECT_TRUE(check(1, 1000 + wcpp::dedup_history));
+  EXPECT_TRUE(check(1, 12));
+  EXPECT_TRUE(check(1, 13));
+  EXPECT_FALSE(check(1, 12));
+  EXPECT_EQ(dedup.duplicates(), 5u);
+
+  // Wrapping around
+  EXPECT_TRUE(check(2, 65535));
+  EXPECT_TRUE(check(2, 0));
+  EXPECT_FALSE(check(2, 65535));
+  EXPECT_EQ(dedup.duplicates(), 6u);
+
+  // Other streams are separate, and local packets always pass
+  p.telemetry('T', 1);
+  EXPECT_TRUE(dedup.check(p, 0));
+  EXPECT_TRUE(dedup.check(p, 0));
+
+  EXPECT_TRUE(check(3, 0));
+  EXPECT_TRUE(check(4, 0));
+  EXPECT_TRUE(check(5, 0));
+  EXPECT_TRUE(check(5, 0));
+  EXPECT_EQ(dedup.overflowed(), 2u);
+}
+
+TEST(DedupTest, Restart) {
+  wcpp::StaticDedupTable<4> dedup(1000);
+  uint8_t buf[wcpp::size_max];
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+
+  uint32_t now = 0;
+  auto send = [&](uint8_t unit, uint16_t count) {
+    unsigned passed = 0;
+    for (uint16_t sequence = 0; sequence < count; sequence++, now += 10) {
+      p.telemetry('T', 1, unit, 0, sequence);
+      if (dedup.check(p, now)) passed++;
+    }
+    return passed;
+  };
+  // The unit reboots, which takes a few seconds, and counts from 0 again
+  EXPECT_EQ(send(1, 500), 500u);
+  now += 3000;
+  EXPECT_EQ(send(1, 500), 500u);
+  EXPECT_EQ(dedup.duplicates(), 0u);
+
+  // Repeats from a slower link stay repeats while the stream goes on
+  p.telemetry('T', 1, 1, 0, 0);
+  EXPECT_FALSE(dedup.check(p, now));
+  p.telemetry('T', 1, 1, 0, 498);
+  EXPECT_FALSE(dedup.check(p, now + 900));
+  EXPECT_EQ(dedup.duplicates(), 2u);
+}
+
+TEST(PipelineTest, RedundantLinks) {
+  const unsigned packets = 20000;
+  std::vector<uint8_t> a = stream(packets, 1);
+  // The second link carries the same packets, the first one corrupted
+  std::vector<uint8_t> b = a;
+  b[2] ^= 0x55;
+
+  static wcpp::StaticPacketPool<1024> pool;
+  wcpp::Bus bus(pool);
+  wcpp::Subscriber* s = bus.subscribe(wcpp::BusFilter(), 256, wcpp::BusPolicy::block);
+  static wcpp::StaticTelemetryCache<1024> cache;
+  FILE* log = tmpfile();
+  wcpp::Tracer tracer;
+  bus.traceTo(tracer);
+
+  wcpp::Pipeline pipeline(pool, 256);
+  EXPECT_TRUE(pipeline.addLink(reader(a)));
+  EXPECT_TRUE(pipeline.addLink(reader(b)));
+  pipeline.routeTo(bus);
+  pipeline.logTo(log);
+  pipeline.cacheTo(cache);
+  pipeline.traceTo(tracer);
+  ASSERT_TRUE(pipeline.start());
+
+  // Each packet is routed once
+  std::vector<bool> routed(packets);
+  std::atomic<bool> done(false);
+  std::thread consumer([&]() {
+    uint8_t out_buf[wcpp::size_max];
+    wcpp::Packet out = wcpp::Packet::empty(out_buf, sizeof(out_buf));
+    while (true) {
+      bool last = done.load(std::memory_order_acquire);
+      if (s->receive(out)) {
+        unsigned i = out.sequence() * 24 + 3 * out.packet_id() + out.origin_unit_id() - 1;
+        EXPECT_FALSE(routed[i]);
+        routed[i] = true;
+      }
+      else if (last) break;
+      else std::this_thread::yield();
+    }
+  });
+  pipeline.join();
+  done.store(true, std::memory_order_release);
+  consumer.join();
+  EXPECT_EQ(std::count(routed.begin(), routed.end(), true), packets);
+
+  // Resynchronizing may cost the frame after the corrupted one as well
+  EXPECT_GE(pipeline.frames(), 2 * packets - 2);
+  EXPECT_LE(pipeline.frames(), 2 * packets - 1);
+  EXPECT_GE(pipeline.errors(), 1u);
+  EXPECT_EQ(pipeline.duplicates(), pipeline.frames() - packets);
+  EXPECT_EQ(pipeline.handled(wcpp::PipelineStage::validate), pipeline.frames());
+  EXPECT_EQ(pipeline.handled(wcpp::PipelineStage::route), packets);
+  EXPECT_EQ(pipeline.handled(wcpp::PipelineStage::log), packets);
+  EXPECT_EQ(pipeline.handled(wcpp::PipelineStage::cache), packets);
+  EXPECT_GT(pipeline.latency(wcpp::PipelineStage::route).percentile(0.5), 0u);
+  EXPECT_EQ(cache.size(), 24u);
+  // Times a reader can hold against its own steady_clock
+  wcpp::TelemetryCache::Snapshot snapshot;
+  ASSERT_TRUE(cache.get(1, 0x10, 0x80, snapshot));
+  uint32_t now = wcpp::monotonicNanos() / 1000000;
+  EXPECT_LE(snapshot.time, now);
+  EXPECT_LT(now - snapshot.time, 60000u);
+  EXPECT_EQ(pool.available(), pool.count());
+
+  // Every frame is traced until dedup, then every packet once
+  wcpp::LatencyHistogram traced;
+  tracer.merge(wcpp::TraceStage::deframe, traced);
+  EXPECT_EQ(traced.count(), pipeline.frames());
+  for (wcpp::TraceStage stage : {wcpp::TraceStage::validate, wcpp::TraceStage::route,
+                                 wcpp::TraceStage::deliver}) {
+    traced.reset();
+    tracer.merge(stage, traced);
+    EXPECT_EQ(traced.count(), packets);
+  }
+  EXPECT_EQ(tracer.keys().size(), 24u);
+
+  // The log holds each packet once
+  rewind(log);
+  wcpp::Deframer deframer;
+  std::vector<bool> logged(packets);
+  unsigned frames = 0;
+  int c;
+  while ((c = fgetc(log)) != EOF) {
+    if (!deframer.put(c)) continue;
+    const wcpp::Packet p = deframer.packet();
+    unsigned i = p.sequence() * 24 + 3 * p.packet_id() + p.origin_unit_id() - 1;
+    EXPECT_FALSE(logged[i]);
+    logged[i] = true;
+    frames++;
+  }
+  EXPECT_EQ(frames, packets);
+  fclose(log);
+}
+
+TEST(PipelineTest, Stop) {
+  static wcpp::StaticPacketPool<64> pool;
+  std::vector<uint8_t> bytes = stream(100, 2);
+  size_t pos = 0;
+  wcpp::Pipeline pipeline(pool, 16);
+  // A link that never ends
+  pipeline.addLink([&](uint8_t* buf, size_t size) -> long {
+    if (pos == bytes.size()) return 0;
+    size_t n = std::min(size, bytes.size() - pos);
+    std::memcpy(buf, bytes.data() + pos, n);
+    pos += n;
+    return n;
+  });
+  wcpp::Bus bus(pool);
+  pipeline.routeTo(bus);
+  ASSERT_TRUE(pipeline.start());
+  EXPECT_FALSE(pipeline.addLink([](uint8_t*, size_t) -> long { return -1; }));
+  while (pipeline.handled(wcpp::PipelineStage::route) < 100) std::this_thread::yield();
+  pipeline.stop();
+  EXPECT_FALSE(pipeline.running());
+  EXPECT_EQ(pipeline.frames(), 100u);
+  EXPECT_EQ(pool.available(), pool.count());
+}
+
+TEST(PipelineTest, StopWithPoolEmpty) {
+  static wcpp::StaticPacketPool<64> pool;
+  std::vector<uint8_t> bytes = stream(100, 3);
+  size_t pos = 0;
+  wcpp::Pipeline pipeline(pool, 16);
+  pipeline.addLink([&](uint8_t* buf, size_t size) -> long {
+    if (pos == bytes.size()) pos = 0;
+    size_t n = std::min(size, bytes.size() - pos);
+    std::memcpy(buf, bytes.data() + pos, n);
+    pos += n;
+    return n;
+  });
+  // Never reads, so it ends up holding every buffer of the pool
+  wcpp::Bus bus(pool);
+  bus.subscribe(wcpp::BusFilter(), 1024, wcpp::BusPolicy::drop);
+  pipeline.routeTo(bus);
+  ASSERT_TRUE(pipeline.start());
+  while (pool.available() > 0) std::this_thread::yield();
+  pipeline.stop();
+  EXPECT_FALSE(pipeline.running());
+}
+
+#endif
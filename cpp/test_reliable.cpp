@@ -0,0 +1,261 @@
+#include "reliable.h"
+
+#ifndef ARDUINO
+
+#include <gtest/gtest.h>
+#include <random>
+#include <set>
+#include <vector>
+
+namespace {
+
+wcpp::Packet command(uint8_t* buf, int counter) {
+  wcpp::Packet p = wcpp::Packet::empty(buf, wcpp::size_max);
+  p.command('C', 2, 1, 5);
+  p.append("Ct").setInt(counter);
+  return p;
+}
+
+std::vector<uint8_t> bytes(const wcpp::Packet& p) {
+  return std::vector<uint8_t>(p.encode(), p.encode() + p.size());
+}
+
+} // namespace
+
+TEST(ReliableTest, CumulativeAck) {
+  wcpp::StaticReliableSender<8> tx(100);
+  wcpp::StaticReliableReceiver<> rx;
+  uint8_t buf[wcpp::size_max];
+
+  for (int i = 0; i < 3; i++) ASSERT_TRUE(tx.send(command(buf, i), 0));
+  EXPECT_EQ(tx.in_flight(), 3);
+  EXPECT_EQ(tx.next_sequence(), 3);
+
+  for (int i = 0; i < 3; i++) {
+    wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+    ASSERT_TRUE(tx.pop(p, 0));
+    EXPECT_EQ(p.sequence(), i);
+    EXPECT_EQ((*p.find("Ct")).getInt(), i);
+    EXPECT_TRUE(rx.receive(p));
+  }
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+  EXPECT_FALSE(tx.pop(p, 0));
+
+  // One ACK covers all three
+  wcpp::Packet ack = wcpp::Packet::empty(buf, sizeof(buf));
+  ASSERT_TRUE(rx.ack(ack));
+  EXPECT_TRUE(ack.isTelemetry());
+  EXPECT_EQ(ack.packet_id(), wcpp::reliable_ack_packet_id);
+  EXPECT_EQ(ack.origin_unit_id(), 5);
+  EXPECT_EQ(ack.dest_unit_id(), 1);
+  EXPECT_EQ((*ack.find("Ak")).getUInt(), 2u);
+  EXPECT_EQ(ack.find("Ab"), ack.end());
+  EXPECT_EQ((*ack.find("As")).getUInt(), tx.session());
+  EXPECT_FALSE(rx.ack(ack));
+
+  // Lookalikes: other telemetry with an "Ak" field, or an ACK from
+  // another unit
+  uint8_t other_buf[32];
+  wcpp::Packet other = wcpp::Packet::empty(other_buf, sizeof(other_buf));
+  other.telemetry('T', 0, 5, 1);
+  other.append("Ak").setInt(2);
+  EXPECT_FALSE(tx.handle(other));
+  other = wcpp::Packet::empty(other_buf, sizeof(other_buf));
+  other.telemetry(wcpp::reliable_ack_packet_id, ack.component_id(), 6, 1);
+  other.append("Ak").setInt(2);
+  EXPECT_TRUE(tx.handle(other));
+  EXPECT_EQ(tx.in_flight(), 3);
+
+  EXPECT_TRUE(tx.handle(ack));
+  EXPECT_EQ(tx.in_flight(), 0);
+  EXPECT_EQ(tx.acked(), 3u);
+  EXPECT_FALSE(tx.ready(1000));
+}
+
+TEST(ReliableTest, SelectiveAck) {
+  wcpp::StaticReliableSender<8> tx(100);
+  wcpp::StaticReliableReceiver<> rx;
+  uint8_t buf[wcpp::size_max];
+
+  std::vector<std::vector<uint8_t>> sent;
+  for (int i = 0; i < 5; i++) {
+    ASSERT_TRUE(tx.send(command(buf, i), 0));
+    wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+    ASSERT_TRUE(tx.pop(p, 0));
+    sent.push_back(bytes(p));
+  }
+
+  // 1 and 3 are lost
+  for (int i : {0, 2, 4}) EXPECT_TRUE(rx.receive(wcpp::Packet::decode(sent[i].data())));
+  wcpp::Packet ack = wcpp::Packet::empty(buf, sizeof(buf));
+  ASSERT_TRUE(rx.ack(ack));
+  EXPECT_EQ((*ack.find("Ak")).getUInt(), 0u);
+  EXPECT_EQ((*ack.find("Ab")).getUInt(), 0b101u);
+
+  tx.handle(ack);
+  EXPECT_EQ(tx.in_flight(), 2);
+
+  // Only the lost ones come back, once the timeout has passed
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+  EXPECT_FALSE(tx.pop(p, 99));
+  std::vector<int> again;
+  while (tx.pop(p, 110)) again.push_back(p.sequence());
+  EXPECT_EQ(again, std::vector<int>({1, 3}));
+  EXPECT_EQ(tx.retransmits(), 2u);
+
+  // Retransmits of what already arrived are duplicates, still acknowledged
+  EXPECT_FALSE(rx.receive(wcpp::Packet::decode(sent[2].data())));
+  EXPECT_EQ(rx.duplicates(), 1u);
+  EXPECT_TRUE(rx.receive(wcpp::Packet::decode(sent[1].data())));
+  EXPECT_TRUE(rx.receive(wcpp::Packet::decode(sent[3].data())));
+  ack = wcpp::Packet::empty(buf, sizeof(buf));
+  ASSERT_TRUE(rx.ack(ack));
+  EXPECT_EQ((*ack.find("Ak")).getUInt(), 4u);
+  tx.handle(ack);
+  EXPECT_EQ(tx.in_flight(), 0);
+}
+
+TEST(ReliableTest, AckPacketId) {
+  const uint8_t id = 0x31;
+  wcpp::StaticReliableSender<8> tx(100, 5, 10, 0, 0, id);
+  wcpp::StaticReliableReceiver<> rx(id);
+  uint8_t buf[wcpp::size_max];
+
+  ASSERT_TRUE(tx.send(command(buf, 0), 0));
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+  ASSERT_TRUE(tx.pop(p, 0));
+  EXPECT_TRUE(rx.receive(p));
+  wcpp::Packet ack = wcpp::Packet::empty(buf, sizeof(buf));
+  ASSERT_TRUE(rx.ack(ack));
+  EXPECT_EQ(ack.packet_id(), id);
+  std::vector<uint8_t> ack_bytes = bytes(ack);
+
+  // Under the default ID it is telemetry like any other
+  wcpp::StaticReliableSender<8> other(100, 5, 10, 0, tx.session());
+  ASSERT_TRUE(other.send(command(buf, 0), 0));
+  EXPECT_FALSE(other.handle(wcpp::Packet::decode(ack_bytes.data())));
+  EXPECT_EQ(other.in_flight(), 1);
+
+  EXPECT_TRUE(tx.handle(wcpp::Packet::decode(ack_bytes.data())));
+  EXPECT_EQ(tx.in_flight(), 0);
+  EXPECT_EQ(tx.acked(), 1u);
+}
+
+TEST(ReliableTest, Backoff) {
+  wcpp::StaticReliableSender<4, 8> tx(100, 3, 10);
+  uint8_t buf[wcpp::size_max];
+  ASSERT_TRUE(tx.send(command(buf, 0), 1000));
+
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+  std::vector<uint32_t> times;
+  for (uint32_t now = 1000; now < 3000; now += 10) {
+    if (tx.pop(p, now)) times.push_back(now);
+  }
+  // Waits of 100, then 200, both longer than a turn of the wheel
+  EXPECT_EQ(times, std::vector<uint32_t>({1000, 1100, 1300}));
+  EXPECT_EQ(tx.failed(), 1u);
+  EXPECT_EQ(tx.in_flight(), 0);
+}
+
+TEST(ReliableTest, Window) {
+  wcpp::StaticReliableSender<2> tx(100);
+  uint8_t buf[wcpp::size_max];
+  EXPECT_TRUE(tx.send(command(buf, 0), 0));
+  EXPECT_TRUE(tx.send(command(buf, 1), 0));
+  EXPECT_FALSE(tx.send(command(buf, 2), 0));
+
+  // Not remote, not a command
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+  p.command('C', 2);
+  EXPECT_FALSE(tx.send(p, 0));
+  p.telemetry('T', 2, 1, 5);
+  EXPECT_FALSE(tx.send(p, 0));
+}
+
+TEST(ReliableTest, Restart) {
+  wcpp::StaticReliableReceiver<2> rx;
+  uint8_t buf[wcpp::size_max];
+
+  wcpp::StaticReliableSender<8> a(100);
+  std::vector<std::vector<uint8_t>> sent;
+  for (int i = 0; i < 3; i++) {
+    a.send(command(buf, i), 0);
+    wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+    a.pop(p, 0);
+    sent.push_back(bytes(p));
+    EXPECT_TRUE(rx.receive(p));
+  }
+  wcpp::Packet ack = wcpp::Packet::empty(buf, sizeof(buf));
+  ASSERT_TRUE(rx.ack(ack));
+  std::vector<uint8_t> old_ack = bytes(ack);
+  EXPECT_TRUE(a.handle(ack));
+  EXPECT_EQ(a.in_flight(), 0);
+
+  // Restarted at 0 as well, behind what the receiver has seen: only the
+  // session tells the two apart
+  wcpp::StaticReliableSender<8> b(100);
+  EXPECT_NE(b.session(), a.session());
+  for (int i = 0; i < 2; i++) ASSERT_TRUE(b.send(command(buf, 10 + i), 0));
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+  ASSERT_TRUE(b.pop(p, 0));
+  EXPECT_EQ(p.sequence(), 0);
+  EXPECT_TRUE(rx.receive(p));
+  EXPECT_FALSE(rx.receive(p));
+  ack = wcpp::Packet::empty(buf, sizeof(buf));
+  ASSERT_TRUE(rx.ack(ack));
+  EXPECT_TRUE(b.handle(ack));
+  EXPECT_EQ(b.in_flight(), 1);
+  EXPECT_EQ(b.acked(), 1u);
+
+  // A late retransmit from before the restart is neither delivered nor
+  // acknowledged, and an ACK from then covers nothing now
+  EXPECT_FALSE(rx.receive(wcpp::Packet::decode(sent[1].data())));
+  ack = wcpp::Packet::empty(buf, sizeof(buf));
+  EXPECT_FALSE(rx.ack(ack));
+  EXPECT_TRUE(b.handle(wcpp::Packet::decode(old_ack.data())));
+  EXPECT_EQ(b.in_flight(), 1);
+
+  p = wcpp::Packet::empty(buf, sizeof(buf));
+  ASSERT_TRUE(b.pop(p, 0));
+  EXPECT_EQ((*p.find("Ct")).getInt(), 11);
+  EXPECT_TRUE(rx.receive(p));
+
+  // Local commands and telemetry are not tracked
+  p = wcpp::Packet::empty(buf, sizeof(buf));
+  p.command('C', 2);
+  EXPECT_TRUE(rx.receive(p));
+  EXPECT_TRUE(rx.receive(p));
+}
+
+TEST(ReliableTest, LossyLink) {
+  wcpp::StaticReliableSender<16> tx(50, 20, 5);
+  wcpp::StaticReliableReceiver<> rx;
+  std::mt19937_64 engine(7);
+  std::bernoulli_distribution lost(0.3);
+
+  const int count = 500;
+  int queued = 0;
+  std::multiset<int> delivered;
+  uint8_t buf[wcpp::size_max];
+  for (uint32_t now = 0; now < 100000 && (int)delivered.size() < count; now += 5) {
+    while (queued < count && tx.send(command(buf, queued), now)) queued++;
+
+    wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+    while (tx.pop(p, now)) {
+      if (!lost(engine) && rx.receive(p)) delivered.insert((*p.find("Ct")).getInt());
+      p = wcpp::Packet::empty(buf, sizeof(buf));
+    }
+    wcpp::Packet ack = wcpp::Packet::empty(buf, sizeof(buf));
+    while (rx.ack(ack)) {
+      if (!lost(engine)) tx.handle(ack);
+      ack = wcpp::Packet::empty(buf, sizeof(buf));
+    }
+  }
+
+  ASSERT_EQ((int)delivered.size(), count);
+  for (int i = 0; i < count; i++) EXPECT_EQ(delivered.count(i), 1u);
+  EXPECT_EQ(tx.failed(), 0u);
+  EXPECT_GT(rx.duplicates(), 0u);
+}
+
+#endif
@@ -0,0 +1,156 @@
+#include "scheduler.h"
+
+#ifndef ARDUINO
+
+#include <gtest/gtest.h>
+
+static wcpp::Packet buildTelemetry(uint8_t* buf, uint8_t id, uint8_t component, int value) {
+  wcpp::Packet p = wcpp::Packet::empty(buf, wcpp::size_max);
+  p.telemetry(id, component);
+  p.append("Va").setInt(value);
+  return p;
+}
+
+TEST(SchedulerTest, CommandsFirst) {
+  wcpp::StaticScheduler<4, 64> scheduler;
+  uint8_t buf[wcpp::size_max];
+  uint8_t out_buf[wcpp::size_max];
+
+  EXPECT_TRUE(scheduler.push(buildTelemetry(buf, 1, 1, 100), 0));
+  wcpp::Packet c = wcpp::Packet::empty(buf, wcpp::size_max);
+  c.command(5, 2);
+  c.append("Go").setInt(1);
+  EXPECT_TRUE(scheduler.push(c, 0));
+  c.command(6, 2);
+  EXPECT_TRUE(scheduler.push(c, 0));
+
+  wcpp::Packet out = wcpp::Packet::empty(out_buf, wcpp::size_max);
+  ASSERT_TRUE(scheduler.pop(out, 0));
+  EXPECT_TRUE(out.isCommand());
+  EXPECT_EQ(out.packet_id(), 5);
+  ASSERT_TRUE(scheduler.pop(out, 0));
+  EXPECT_TRUE(out.isCommand());
+  EXPECT_EQ(out.packet_id(), 6);
+  ASSERT_TRUE(scheduler.pop(out, 0));
+  EXPECT_TRUE(out.isTelemetry());
+  EXPECT_FALSE(scheduler.pop(out, 0));
+  EXPECT_TRUE(scheduler.empty());
+}
+
+TEST(SchedulerTest, CoalescesTelemetry) {
+  wcpp::StaticScheduler<4, 64> scheduler;
+  uint8_t buf[wcpp::size_max];
+  uint8_t out_buf[wcpp::size_max];
+
+  for (int i = 0; i < 10; i++) {
+    EXPECT_TRUE(scheduler.push(buildTelemetry(buf, 1, 1, i), i));
+  }
+  EXPECT_EQ(scheduler.pending_count(), 1);
+
+  wcpp::Packet out = wcpp::Packet::empty(out_buf, wcpp::size_max);
+  ASSERT_TRUE(scheduler.pop(out, 10));
+  EXPECT_EQ((*out.begin()).getInt(), 9);
+  EXPECT_FALSE(scheduler.pop(out, 10));
+}
+
+TEST(SchedulerTest, RateLimit) {
+  wcpp::StaticScheduler<4, 64> scheduler;
+  EXPECT_TRUE(scheduler.configure(1, 1, 1, 100));
+  uint8_t buf[wcpp::size_max];
+  uint8_t out_buf[wcpp::size_max];
+  wcpp::Packet out = wcpp::Packet::empty(out_buf, wcpp::size_max);
+
+  scheduler.push(buildTelemetry(buf, 1, 1, 0), 0);
+  EXPECT_TRUE(scheduler.pop(out, 0));
+  scheduler.push(buildTelemetry(buf, 1, 1, 1), 10);
+  EXPECT_FALSE(scheduler.ready(50));
+  EXPECT_EQ(scheduler.next_time(50), 100);
+  EXPECT_FALSE(scheduler.pop(out, 50));
+  EXPECT_TRUE(scheduler.ready(100));
+  EXPECT_TRUE(scheduler.pop(out, 100));
+  EXPECT_EQ((*out.begin()).getInt(), 1);
+}
+
+TEST(SchedulerTest, WeightedFairQueuing) {
+  wcpp::StaticScheduler<4, 64> scheduler;
+  EXPECT_TRUE(scheduler.configure(1, 1, 3, 0));
+  EXPECT_TRUE(scheduler.configure(2, 1, 1, 0));
+  uint8_t buf[wcpp::size_max];
+  uint8_t out_buf[wcpp::size_max];
+  wcpp::Packet out = wcpp::Packet::empty(out_buf, wcpp::size_max);
+
+  int sent[3] = {0, 0, 0};
+  for (int t = 0; t < 400; t++) {
+    scheduler.push(buildTelemetry(buf, 1, 1, t), t);
+    scheduler.push(buildTelemetry(buf, 2, 1, t), t);
+    ASSERT_TRUE(scheduler.pop(out, t));
+    sent[out.packet_id()]++;
+  }
+  EXPECT_NEAR(sent[1], 300, 4);
+  EXPECT_NEAR(sent[2], 100, 4);
+}
+
+TEST(SchedulerTest, FixedCapacity) {
+  wcpp::StaticScheduler<2, 16> scheduler;
+  uint8_t buf[wcpp::size_max];
+
+  EXPECT_TRUE(scheduler.push(buildTelemetry(buf, 1, 1, 0), 0));
+  EXPECT_TRUE(scheduler.push(buildTelemetry(buf, 2, 1, 0), 0));
+  EXPECT_FALSE(scheduler.push(buildTelemetry(buf, 3, 1, 0), 0));
+
+  wcpp::Packet c = wcpp::Packet::empty(buf, wcpp::size_max);
+  c.command(5, 2);
+  c.append("Go").setInt(1);
+  EXPECT_TRUE(scheduler.push(c, 0));
+  EXPECT_TRUE(scheduler.push(c, 0));
+  EXPECT_FALSE(scheduler.push(c, 0));
+}
+
+TEST(SchedulerTest, ManyCommands) {
+  wcpp::StaticScheduler<2, 2048> scheduler;
+  uint8_t buf[wcpp::size_max];
+  uint8_t out_buf[wcpp::size_max];
+
+  wcpp::Packet c = wcpp::Packet::empty(buf, wcpp::size_max);
+  for (int i = 0; i < 300; i++) {
+    c.command(i % 100, 2);
+    ASSERT_TRUE(scheduler.push(c, 0));
+  }
+  EXPECT_EQ(scheduler.command_count(), 300u);
+  EXPECT_TRUE(scheduler.ready(0));
+  for (int i = 0; i < 300; i++) {
+    wcpp::Packet out = wcpp::Packet::empty(out_buf, wcpp::size_max);
+    ASSERT_TRUE(scheduler.pop(out, 0));
+  }
+  EXPECT_TRUE(scheduler.empty());
+}
+
+TEST(SchedulerTest, OutTooSmall) {
+  wcpp::StaticScheduler<2, 64> scheduler;
+  uint8_t buf[wcpp::size_max];
+  uint8_t out_buf[wcpp::size_max];
+
+  EXPECT_TRUE(scheduler.push(buildTelemetry(buf, 1, 1, 100), 0));
+  wcpp::Packet c = wcpp::Packet::empty(buf, wcpp::size_max);
+  c.command(5, 2);
+  c.append("Go").setInt(1);
+  EXPECT_TRUE(scheduler.push(c, 0));
+
+  // Nothing is lost: the command stays first until out is big enough
+  wcpp::Packet small = wcpp::Packet::empty(out_buf, 4);
+  EXPECT_FALSE(scheduler.pop(small, 0));
+  EXPECT_EQ(scheduler.command_count(), 1u);
+  EXPECT_EQ(scheduler.pending_count(), 1);
+
+  wcpp::Packet out = wcpp::Packet::empty(out_buf, wcpp::size_max);
+  ASSERT_TRUE(scheduler.pop(out, 0));
+  EXPECT_TRUE(out.isCommand());
+  EXPECT_EQ((*out.begin()).getInt(), 1);
+  out = wcpp::Packet::empty(out_buf, wcpp::size_max);
+  ASSERT_TRUE(scheduler.pop(out, 0));
+  EXPECT_FALSE(out.isCommand());
+  EXPECT_EQ((*out.begin()).getInt(), 100);
+  EXPECT_TRUE(scheduler.empty());
+}
+
+#endif
@@ -0,0 +1,258 @@
+#include "segment.h"
+
+#ifndef ARDUINO
+
+#include <gtest/gtest.h>
+#include <deque>
+#include <random>
+#include <vector>
+
+namespace {
+
+// Packets in flight, losing, duplicating and reordering some of them
+class LossyLink {
+public:
+  LossyLink(uint64_t seed, double loss, double duplicate = 0, double reorder = 0)
+    : engine_(seed), loss_(loss), duplicate_(duplicate), reorder_(reorder) {}
+
+  void send(const wcpp::Packet& p) {
+    std::vector<uint8_t> bytes(p.encode(), p.encode() + p.size());
+    if (chance(loss_)) return;
+    if (chance(duplicate_)) queue_.push_back(bytes);
+    if (chance(reorder_) && !queue_.empty()) queue_.insert(queue_.end() - 1, bytes);
+    else queue_.push_back(bytes);
+  }
+
+  bool receive(std::vector<uint8_t>& out) {
+    if (queue_.empty()) return false;
+    out = queue_.front();
+    queue_.pop_front();
+    return true;
+  }
+
+private:
+  std::mt19937_64 engine_;
+  double loss_;
+  double duplicate_;
+  double reorder_;
+  std::deque<std::vector<uint8_t>> queue_;
+
+  bool chance(double p) {
+    return std::uniform_real_distribution<double>(0, 1)(engine_) < p;
+  }
+};
+
+std::vector<uint8_t> message(uint32_t length) {
+  std::vector<uint8_t> data(length);
+  for (uint32_t i = 0; i < length; i++) data[i] = i * 7 + (i >> 8);
+  return data;
+}
+
+// Runs the transfer to completion, returns the number of rounds
+int transfer(wcpp::Segmenter& tx, wcpp::Reassembler& rx, LossyLink& down, LossyLink& up,
+             std::vector<uint8_t>& streamed, int rounds_max = 100) {
+  int rounds = 0;
+  while (!tx.done() && rounds < rounds_max) {
+    rounds++;
+    uint8_t buf[wcpp::size_max];
+    while (true) {
+      wcpp::Packet p = wcpp::Packet::empty(buf, 64);
+      p.telemetry('F', 3);
+      if (!tx.next(p)) break;
+      down.send(p);
+    }
+
+    std::vector<uint8_t> bytes;
+    while (down.receive(bytes)) {
+      rx.receive(wcpp::Packet::decode(bytes.data()));
+      uint32_t length;
+      const uint8_t* data = rx.read(length);
+      streamed.insert(streamed.end(), data, data + length);
+    }
+
+    // The receiver reports after the burst, as on a timeout
+    wcpp::Packet status = wcpp::Packet::empty(buf, sizeof(buf));
+    status.command('F', 3);
+    if (rx.status(status)) up.send(status);
+    while (up.receive(bytes)) tx.handle(wcpp::Packet::decode(bytes.data()));
+  }
+  return rounds;
+}
+
+} // namespace
+
+TEST(SegmentTest, Lossless) {
+  std::vector<uint8_t> data = message(1000);
+  wcpp::StaticSegmenter<64> tx;
+  wcpp::StaticReassembler<2048> rx;
+  uint8_t chunk = wcpp::segmentChunk(64, false);
+  ASSERT_TRUE(tx.start(1, data.data(), data.size(), chunk));
+  EXPECT_EQ(tx.segments(), (1000u + chunk - 1) / chunk);
+  EXPECT_EQ(tx.pending(), tx.segments());
+
+  LossyLink down(1, 0), up(2, 0);
+  std::vector<uint8_t> streamed;
+  EXPECT_EQ(transfer(tx, rx, down, up, streamed), 1);
+  EXPECT_TRUE(rx.complete());
+  EXPECT_EQ(rx.length(), 1000u);
+  EXPECT_EQ(streamed, data);
+  EXPECT_EQ(rx.duplicates(), 0u);
+  EXPECT_EQ(rx.errors(), 0u);
+}
+
+TEST(SegmentTest, Lossy) {
+  std::vector<uint8_t> data = message(20000);
+  wcpp::StaticSegmenter<1024> tx;
+  wcpp::StaticReassembler<20000, 1024> rx;
+  ASSERT_TRUE(tx.start(7, data.data(), data.size(), wcpp::segmentChunk(64, false)));
+
+  LossyLink down(3, 0.2, 0.05, 0.1), up(4, 0.2);
+  std::vector<uint8_t> streamed;
+  int rounds = transfer(tx, rx, down, up, streamed);
+  EXPECT_TRUE(tx.done());
+  EXPECT_TRUE(rx.complete());
+  EXPECT_EQ(streamed, data);
+  EXPECT_GT(rx.duplicates(), 0u);
+  EXPECT_LT(rounds, 20);
+}
+
+TEST(SegmentTest, StreamsPrefix) {
+  std::vector<uint8_t> data = message(100);
+  wcpp::StaticSegmenter<16> tx;
+  wcpp::StaticReassembler<128> rx;
+  ASSERT_TRUE(tx.start(1, data.data(), data.size(), 20));
+
+  std::vector<std::vector<uint8_t>> segments;
+  uint8_t buf[64];
+  while (true) {
+    wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+    p.telemetry('F', 3);
+    if (!tx.next(p)) break;
+    segments.emplace_back(p.encode(), p.encode() + p.size());
+  }
+  ASSERT_EQ(segments.size(), 5u);
+
+  // Segment 1 first, nothing in order yet
+  uint32_t length;
+  EXPECT_TRUE(rx.receive(wcpp::Packet::decode(segments[1].data())));
+  rx.read(length);
+  EXPECT_EQ(length, 0u);
+  EXPECT_EQ(rx.prefix(), 0u);
+
+  EXPECT_TRUE(rx.receive(wcpp::Packet::decode(segments[0].data())));
+  const uint8_t* got = rx.read(length);
+  ASSERT_EQ(length, 40u);
+  EXPECT_EQ(std::vector<uint8_t>(got, got + length),
+            std::vector<uint8_t>(data.begin(), data.begin() + 40));
+
+  EXPECT_FALSE(rx.receive(wcpp::Packet::decode(segments[0].data())));
+  EXPECT_EQ(rx.duplicates(), 1u);
+
+  // Segments 3 and 4 arrive, 2 is missing
+  rx.receive(wcpp::Packet::decode(segments[3].data()));
+  rx.receive(wcpp::Packet::decode(segments[4].data()));
+  uint8_t status_buf[64];
+  wcpp::Packet status = wcpp::Packet::empty(status_buf, sizeof(status_buf));
+  status.command('F', 3);
+  ASSERT_TRUE(rx.status(status));
+  EXPECT_EQ((*status.find("Of")).getUInt(), 40u);
+  uint8_t bitmap[8];
+  ASSERT_EQ((*status.find("Nk")).getBytes(bitmap), 1);
+  EXPECT_EQ(bitmap[0], 0b001);
+
+  // No room for the bitmap: nothing is added
+  uint8_t short_buf[64];
+  wcpp::Packet short_status = wcpp::Packet::empty(short_buf, status.size() - 1);
+  short_status.command('F', 3);
+  uint8_t size = short_status.size();
+  EXPECT_FALSE(rx.status(short_status));
+  EXPECT_EQ(short_status.size(), size);
+
+  // Only segment 2 goes out again
+  EXPECT_TRUE(tx.handle(status));
+  EXPECT_EQ(tx.pending(), 1u);
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+  p.telemetry('F', 3);
+  ASSERT_TRUE(tx.next(p));
+  EXPECT_EQ((*p.find("Of")).getUInt(), 40u);
+  EXPECT_TRUE(rx.receive(p));
+  got = rx.read(length);
+  ASSERT_EQ(length, 60u);
+  EXPECT_EQ(got[0], data[40]);
+  EXPECT_TRUE(rx.complete());
+}
+
+TEST(SegmentTest, MessageIds) {
+  std::vector<uint8_t> data = message(50);
+  wcpp::StaticSegmenter<16> tx;
+  wcpp::StaticReassembler<128> rx;
+  uint8_t buf[64];
+
+  auto first = [&](uint16_t id) {
+    tx.start(id, data.data(), data.size(), 20);
+    wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+    p.telemetry('F', 3);
+    tx.next(p);
+    return std::vector<uint8_t>(p.encode(), p.encode() + p.size());
+  };
+  std::vector<uint8_t> old = first(0xFFFF);
+  std::vector<uint8_t> current = first(2);
+
+  EXPECT_TRUE(rx.receive(wcpp::Packet::decode(current.data())));
+  // Older across the wrap, ignored
+  EXPECT_FALSE(rx.receive(wcpp::Packet::decode(old.data())));
+  EXPECT_EQ(rx.message_id(), 2);
+
+  std::vector<uint8_t> next = first(3);
+  EXPECT_TRUE(rx.receive(wcpp::Packet::decode(next.data())));
+  EXPECT_EQ(rx.message_id(), 3);
+  EXPECT_EQ(rx.prefix(), 20u);
+
+  // A status for another message is not ours
+  uint8_t status_buf[64];
+  wcpp::Packet status = wcpp::Packet::empty(status_buf, sizeof(status_buf));
+  status.command('F', 3);
+  status.append("Mi").setInt(9);
+  status.append("Of").setInt(50);
+  EXPECT_FALSE(tx.handle(status));
+  EXPECT_FALSE(tx.done());
+}
+
+TEST(SegmentTest, Limits) {
+  std::vector<uint8_t> data = message(300);
+  wcpp::StaticSegmenter<4> tx;
+  EXPECT_FALSE(tx.start(1, data.data(), data.size(), 50));
+  EXPECT_FALSE(tx.start(1, data.data(), data.size(), 0));
+  ASSERT_TRUE(tx.start(1, data.data(), 0, 50));
+  EXPECT_EQ(tx.segments(), 1u);
+
+  // An empty message is one empty segment
+  wcpp::StaticReassembler<16> rx;
+  uint8_t buf[128];
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+  p.telemetry('F', 3);
+  ASSERT_TRUE(tx.next(p));
+  EXPECT_TRUE(rx.receive(p));
+  EXPECT_TRUE(rx.complete());
+
+  // Larger than the receive buffer
+  ASSERT_TRUE(tx.start(2, data.data(), 100, 50));
+  p = wcpp::Packet::empty(buf, sizeof(buf));
+  p.telemetry('F', 3);
+  ASSERT_TRUE(tx.next(p));
+  EXPECT_FALSE(rx.receive(p));
+  EXPECT_EQ(rx.errors(), 1u);
+
+  // No room for the data: nothing is added and the segment stays pending
+  p = wcpp::Packet::empty(buf, 40);
+  p.telemetry('F', 3);
+  p.append("Xx").setInt(1);
+  uint8_t size = p.size();
+  EXPECT_FALSE(tx.next(p));
+  EXPECT_EQ(p.size(), size);
+  p = wcpp::Packet::empty(buf, sizeof(buf));
+  p.telemetry('F', 3);
+  EXPECT_TRUE(tx.next(p));
+}
+
+#endif
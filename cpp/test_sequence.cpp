@@ -0,0 +1,96 @@
+#include "sequence.h"
+
+#ifndef ARDUINO
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+TEST(SequenceTest, PerStream) {
+  wcpp::StaticSequenceTable<16> table;
+  uint8_t buf[wcpp::size_max];
+
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+  for (int i = 0; i < 3; i++) {
+    p.telemetry('T', 2, 1, 5, table);
+    EXPECT_EQ(p.sequence(), i);
+  }
+  // Another component, and a command with the same ID, count on their own
+  p.telemetry('T', 3, 1, 5, table);
+  EXPECT_EQ(p.sequence(), 0);
+  p.command('T', 2, 1, 5, table);
+  EXPECT_EQ(p.sequence(), 0);
+  EXPECT_TRUE(p.isCommand());
+  p.telemetry('T', 2, 1, 5, table);
+  EXPECT_EQ(p.sequence(), 3);
+  EXPECT_EQ(table.used(), 3);
+
+  // The plain setters keep working with numbers
+  uint16_t sequence = 42;
+  p.command('C', 2, 1, 5, sequence);
+  EXPECT_EQ(p.sequence(), 42);
+}
+
+TEST(SequenceTest, Stamp) {
+  wcpp::StaticSequenceTable<16> table;
+  uint8_t buf[wcpp::size_max];
+
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+  p.telemetry('T', 2, 1, 5);
+  p.append("Ct").setInt(7);
+  EXPECT_TRUE(table.stamp(p));
+  EXPECT_TRUE(table.stamp(p));
+  EXPECT_EQ(p.sequence(), 1);
+  EXPECT_EQ((*p.find("Ct")).getInt(), 7);
+
+  p.telemetry('T', 2);
+  EXPECT_FALSE(table.stamp(p));
+  EXPECT_FALSE(p.setSequence(3));
+}
+
+TEST(SequenceTest, Overflow) {
+  wcpp::StaticSequenceTable<2> table;
+  EXPECT_EQ(table.next(1, 1), 0);
+  EXPECT_EQ(table.next(2, 1), 0);
+  EXPECT_EQ(table.next(1, 1), 1);
+
+  // No slot left, these share a counter
+  EXPECT_EQ(table.next(3, 1), 0);
+  EXPECT_EQ(table.next(4, 1), 1);
+  EXPECT_EQ(table.overflowed(), 2u);
+  EXPECT_EQ(table.next(2, 1), 1);
+}
+
+TEST(SequenceTest, Threads) {
+  static wcpp::StaticSequenceTable<64> table;
+  const int threads = 8;
+  const int count = 5000;
+  const int streams = 4;
+
+  std::vector<std::vector<uint16_t>> got(threads * streams);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back([&, t] {
+      for (int i = 0; i < count; i++) {
+        for (int s = 0; s < streams; s++) got[t * streams + s].push_back(table.next(s, 0x80 | 9));
+      }
+    });
+  }
+  for (auto& w : workers) w.join();
+
+  // Every stream handed out each number exactly once
+  for (int s = 0; s < streams; s++) {
+    std::vector<uint16_t> all;
+    for (int t = 0; t < threads; t++) {
+      all.insert(all.end(), got[t * streams + s].begin(), got[t * streams + s].end());
+    }
+    std::sort(all.begin(), all.end());
+    ASSERT_EQ((int)all.size(), threads * count);
+    for (int i = 0; i < threads * count; i++) ASSERT_EQ(all[i], i);
+  }
+  EXPECT_EQ(table.used(), streams);
+  EXPECT_EQ(table.overflowed(), 0u);
+}
+
+#endif
@@ -0,0 +1,90 @@
+#include "telemetry_cache.h"
+
+#ifndef ARDUINO
+
+#include <gtest/gtest.h>
+#include <thread>
+
+static wcpp::Packet buildTelemetry(uint8_t* buf, uint8_t unit, uint8_t component, uint8_t id,
+                                   int64_t value) {
+  wcpp::Packet p = wcpp::Packet::empty(buf, wcpp::size_max);
+  p.telemetry(id, component, unit, 0xFE);
+  p.append("Va").setInt(value);
+  p.append("Vb").setInt(-value);
+  return p;
+}
+
+TEST(TelemetryCacheTest, LatestValue) {
+  wcpp::StaticTelemetryCache<16> cache;
+  uint8_t buf[wcpp::size_max];
+  wcpp::TelemetryCache::Snapshot snapshot;
+
+  EXPECT_FALSE(cache.get(1, 2, 0x83, snapshot));
+
+  for (int i = 0; i < 5; i++) {
+    EXPECT_TRUE(cache.update(buildTelemetry(buf, 1, 2, 3, i), 100 * i));
+    EXPECT_TRUE(cache.update(buildTelemetry(buf, 1, 2, 4, 10 * i), 100 * i));
+  }
+  EXPECT_EQ(cache.size(), 2);
+
+  ASSERT_TRUE(cache.get(1, 2, 0x83, snapshot));
+  EXPECT_EQ((*snapshot.packet().begin()).getInt(), 4);
+  EXPECT_EQ(snapshot.count, 5);
+  EXPECT_EQ(snapshot.time, 400);
+  EXPECT_EQ(snapshot.interval, 100);
+  EXPECT_FLOAT_EQ(snapshot.rate(), 10.0f);
+
+  ASSERT_TRUE(cache.get(buildTelemetry(buf, 1, 2, 4, 0).key(), snapshot));
+  EXPECT_EQ((*snapshot.packet().begin()).getInt(), 40);
+
+  unsigned found = 0;
+  for (unsigned i = 0; i < cache.capacity(); i++) {
+    if (cache.at(i, snapshot)) found++;
+  }
+  EXPECT_EQ(found, 2);
+}
+
+TEST(TelemetryCacheTest, Full) {
+  wcpp::StaticTelemetryCache<4> cache;
+  uint8_t buf[wcpp::size_max];
+
+  for (int i = 0; i < 4; i++) EXPECT_TRUE(cache.update(buildTelemetry(buf, 1, 1, i, 0), 0));
+  EXPECT_FALSE(cache.update(buildTelemetry(buf, 1, 1, 5, 0), 0));
+  EXPECT_TRUE(cache.update(buildTelemetry(buf, 1, 1, 2, 0), 0));
+}
+
+TEST(TelemetryCacheTest, ConcurrentSnapshots) {
+  wcpp::StaticTelemetryCache<64> cache;
+  std::atomic<bool> done(false);
+
+  std::thread writer([&]() {
+    uint8_t buf[wcpp::size_max];
+    for (int i = 1; i <= 200000; i++) {
+      cache.update(buildTelemetry(buf, 1, 2, i % 4, i), i);
+    }
+    done = true;
+  });
+
+  auto reader = [&]() {
+    wcpp::TelemetryCache::Snapshot snapshot;
+    unsigned torn = 0;
+    while (!done) {
+      for (uint8_t id = 0; id < 4; id++) {
+        if (!cache.get(1, 2, 0x80 | id, snapshot)) continue;
+        const wcpp::Packet p = snapshot.packet();
+        auto e = p.begin();
+        int64_t a = (*e).getInt();
+        ++e;
+        if ((*e).getInt() != -a || a % 4 != id) torn++;
+      }
+    }
+    EXPECT_EQ(torn, 0);
+  };
+  std::thread r1(reader), r2(reader);
+
+  writer.join();
+  r1.join();
+  r2.join();
+}
+
+#endif
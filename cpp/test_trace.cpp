@@ -0,0 +1,125 @@
+#include "trace.h"
+
+#ifndef ARDUINO
+
+#include "bus.h"
+
+#include <gtest/gtest.h>
+#include <string>
+
+static uint64_t count(const wcpp::Tracer& tracer, wcpp::TraceStage stage) {
+  wcpp::LatencyHistogram h;
+  tracer.merge(stage, h);
+  return h.count();
+}
+
+static uint64_t count(const wcpp::Tracer& tracer, uint32_t key, wcpp::TraceStage stage) {
+  wcpp::LatencyHistogram h;
+  tracer.merge(key, stage, h);
+  return h.count();
+}
+
+TEST(TraceTest, Clock) {
+  uint64_t start = wcpp::traceTicks();
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  uint64_t ns = wcpp::traceNanos(wcpp::traceTicks() - start);
+  EXPECT_GE(ns, 9000000u);
+  EXPECT_LT(ns, 1000000000u);
+}
+
+TEST(TraceTest, Stages) {
+  static wcpp::StaticPacketPool<4> pool;
+  wcpp::Bus bus(pool);
+  wcpp::Tracer tracer;
+  bus.traceTo(tracer);
+  wcpp::Subscriber* s = bus.subscribe(wcpp::BusFilter());
+
+  wcpp::Packet p = pool.allocate();
+  p.telemetry('T', 0x10, 2, 0, 7);
+  wcpp::Tracer::arrive(p.encode(), wcpp::traceTicks());
+  tracer.record(p, wcpp::TraceStage::deframe);
+  tracer.record(p, wcpp::TraceStage::validate);
+  tracer.record(p, wcpp::TraceStage::route);
+  EXPECT_EQ(bus.publish(p), 1u);
+  uint8_t buf[wcpp::size_max];
+  wcpp::Packet out = wcpp::Packet::empty(buf, sizeof(buf));
+  ASSERT_TRUE(s->receive(out));
+
+  for (unsigned i = 0; i < wcpp::trace_stages; i++) {
+    EXPECT_EQ(count(tracer, (wcpp::TraceStage)i), 1u);
+    EXPECT_EQ(count(tracer, p.key(), (wcpp::TraceStage)i), 1u);
+  }
+  EXPECT_EQ(tracer.keys(), std::vector<uint32_t>{p.key()});
+
+  // A packet that never arrived through a link is not recorded
+  wcpp::Packet q = pool.allocate();
+  q.telemetry('U', 0x10);
+  tracer.record(q, wcpp::TraceStage::deframe);
+  bus.publish(q);
+  ASSERT_TRUE(s->receive(out));
+  // Nor is one that skipped a stage
+  wcpp::Tracer::arrive(q.encode(), wcpp::traceTicks());
+  tracer.record(q, wcpp::TraceStage::route);
+  for (unsigned i = 0; i < wcpp::trace_stages; i++) {
+    EXPECT_EQ(count(tracer, (wcpp::TraceStage)i), 1u);
+  }
+  EXPECT_EQ(tracer.keys().size(), 1u);
+}
+
+TEST(TraceTest, Streams) {
+  static wcpp::StaticPacketPool<4> pool;
+  wcpp::Tracer tracer;
+  const unsigned streams = 2 * wcpp::Tracer::keys_max;
+  for (unsigned i = 0; i < streams; i++) {
+    wcpp::Packet p = pool.allocate();
+    p.telemetry(i % 128, i / 128, 1, 0, 0);
+    wcpp::Tracer::arrive(p.encode(), wcpp::traceTicks());
+    tracer.record(p, wcpp::TraceStage::deframe);
+  }
+  // More streams than slots: the rest count as dropped, the stages do not
+  EXPECT_EQ(count(tracer, wcpp::TraceStage::deframe), streams);
+  EXPECT_LE(tracer.keys().size(), wcpp::Tracer::keys_max);
+  EXPECT_EQ(tracer.keys().size() + tracer.dropped(), streams);
+}
+
+TEST(TraceTest, Threads) {
+  static wcpp::StaticPacketPool<256> pool;
+  wcpp::Tracer tracer;
+  const unsigned threads = 4, packets = 10000;
+
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < threads; t++) {
+    workers.emplace_back([&, t]() {
+      for (unsigned i = 0; i < packets; i++) {
+        wcpp::Packet p = pool.allocate();
+        p.telemetry(i % 32, t, 1, 0, i);
+        wcpp::Tracer::arrive(p.encode(), wcpp::traceTicks());
+        tracer.record(p, wcpp::TraceStage::deframe);
+      }
+    });
+  }
+  for (auto& w : workers) w.join();
+
+  EXPECT_EQ(count(tracer, wcpp::TraceStage::deframe), threads * packets);
+  EXPECT_EQ(count(tracer, wcpp::TraceStage::validate), 0u);
+  // Each thread has 32 streams of its own
+  EXPECT_EQ(tracer.keys().size(), threads * 32);
+  EXPECT_EQ(tracer.dropped(), 0u);
+
+  FILE* file = tmpfile();
+  tracer.dump(file);
+  rewind(file);
+  std::string text;
+  int c;
+  while ((c = fgetc(file)) != EOF) text += (char)c;
+  fclose(file);
+  EXPECT_NE(text.find("deframe"), std::string::npos);
+  uint8_t buf[wcpp::size_max];
+  wcpp::Packet p = wcpp::Packet::empty(buf, sizeof(buf));
+  p.telemetry(31, 3, 1, 0, 0);
+  char line[32];
+  snprintf(line, sizeof(line), "0x01 0x03 0x%02X deframe", p.type_and_id());
+  EXPECT_NE(text.find(line), std::string::npos);
+}
+
+#endif
@@ -0,0 +1,84 @@
+#include "workload.h"
+
+#ifndef ARDUINO
+
+#include <gtest/gtest.h>
+#include <cstring>
+
+// Deepest struct or nested packet level, and the count of each kind
+static int inspect(const wcpp::Entries& entries, unsigned* counts, int depth = 0) {
+  int deepest = depth;
+  for (auto i = entries.begin(); i != entries.end(); ++i) {
+    const wcpp::Entry e = *i;
+    counts[(unsigned)e.kind()]++;
+    if (e.isStruct())      deepest = std::max(deepest, inspect(e.getStruct(), counts, depth + 1));
+    else if (e.isPacket()) deepest = std::max(deepest, inspect(e.getPacket(), counts, depth + 1));
+  }
+  return deepest;
+}
+
+TEST(WorkloadTest, Profiles) {
+  for (const wcpp::WorkloadProfile& profile : wcpp::workload_profiles) {
+    std::mt19937_64 rand(1);
+    unsigned counts[wcpp::entry_kinds] = {};
+    for (int i = 0; i < 2000; i++) {
+      uint8_t buf[wcpp::size_max];
+      wcpp::Packet p = wcpp::generatePacket(profile, buf, rand);
+      ASSERT_TRUE(wcpp::Packet::validate(buf, p.size())) << profile.name;
+      EXPECT_LE(p.size(), profile.size_max) << profile.name;
+      EXPECT_LE(inspect(p, counts), profile.depth_max) << profile.name;
+
+      unsigned n = 0;
+      for (auto e = p.begin(); e != p.end(); ++e) n++;
+      EXPECT_LE(n, profile.entries_max) << profile.name;
+    }
+    for (unsigned k = 0; k < wcpp::entry_kinds; k++) {
+      // Nested packets may be too small to hold anything else
+      if (profile.weights[k] == 0 && k != (unsigned)wcpp::Entry::Kind::null) {
+        EXPECT_EQ(counts[k], 0u) << profile.name << " kind " << k;
+      }
+      if (profile.weights[k] > 0) {
+        EXPECT_GT(counts[k], 0u) << profile.name << " kind " << k;
+      }
+    }
+  }
+}
+
+TEST(WorkloadTest, Weights) {
+  wcpp::WorkloadProfile profile = {"test", {0, 0, 0, 0, 3, 0, 1, 0, 0}, 4, 4, 0, 255, 8, 0};
+  std::mt19937_64 rand(2);
+  unsigned counts[wcpp::entry_kinds] = {};
+  for (int i = 0; i < 5000; i++) {
+    uint8_t buf[wcpp::size_max];
+    wcpp::Packet p = wcpp::generatePacket(profile, buf, rand);
+    EXPECT_TRUE(p.isLocal());
+    inspect(p, counts);
+  }
+  unsigned floats = counts[(unsigned)wcpp::Entry::Kind::float32];
+  unsigned bytes = counts[(unsigned)wcpp::Entry::Kind::bytes];
+  EXPECT_EQ(floats + bytes, 20000u);
+  EXPECT_NEAR((double)floats / bytes, 3.0, 0.2);
+}
+
+TEST(WorkloadTest, Replay) {
+  RandomSequence sequence(3);
+  auto r1 = sequence.begin();
+  auto r2 = sequence.begin();
+  for (int i = 0; i < 100; i++) {
+    uint8_t a[wcpp::size_max], b[wcpp::size_max];
+    wcpp::Packet p = wcpp::generatePacket(wcpp::workload_nested, a, r1);
+    wcpp::Packet q = wcpp::generatePacket(wcpp::workload_nested, b, r2);
+    ASSERT_EQ(p.size(), q.size());
+    EXPECT_EQ(memcmp(a, b, p.size()), 0);
+  }
+
+  // The same seed gives the same packets from a plain engine
+  std::mt19937_64 e1(4), e2(4);
+  uint8_t a[wcpp::size_max], b[wcpp::size_max];
+  wcpp::Packet p = wcpp::generatePacket(wcpp::workload_mixed, a, e1);
+  wcpp::Packet q = wcpp::generatePacket(wcpp::workload_mixed, b, e2);
+  ASSERT_EQ(p.size(), q.size());
+  EXPECT_EQ(memcmp(a, b, p.size()), 0);
+}
+
+#endif
@@ -0,0 +1,175 @@
+#include "trace.h"
+
+#ifndef ARDUINO
+
+#include <algorithm>
+#include <thread>
+
+namespace wcpp {
+
+static double calibrate() {
+#if defined(__x86_64__) || defined(__i386__)
+  uint64_t start_ns = monotonicNanos();
+  uint64_t start = traceTicks();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  uint64_t ns = monotonicNanos() - start_ns;
+  uint64_t ticks = traceTicks() - start;
+  return ticks > 0 ? (double)ns / ticks : 1;
+#else
+  return 1;
+#endif
+}
+
+uint64_t traceNanos(uint64_t ticks) {
+  static const double ns_per_tick = calibrate();
+  return (uint64_t)(ticks * ns_per_tick);
+}
+
+
+static std::atomic<uint64_t> tracer_ids(1);
+
+struct TracerCache {
+  uint64_t id;
+  void* buffer;
+};
+static thread_local TracerCache tracer_cache = {0, nullptr};
+
+Tracer::Tracer() : id_(tracer_ids.fetch_add(1, std::memory_order_relaxed)) {
+  // Calibrate now rather than in the first hook
+  traceNanos(0);
+}
+
+Tracer::~Tracer() {}
+
+Tracer::Buffer::Buffer() : dropped(0) {
+  for (unsigned i = 0; i < keys_max; i++) slots[i].key.store(0, std::memory_order_relaxed);
+}
+
+Tracer::Slot* Tracer::Buffer::find(uint32_t key) {
+  key |= key_used;
+  uint32_t i = probe(key, keys_max, probes_max, [&](uint32_t j) {
+    uint32_t k = slots[j].key.load(std::memory_order_relaxed);
+    return k == key || k == 0;
+  });
+  if (i == keys_max) return nullptr;
+  // Only the owner writes, and the histograms are there from the start
+  if (slots[i].key.load(std::memory_order_relaxed) == 0) {
+    slots[i].key.store(key, std::memory_order_release);
+  }
+  return slots + i;
+}
+
+Tracer::Buffer& Tracer::buffer() {
+  if (tracer_cache.id == id_) return *static_cast<Buffer*>(tracer_cache.buffer);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  Buffer* b = nullptr;
+  // Back to this tracer after another one: the buffer is already there
+  for (auto& buffer : buffers_) {
+    if (buffer->owner == std::this_thread::get_id()) b = buffer.get();
+  }
+  if (b == nullptr) {
+    buffers_.emplace_back(new Buffer());
+    b = buffers_.back().get();
+    b->owner = std::this_thread::get_id();
+  }
+  tracer_cache = {id_, b};
+  return *b;
+}
+
+void Tracer::record(const Packet& packet, TraceStage stage) {
+  uint64_t now = traceTicks();
+  std::atomic<uint64_t>* stamps = PacketPool::stamps(packet.encode());
+  unsigned s = (unsigned)stage;
+  uint64_t arrived = stamps[0].load(std::memory_order_relaxed);
+  uint64_t before = stamps[s].load(std::memory_order_relaxed);
+  if (arrived == 0 || before == 0) return;
+
+  Buffer& b = buffer();
+  b.stages[s].record(traceNanos(now - before));
+  Slot* slot = b.find(packet.key());
+  if (slot != nullptr) slot->stages[s].record(traceNanos(now - arrived));
+  else b.dropped.store(b.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  // Nobody reads a stamp after the last stage
+  if (s + 1 < pool_stamps) stamps[s + 1].store(now, std::memory_order_relaxed);
+}
+
+template <typename F> void Tracer::forEach(F f) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& buffer : buffers_) f(*buffer);
+}
+
+void Tracer::merge(TraceStage stage, LatencyHistogram& out) const {
+  forEach([&](const Buffer& b) { out.merge(b.stages[(unsigned)stage]); });
+}
+
+void Tracer::merge(uint32_t key, TraceStage stage, LatencyHistogram& out) const {
+  key |= key_used;
+  forEach([&](const Buffer& b) {
+    for (unsigned i = 0; i < keys_max; i++) {
+      const Slot& slot = b.slots[i];
+      if (slot.key.load(std::memory_order_acquire) == key) out.merge(slot.stages[(unsigned)stage]);
+    }
+  });
+}
+
+std::vector<uint32_t> Tracer::keys() const {
+  std::vector<uint32_t> keys;
+  forEach([&](const Buffer& b) {
+    for (unsigned i = 0; i < keys_max; i++) {
+      uint32_t k = b.slots[i].key.load(std::memory_order_acquire);
+      if (k != 0) keys.push_back(k & ~key_used);
+    }
+  });
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  return keys;
+}
+
+uint64_t Tracer::dropped() const {
+  uint64_t n = 0;
+  forEach([&](const Buffer& b) { n += b.dropped.load(std::memory_order_relaxed); });
+  return n;
+}
+
+static const char* const trace_stage_names[trace_stages] = {"deframe", "validate", "route", "deliver"};
+
+static void dumpLine(FILE* file, const LatencyHistogram& h) {
+  fprintf(file, "%10llu %9.1f %9.1f %9.1f %9.1f %9.1f\n", (unsigned long long)h.count(),
+          h.percentile(0.5) / 1e3, h.percentile(0.9) / 1e3, h.percentile(0.99) / 1e3,
+          h.percentile(0.999) / 1e3, h.max() / 1e3);
+}
+
+void Tracer::dump(FILE* file) const {
+  // Histograms are too big for the stack
+  std::unique_ptr<LatencyHistogram> h(new LatencyHistogram());
+
+  fprintf(file, "since the stage before, us\n");
+  fprintf(file, "%-16s %10s %9s %9s %9s %9s %9s\n", "stage", "count", "p50", "p90", "p99", "p99.9", "max");
+  for (unsigned s = 0; s < trace_stages; s++) {
+    h->reset();
+    merge((TraceStage)s, *h);
+    fprintf(file, "%-16s ", trace_stage_names[s]);
+    dumpLine(file, *h);
+  }
+
+  fprintf(file, "since arrival, us\n");
+  fprintf(file, "%-4s %-4s %-4s %-9s %10s %9s %9s %9s %9s %9s\n", "unit", "comp", "id", "stage",
+          "count", "p50", "p90", "p99", "p99.9", "max");
+  for (uint32_t key : keys()) {
+    for (unsigned s = 0; s < trace_stages; s++) {
+      h->reset();
+      merge(key, (TraceStage)s, *h);
+      if (h->count() == 0) continue;
+      fprintf(file, "0x%02X 0x%02X 0x%02X %-9s ", key >> 16, key >> 8 & 0xFF, key & 0xFF,
+              trace_stage_names[s]);
+      dumpLine(file, *h);
+    }
+  }
+  if (dropped() > 0) fprintf(file, "%llu not recorded per stream: too many streams\n",
+                             (unsigned long long)dropped());
+}
+
+} // namespace wcpp
+
+#endif
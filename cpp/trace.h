@@ -0,0 +1,116 @@
+#pragma once
+
+#ifndef ARDUINO
+
+#include "fixed.h"
+#include "histogram.h"
+#include "pool.h"
+
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace wcpp {
+
+// Where the time goes between bytes arriving and a consumer getting the
+// packet. Each pooled packet carries a timestamp per stage (PoolBlock), and
+// the hooks record, for each stage, the time since the stage before it and
+// the time since the bytes arrived:
+//
+//   arrival   whoever reads the link stamps the packet (Tracer::arrive)
+//   deframe   the packet is in the pool
+//   validate  it passed validation and dedup
+//   route     it is about to be published
+//   deliver   a subscriber received it
+//
+// Timestamps are TSC ticks where there is one, so a hook costs a few tens
+// of nanoseconds. Each thread records into histograms of its own, with no
+// atomic read-modify-write and no locks after its first hook, so tracing
+// can stay on in production. dump() merges them on the way out.
+
+enum class TraceStage : uint8_t { deframe, validate, route, deliver };
+constexpr unsigned trace_stages = 4;
+static_assert(pool_stamps == trace_stages, "a stamp for the arrival and each stage but the last");
+
+#if defined(__x86_64__) || defined(__i386__)
+// Needs an invariant TSC, which every x86 of the last decade has
+inline uint64_t traceTicks() { return __rdtsc(); }
+#else
+inline uint64_t traceTicks() { return monotonicNanos(); }
+#endif
+
+// Ticks to nanoseconds, calibrated against steady_clock on first use
+uint64_t traceNanos(uint64_t ticks);
+
+class Tracer {
+public:
+  // Packets from this many streams (origin unit, component, packet type and
+  // ID) per thread get histograms of their own, allocated with the thread's
+  // buffer on its first hook. A stream whose slot is not within probes_max
+  // of its hash counts as dropped.
+  static constexpr unsigned keys_max = 128;
+  static constexpr unsigned probes_max = 16;
+
+  Tracer();
+  ~Tracer();
+
+  Tracer(const Tracer&) = delete;
+  Tracer& operator=(const Tracer&) = delete;
+
+  // Stamps a pooled packet with when its bytes arrived, from traceTicks()
+  static inline void arrive(const uint8_t* buf, uint64_t ticks) {
+    std::atomic<uint64_t>* stamps = PacketPool::stamps(buf);
+    stamps[0].store(ticks, std::memory_order_relaxed);
+    for (unsigned i = 1; i < pool_stamps; i++) stamps[i].store(0, std::memory_order_relaxed);
+  }
+
+  // The packet went through the stage. Packets that were not stamped by
+  // arrive(), or skipped the stage before, are not recorded.
+  void record(const Packet& packet, TraceStage stage);
+
+  // Histograms of all threads together, in nanoseconds. Since the stage
+  // before, or since arrival for the per-stream ones.
+  void merge(TraceStage stage, LatencyHistogram& out) const;
+  void merge(uint32_t key, TraceStage stage, LatencyHistogram& out) const;
+  // Streams seen so far, as Packet::key()
+  std::vector<uint32_t> keys() const;
+  uint64_t dropped() const;
+
+  // Percentiles in microseconds of each stage, then of each stream
+  void dump(FILE* file) const;
+
+private:
+  struct Slot {
+    std::atomic<uint32_t> key;
+    LatencyHistogram stages[trace_stages];
+  };
+
+  struct Buffer {
+    LatencyHistogram stages[trace_stages];
+    Slot slots[keys_max];
+    std::atomic<uint64_t> dropped;
+    std::thread::id owner;
+
+    Buffer();
+    Slot* find(uint32_t key);
+  };
+
+  const uint64_t id_;
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<Buffer>> buffers_;
+
+  Buffer& buffer();
+  template <typename F> void forEach(F f) const;
+
+  static constexpr uint32_t key_used = 0x80000000;
+};
+
+} // namespace wcpp
+
+#endif
@@ -0,0 +1,237 @@
+#pragma once
+
+#ifndef ARDUINO
+
+#include "packet.h"
+
+#include <random>
+#include <vector>
+
+// Random packet workloads for tests, fuzzing and benchmarks. A profile sets
+// which kinds of entries appear and how often, how deep structs and nested
+// packets go and how large packets get. Packets are drawn from any source
+// of uint64_t numbers called as rand(): a std::mt19937_64, or a
+// RandomSequence to replay the same numbers later.
+
+// Replayable random numbers. Every number drawn is kept, so an iterator
+// from an earlier point reads the same numbers again.
+class RandomSequence {
+public:
+  class iterator {
+  public:
+    iterator(RandomSequence& sequence_): sequence_(sequence_), i_(0) {
+      fill();
+    }
+    iterator(const iterator& it): sequence_(it.sequence_), i_(it.i_) {}
+    uint64_t operator*() const {
+      return sequence_.history_.at(i_);
+    }
+    uint64_t operator()() {
+      uint64_t rand(**this);
+      ++(*this);
+      return rand;
+    }
+    iterator& operator++() {
+      i_++;
+      fill();
+      return *this;
+    }
+    iterator& operator=(const iterator& it) {
+      sequence_ = it.sequence_;
+      i_ = it.i_;
+      return *this;
+    }
+    iterator next() {
+      iterator n(*this);
+      ++n;
+      return n;
+    }
+    iterator& reroll() {
+      sequence_.history_.erase(std::next(sequence_.history_.begin(), i_), sequence_.history_.end());
+      sequence_.history_.push_back(sequence_.engine_());
+      return *this;
+    }
+  // private:
+    RandomSequence& sequence_;
+    size_t i_;
+
+    void fill() {
+      while (i_ >= sequence_.history_.size()) {
+        sequence_.history_.push_back(sequence_.engine_());
+      }
+    }
+  };
+
+  RandomSequence(uint64_t seed): engine_(seed) {}
+  iterator begin() { return iterator(*this); }
+  size_t size() const { return history_.size(); }
+
+private:
+  std::vector<uint64_t> history_;
+  std::mt19937_64 engine_;
+};
+
+namespace wcpp {
+
+constexpr unsigned entry_kinds = (unsigned)Entry::Kind::packet + 1;
+
+struct WorkloadProfile {
+  const char* name;
+  // Relative weight of each Entry::Kind. Structs and packets are not drawn
+  // at depth_max.
+  uint8_t weights[entry_kinds];
+  // Entries per packet and per struct, unless the packet fills up first
+  uint8_t entries_min;
+  uint8_t entries_max;
+  uint8_t depth_max;
+  // Packet buffer size; entries that do not fit end the packet
+  uint8_t size_max;
+  uint8_t bytes_max;
+  uint8_t remote_percent;
+};
+
+//                                  null uint sint f16 f32 f64 bytes struct packet
+constexpr WorkloadProfile workload_telemetry
+  {"telemetry", {0, 2, 2, 2, 6, 1, 0, 0, 0}, 3, 8, 0, 64, 0, 50};
+constexpr WorkloadProfile workload_mixed
+  {"mixed", {1, 2, 2, 1, 2, 2, 2, 1, 1}, 1, 12, 2, 255, 32, 50};
+constexpr WorkloadProfile workload_nested
+  {"nested", {1, 2, 1, 1, 2, 1, 1, 4, 2}, 2, 6, 4, 255, 16, 50};
+constexpr WorkloadProfile workload_bulk
+  {"bulk", {0, 1, 0, 0, 0, 0, 6, 0, 0}, 1, 6, 0, 255, 120, 100};
+
+constexpr WorkloadProfile workload_profiles[] = {
+  workload_telemetry, workload_mixed, workload_nested, workload_bulk,
+};
+
+template <typename Rand>
+Packet generatePacket(const WorkloadProfile& profile, uint8_t* buf, Rand& rand, int depth = 0);
+
+namespace workload {
+
+template <typename Rand>
+Entry::Kind drawKind(const WorkloadProfile& profile, Rand& rand, int depth) {
+  unsigned kinds = depth < profile.depth_max ? entry_kinds : (unsigned)Entry::Kind::structure;
+  unsigned total = 0;
+  for (unsigned k = 0; k < kinds; k++) total += profile.weights[k];
+  if (total == 0) return Entry::Kind::null;
+
+  unsigned x = rand() % total;
+  unsigned k = 0;
+  while (x >= profile.weights[k]) x -= profile.weights[k++];
+  return (Entry::Kind)k;
+}
+
+// Integers of every encoded length, from a 5 bit inline value to 8 bytes
+inline uint64_t magnitude(uint64_t r, unsigned bytes) {
+  return bytes == 0 ? r % 32 : r >> (64 - 8 * bytes);
+}
+
+template <typename Rand>
+bool fillEntries(const WorkloadProfile& profile, Entries& entries, const Entries& root,
+                 Rand& rand, int depth);
+
+template <typename Rand>
+bool setValue(const WorkloadProfile& profile, Entry& e, Entry::Kind kind, const Entries& root,
+              Rand& rand, int depth) {
+  switch (kind) {
+  case Entry::Kind::null:
+    return e.setNull();
+  case Entry::Kind::unsigned_int: {
+    unsigned bytes = rand() % 9;
+    return e.setInt(magnitude(rand(), bytes));
+  }
+  case Entry::Kind::signed_int: {
+    unsigned bytes = rand() % 9;
+    return e.setInt(-(int64_t)(magnitude(rand(), bytes) >> 1) - 1);
+  }
+  case Entry::Kind::float16:
+    return e.setFloat16((float)(rand() % 20001) / 10 - 1000);
+  case Entry::Kind::float32: {
+    uint64_t r = rand();
+    return e.setFloat32((float)(int32_t)r / (float)((r >> 32) % 1000 + 1));
+  }
+  case Entry::Kind::float64: {
+    uint64_t r = rand();
+    return e.setFloat64((double)(int64_t)r / 1e9);
+  }
+  case Entry::Kind::bytes: {
+    uint8_t bytes[size_max];
+    unsigned length = rand() % (profile.bytes_max + 1u);
+    for (unsigned i = 0; i < length; i += 8) {
+      uint64_t r = rand();
+      for (unsigned j = i; j < length && j < i + 8; j++, r >>= 8) bytes[j] = r;
+    }
+    return e.setBytes(bytes, length);
+  }
+  case Entry::Kind::structure: {
+    SubEntries sub = e.setStruct();
+    if (!e.isStruct()) return false;
+    fillEntries(profile, sub, root, rand, depth + 1);
+    return true;
+  }
+  case Entry::Kind::packet: {
+    // The nested packet is built on the stack, no larger than the room left
+    int room = root.size_remain() - (int)entry_type_size;
+    if (room < 7) return e.setNull();
+    WorkloadProfile inner = profile;
+    if (room < inner.size_max) inner.size_max = room;
+    uint8_t sub_buf[size_max];
+    Packet sub = generatePacket(inner, sub_buf, rand, depth + 1);
+    return e.setPacket(sub);
+  }
+  }
+  return false;
+}
+
+// Appends entries until the count drawn is reached or the next one does not
+// fit; an entry that does not fit is removed
+template <typename Rand>
+bool fillEntries(const WorkloadProfile& profile, Entries& entries, const Entries& root,
+                 Rand& rand, int depth) {
+  unsigned count = profile.entries_min + rand() % (profile.entries_max - profile.entries_min + 1u);
+  auto last = entries.begin();
+  for (unsigned i = 0; i < count; i++) {
+    uint64_t r = rand();
+    char name[2] = {(char)(r % 32 + 64), (char)(r / 32 % 32 + 96)};
+    Entry::Kind kind = drawKind(profile, rand, depth);
+    Entry e = entries.append(name);
+    if (!e) return false;
+    if (!setValue(profile, e, kind, root, rand, depth)) {
+      (*last).remove();
+      return false;
+    }
+    ++last;
+  }
+  return true;
+}
+
+} // namespace workload
+
+// Builds a random packet of the profile in buf, which must hold
+// profile.size_max bytes
+template <typename Rand>
+Packet generatePacket(const WorkloadProfile& profile, uint8_t* buf, Rand& rand, int depth) {
+  Packet p = Packet::empty(buf, profile.size_max);
+  uint64_t r = rand();
+  bool telemetry = r & 1;
+  uint8_t id = r >> 1 & packet_id_mask;
+  uint8_t component = r >> 8;
+  if ((r >> 16 & 0xFF) % 100 < profile.remote_percent) {
+    uint8_t origin = (r >> 24) % 255 + 1;
+    uint8_t dest = r >> 32;
+    uint16_t sequence = r >> 40;
+    if (telemetry) p.telemetry(id, component, origin, dest, sequence);
+    else           p.command(id, component, origin, dest, sequence);
+  }
+  else {
+    if (telemetry) p.telemetry(id, component);
+    else           p.command(id, component);
+  }
+  workload::fillEntries(profile, p, p, rand, depth);
+  return p;
+}
+
+} // namespace wcpp
+
+#endif
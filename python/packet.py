@@ -4,6 +4,12 @@ from typing import List, Optional
 
 from crc import Calculator, Crc8
 
+try:
+    from . import _wcpp
+except ImportError:
+    # Built without the C++ extension, Packet.parse is unavailable
+    _wcpp = None
+
 
 class Entry:
 
@@ -238,8 +244,8 @@ class Entry:
             self.size = self.sub_packet.size
 
         buf = bytearray(2 + len(self.payload))
-        buf[0] = ((self.type_ & 0b000111) << 5) | (ord(self.name[0].upper()) - 64)
-        buf[1] = ((self.type_ & 0b111000) << 2) | (ord(self.name[1].upper()) - 64)
+        buf[0] = ((self.type_ & 0b000111) << 5) | (ord(self.name[0]) & 0b11111)
+        buf[1] = ((self.type_ & 0b111000) << 2) | (ord(self.name[1]) & 0b11111)
         buf[2:] = self.payload
         return buf
 
@@ -412,6 +418,14 @@ class Packet:
         packet.sequence = sequence
         return packet
 
+    @classmethod
+    def parse(cls, text: str) -> "Packet":
+        """Packet from its JSON or text form, encoded by the C++ parser
+        (cpp/parse.h), e.g. '{"id":5,"comp":2,"Ax":1.5,"Nm":"abc"}'"""
+        if _wcpp is None:
+            raise RuntimeError("wcpp was built without its C++ extension")
+        return cls.decode(_wcpp.encode(text))
+
     @classmethod
     def decode(cls, buf: bytes) -> Optional["Packet"]:
         if buf[0] > len(buf):
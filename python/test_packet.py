@@ -1,5 +1,5 @@
 import pytest
-from .packet import Packet, Entry
+from .packet import Packet, Entry, _wcpp
 
 class TestPacket:
     def test_cpp_output(self):
@@ -105,3 +105,23 @@ class TestPacket:
         f = open('cpp/build/sample.bin', 'rb')
         data = f.read()
         assert sample_buf == data
+
+    @pytest.mark.skipif(_wcpp is None, reason="C++ extension not built")
+    def test_parse(self):
+        p = Packet.parse('{"id":5,"comp":2,"AX":1.5,"NM":"abc","Gp":{"La":35.25}}')
+        assert p.is_command() and p.is_local()
+        assert p.packet_id == 5 and p.component_id == 2
+        assert p.find('Ax').is_float16() and p.find('Ax').float() == 1.5
+        assert p.find('Nm').string() == 'abc'
+        assert p.find('Gp').struct()[0].float() == 35.25
+
+        # Same bytes as the Python encoder, which also picks the shortest forms
+        q = Packet.command(5, 2)
+        q.entries = [Entry('Ax').set_float16(1.5), Entry('Nm').set_string('abc')]
+        assert _wcpp.encode('cmd id=5 comp=2 Ax=1.5 Nm="abc"') == q.encode()
+
+        lines = _wcpp.encode_lines('tlm id=1 Ct=1\ntlm id=1 Ct=2\n')
+        assert [Packet.decode(b).find('Ct').int() for b in lines] == [1, 2]
+
+        with pytest.raises(ValueError):
+            Packet.parse('{"id":5,"A1":1}')
@@ -0,0 +1,75 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "parse.h"
+
+// The C++ text and JSON parser (cpp/parse.h), so Python tools encode
+// packets exactly as the C++ side does.
+
+static PyObject* encode(PyObject* self, PyObject* args) {
+  const char* text;
+  Py_ssize_t length;
+  if (!PyArg_ParseTuple(args, "s#", &text, &length)) return nullptr;
+
+  uint8_t buf[wcpp::size_max];
+  wcpp::Packet packet = wcpp::Packet::empty(buf, sizeof(buf));
+  size_t error_at = 0;
+  if (wcpp::parse(text, length, packet, &error_at) == 0) {
+    PyErr_Format(PyExc_ValueError, "invalid packet text at %zu", error_at);
+    return nullptr;
+  }
+  return PyBytes_FromStringAndSize((const char*)buf, packet.size());
+}
+
+static PyObject* encode_lines(PyObject* self, PyObject* args) {
+  const char* text;
+  Py_ssize_t length;
+  if (!PyArg_ParseTuple(args, "s#", &text, &length)) return nullptr;
+
+  PyObject* list = PyList_New(0);
+  if (list == nullptr) return nullptr;
+
+  size_t pos = 0;
+  while (true) {
+    // Skip blank lines, so a trailing newline does not count as a packet
+    while (pos < (size_t)length && (text[pos] == '\n' || text[pos] == '\r' ||
+                                    text[pos] == ' ' || text[pos] == '\t')) pos++;
+    if (pos == (size_t)length) break;
+
+    uint8_t buf[wcpp::size_max];
+    wcpp::Packet packet = wcpp::Packet::empty(buf, sizeof(buf));
+    size_t error_at = 0;
+    size_t n = wcpp::parse(text + pos, length - pos, packet, &error_at);
+    if (n == 0) {
+      PyErr_Format(PyExc_ValueError, "invalid packet text at %zu", pos + error_at);
+      Py_DECREF(list);
+      return nullptr;
+    }
+    pos += n;
+
+    PyObject* bytes = PyBytes_FromStringAndSize((const char*)buf, packet.size());
+    if (bytes == nullptr || PyList_Append(list, bytes) < 0) {
+      Py_XDECREF(bytes);
+      Py_DECREF(list);
+      return nullptr;
+    }
+    Py_DECREF(bytes);
+  }
+  return list;
+}
+
+static PyMethodDef methods[] = {
+  {"encode", encode, METH_VARARGS,
+   "encode(text) -> bytes\n\nEncodes one packet from its JSON or text form."},
+  {"encode_lines", encode_lines, METH_VARARGS,
+   "encode_lines(text) -> list[bytes]\n\nEncodes one packet per line, as NDJSON or text."},
+  {nullptr, nullptr, 0, nullptr},
+};
+
+static struct PyModuleDef module = {
+  PyModuleDef_HEAD_INIT, "_wcpp", nullptr, -1, methods,
+};
+
+PyMODINIT_FUNC PyInit__wcpp(void) {
+  return PyModule_Create(&module);
+}
@@ -1,4 +1,4 @@
-from setuptools import setup
+from setuptools import setup, Extension
 
 setup(
     name="wcpp",
@@ -6,6 +6,16 @@ setup(
     install_requires=['crc', 'pyserial', 'rich', 'getchlib'],
     packages=['wcpp'],
     package_dir={'wcpp': 'python'},
+    ext_modules=[
+        Extension(
+            'wcpp._wcpp',
+            sources=['python/wcppmodule.cpp', 'cpp/parse.cpp', 'cpp/Packet.cpp',
+                     'cpp/float16.cpp', 'cpp/instrument.cpp'],
+            include_dirs=['cpp'],
+            extra_compile_args=['-std=c++20'],
+            language='c++',
+        ),
+    ],
     entry_points={
         'console_scripts':[
             'wcpp-util = wcpp.util:main',
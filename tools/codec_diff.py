@@ -0,0 +1,228 @@
+#!/usr/bin/env python3
+"""Differential test of the C++ (cpp/Packet.cpp) and Python (python/packet.py)
+codecs.
+
+C++ to Python: wcpp_codec_diff builds random packets with RandomSequence and
+writes their bytes and values. Python must decode the same values, write the
+same bytes back, and write the same bytes again when it builds each packet
+from scratch out of those values.
+
+Python to C++: random packets built in Python are decoded by wcpp_codec_diff,
+which must report the values Python put in.
+
+    codec_diff.py path/to/wcpp_codec_diff [-s SEED] [-n COUNT]
+
+ctest runs it as the codec_diff test, and skips it without the crc module.
+"""
+
+import argparse
+import json
+import math
+import random
+import struct
+import subprocess
+import sys
+
+try:
+    from wcpp.packet import Entry, Packet
+except ModuleNotFoundError as e:
+    if e.name != 'crc':
+        raise
+    # ctest counts this exit code as skipped
+    print('codec_diff.py needs the crc module', file=sys.stderr)
+    sys.exit(77)
+
+
+def pairs(text):
+    # Keep the order and any repeated names
+    return json.loads(text, object_pairs_hook=list)
+
+
+def float_equal(entry, value):
+    if value is None:
+        return not math.isfinite(entry.float())
+    if not isinstance(value, (int, float)):
+        return False
+    if entry.is_float16() or entry.is_float32():
+        # The C++ side writes the shortest form that reads back as a float
+        return struct.unpack('<f', struct.pack('<f', value))[0] == entry.float()
+    return float(value) == entry.float()
+
+
+def check_entries(entries, items, where):
+    if len(entries) != len(items):
+        return f'{where}: {len(entries)} entries in Python, {len(items)} in C++'
+    for entry, (name, value) in zip(entries, items):
+        at = f'{where}.{entry.name}'
+        if entry.name != name:
+            return f'{at}: name {name!r} in C++'
+        if entry.is_null():
+            ok = value is None
+        elif entry.is_int():
+            ok = entry.int() == value
+        elif entry.is_float():
+            ok = float_equal(entry, value)
+        elif entry.is_bytes():
+            ok = entry.bytes() == value.encode('latin-1')
+        elif entry.is_struct():
+            error = check_entries(entry.struct(), value, at)
+            if error:
+                return error
+            ok = True
+        elif entry.is_packet():
+            error = check_packet(entry.packet(), value, at)
+            if error:
+                return error
+            ok = True
+        else:
+            ok = False
+        if not ok:
+            return f'{at}: {entry.__str__().strip()} in Python, {value!r} in C++'
+    return None
+
+
+def check_packet(packet, items, where='packet'):
+    header = dict(items[:6])
+    expected = {
+        'type': str(packet.type_),
+        'id': packet.packet_id,
+        'comp': packet.component_id,
+    }
+    if packet.is_remote():
+        expected.update({'from': packet.origin_unit_id, 'to': packet.dest_unit_id,
+                         'seq': packet.sequence})
+    n = len(expected)
+    if dict(items[:n]) != expected:
+        return f'{where}: header {expected} in Python, {header} in C++'
+    return check_entries(packet.entries, items[n:], where)
+
+
+def rebuild_entry(entry):
+    """A new entry with the same value, through the Python setters"""
+    new = Entry(entry.name)
+    if entry.is_null():
+        return new.set_null()
+    if entry.is_int():
+        return new.set_int(entry.int())
+    if entry.is_float16():
+        return new.set_float16(entry.float())
+    if entry.is_float64():
+        return new.set_float64(entry.float())
+    if entry.is_float():
+        return new.set_float32(entry.float())
+    if entry.is_bytes():
+        return new.set_bytes(entry.bytes())
+    if entry.is_struct():
+        return new.set_struct([rebuild_entry(e) for e in entry.struct()])
+    return new.set_packet(rebuild_packet(entry.packet()))
+
+
+def rebuild_packet(packet):
+    new = Packet.telemetry() if packet.is_telemetry() else Packet.command()
+    new.packet_id = packet.packet_id
+    new.component_id = packet.component_id
+    new.origin_unit_id = packet.origin_unit_id
+    new.dest_unit_id = packet.dest_unit_id
+    new.sequence = packet.sequence
+    new.entries = [rebuild_entry(e) for e in packet.entries]
+    return new
+
+
+def cpp_to_python(tool, seed, count):
+    out = subprocess.run([tool, 'gen', str(seed), str(count)], check=True,
+                         capture_output=True, text=True).stdout
+    failures = 0
+    for i, line in enumerate(out.splitlines()):
+        hex_, text = line.split(' ', 1)
+        buf = bytes.fromhex(hex_)
+        packet = Packet.decode(buf)
+        if packet is None:
+            error = 'Python could not decode it'
+        else:
+            error = check_packet(packet, pairs(text))
+            if not error and packet.encode() != buf:
+                error = f'encoded again as {packet.encode().hex()}'
+            if not error and rebuild_packet(packet).encode() != buf:
+                error = f'rebuilt as {rebuild_packet(packet).encode().hex()}'
+        if error:
+            failures += 1
+            print(f'seed {seed + i}: {error}\n  {hex_}\n  {text}')
+    return failures
+
+
+def random_name(rand):
+    return chr(rand.randrange(32) + 64) + chr(rand.randrange(32) + 96)
+
+
+def random_entry(rand, room, depth):
+    entry = Entry(random_name(rand))
+    kind = rand.randrange(10 if depth < 2 and room > 16 else 8)
+    if kind == 0:
+        return entry.set_null()
+    if kind == 1:
+        return entry.set_int(rand.randrange(32))
+    if kind == 2:
+        return entry.set_int(rand.randrange(-2**63 + 1, 2**63))
+    if kind == 3:
+        return entry.set_float16(struct.unpack('<e', struct.pack('<e', rand.uniform(-1000, 1000)))[0])
+    if kind == 4:
+        return entry.set_float32(struct.unpack('<f', struct.pack('<f', rand.uniform(-1e6, 1e6)))[0])
+    if kind == 5:
+        return entry.set_float64(rand.uniform(-1e12, 1e12))
+    if kind in (6, 7):
+        return entry.set_bytes(bytes(rand.randrange(256) for _ in range(rand.randrange(max(1, min(room - 3, 40))))))
+    if kind == 8:
+        return entry.set_struct([random_entry(rand, room // 4, depth + 1)
+                                 for _ in range(rand.randrange(4))])
+    return entry.set_packet(random_packet(rand, room // 2, depth + 1))
+
+
+def random_packet(rand, room=255, depth=0):
+    remote = rand.randrange(2)
+    make = Packet.telemetry if rand.randrange(2) else Packet.command
+    if remote:
+        packet = make(rand.randrange(128), rand.randrange(256), rand.randrange(1, 256),
+                      rand.randrange(256), rand.randrange(65536))
+    else:
+        packet = make(rand.randrange(128), rand.randrange(256))
+    size = 7 if remote else 4
+    for _ in range(rand.randrange(8)):
+        entry = random_entry(rand, room - size, depth)
+        entry_size = len(entry.encode())
+        if size + entry_size > room:
+            break
+        packet.entries.append(entry)
+        size += entry_size
+    return packet
+
+
+def python_to_cpp(tool, seed, count):
+    rand = random.Random(seed)
+    packets = [random_packet(rand) for _ in range(count)]
+    bufs = [p.encode() for p in packets]
+    out = subprocess.run([tool, 'dump'], check=True, capture_output=True, text=True,
+                         input=''.join(b.hex() + '\n' for b in bufs)).stdout
+    failures = 0
+    for packet, buf, text in zip(packets, bufs, out.splitlines()):
+        error = 'C++ found it invalid' if text == 'invalid' else check_packet(packet, pairs(text))
+        if error:
+            failures += 1
+            print(f'python packet: {error}\n  {buf.hex()}\n  {text}')
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('tool', help='Path to wcpp_codec_diff')
+    parser.add_argument('-s', '--seed', type=int, default=1)
+    parser.add_argument('-n', '--count', type=int, default=2000)
+    args = parser.parse_args()
+
+    failures = cpp_to_python(args.tool, args.seed, args.count)
+    failures += python_to_cpp(args.tool, args.seed, args.count)
+    print(f'{failures} of {2 * args.count} packets differ')
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == '__main__':
+    main()